@@ -12,10 +12,13 @@ Last Modified: 3 June 2019
 
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm1"
 
-queue_t mainQueues[MAX_NUM_INPUT_THREADS * MAX_NUM_OUTPUT_THREADS];
+//M x N queues, allocated in run() with shared_alloc()
+queue_t *mainQueues;
 
 //Standard interface to framework for returning the algorithm name
 char* get_name(){
@@ -70,10 +73,8 @@ void * input_thread(void * args){
     size_t baseQueueIndex = threadNum * outputThreadCount;
     size_t maxQueueIndex = baseQueueIndex + outputThreadCount;
 
-    //Each input buffer has 5 flows associated with it that it generates
-    size_t orderForFlow[FLOWS_PER_THREAD] = {0};
-    size_t currFlow, currLength;
-    size_t offset = threadNum * FLOWS_PER_THREAD;
+    //Each input buffer has FLOWS_PER_THREAD flow slots, the generator keeps their orders
+    size_t currFlow, currOrder, currLength;
 	
     //Index for the corresponding buffer and the index within the buffer
     //to write to
@@ -81,26 +82,29 @@ void * input_thread(void * args){
     size_t qIndex = 0;
 
     //Used to randomly generate packets and their headers
-    register unsigned int seed0 = (unsigned int)time(NULL);
-    register unsigned int seed1 = (unsigned int)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, threadNum);
 
     //Say this thread is ready to generate and pass
     input[threadNum].readyFlag = 1;
 
     //Wait until everything else is ready. Framework signals start
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Write packets to their corresponding queues
     while(1){
         // *** START PACKET GENERATOR ***
-        //Min value: offset || Max value: offset + 7
-        seed0 = (214013 * seed0 + 2531011);   
-        currFlow = ((seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset;
-
-        //Min value: 64 || Max value: 8191 + 64
-        seed1 = (214013 * seed1 + 2531011); 
-        currLength = ((seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+        //Next header of the burst, flow id and order within the flow
+        header = next_header(&gen);
+        currFlow = header->flow;
+        currOrder = header->order;
+        currLength = header->length;
+        FILL_PAYLOAD(packetData, currFlow, currOrder, currLength);
         // *** END PACKET GENERATOR  ***
+        PHASE(GENERATE);
 
         //Determine which queue to write the packet data to
         qIndex = (currFlow % (maxQueueIndex - baseQueueIndex)) + baseQueueIndex;
@@ -108,26 +112,24 @@ void * input_thread(void * args){
 
         //If the queue spot is filled then that means the input buffer is 
         //full so continuously check until it becomes open
-        while(mainQueues[qIndex].data[dataIndex].isOccupied == OCCUPIED){
-            ;//Do Nothing until a space is available to write
-        }
+        SPIN_WHILE(QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied == OCCUPIED);
+        PHASE(WAIT);
 
         //Write the packet data to the queue
-        memcpy(&mainQueues[qIndex].data[dataIndex].packet.payload, packetData, currLength);
-        mainQueues[qIndex].data[dataIndex].packet.order = orderForFlow[currFlow - offset];
-        mainQueues[qIndex].data[dataIndex].packet.flow = currFlow;
-        mainQueues[qIndex].data[dataIndex].packet.length = currLength;
+        memcpy(QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.payload, packetData, currLength);
+        PHASE(COPY);
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order = currOrder;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.flow = currFlow;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length = currLength;
 
         //Say that the spot is ready to be read
-        mainQueues[qIndex].data[dataIndex].isOccupied = OCCUPIED;
-
-        //Update the next flow number to assign
-        orderForFlow[currFlow - offset]++;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied = OCCUPIED;
 
         //Update the next spot to be written in the queue
         mainQueues[qIndex].toWrite++;
         if(mainQueues[qIndex].toWrite >= BUFFERSIZE) 
             mainQueues[qIndex].toWrite = 0;
+        PHASE(STAGE);
     }
 
     return NULL;
@@ -174,7 +176,9 @@ void * output_thread(void * args){
     //used to "process" packets to confirm they are in the correct order 
     //before consuming more. Processing threads process until they get 
     //to a spot with no packets
-    size_t expected[MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD] = {0}; 
+    flowTable_t flows;
+    size_t *expected;
+    flow_table_init(&flows, flow_table_share());
     size_t qIndex = baseQueueIndex;
     size_t dataIndex = 0;
 
@@ -185,7 +189,9 @@ void * output_thread(void * args){
     output[threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Go through each space in the output queue until we reach an emtpy 
     //space in which case we swap to the other queue to process its packets
@@ -194,66 +200,85 @@ void * output_thread(void * args){
 
         //If there is no packet move to the next queue it is managing and 
         //start reading
-        if(mainQueues[qIndex].data[dataIndex].isOccupied == NOT_OCCUPIED){
+        if(QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied == NOT_OCCUPIED){
             qIndex += outputThreadCount;
             if(qIndex >= maxQueues) 
                 qIndex = baseQueueIndex;
+            SPIN_MISS();
             continue;
         }
+        SPIN_HIT();
+        PHASE(WAIT);
 
         //Get the current flow for the packet
-        size_t currFlow = mainQueues[qIndex].data[dataIndex].packet.flow;
+        size_t currFlow = QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.flow;
 		
         //Packets order must be equal to the expected order.
-        if(expected[currFlow] != mainQueues[qIndex].data[dataIndex].packet.order){
+        expected = flow_lookup(&flows, currFlow);
+        if(*expected != QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order){
             //Print out the contents of the processing queue that caused an error
             for(int i = 0; i < BUFFERSIZE; i++){
-                printf("Position: %d, Flow: %ld, Order: %ld\n", i, mainQueues[qIndex].data[i].packet.flow, mainQueues[qIndex].data[i].packet.order);
+                printf("Position: %d, Flow: %ld, Order: %ld\n", i, (size_t)QUEUE_SLOT(&mainQueues[qIndex], i)->packet.flow, (size_t)QUEUE_SLOT(&mainQueues[qIndex], i)->packet.order);
             }
             
             //Print out the specific packet that caused the error to the user
-            printf("\nError Packet: Flow %lu | Order %lu\n", mainQueues[qIndex].data[dataIndex].packet.flow,mainQueues[qIndex].data[dataIndex].packet.order);
-            printf("Packet out of order in Output Queue %lu. Expected %lu | Got %lu\n", threadNum, expected[currFlow], mainQueues[qIndex].data[dataIndex].packet.order);
+            printf("\nError Packet: Flow %lu | Order %lu\n", (size_t)QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.flow,(size_t)QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order);
+            printf("Packet out of order in Output Queue %lu. Expected %lu | Got %lu\n", threadNum, *expected, (size_t)QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order);
             exit(1);
         }    
-        size_t currLength = mainQueues[qIndex].data[dataIndex].packet.length;
+        PHASE(VERIFY);
+        size_t currLength = QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length;
+        PHASE(PARSE);
 
         //Pull the data out of the packet
-        memcpy(packetData, &mainQueues[qIndex].data[dataIndex].packet.payload, currLength);
+        memcpy(packetData, QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.payload, currLength);
+        PHASE(COPY);
 
         //Set the position to free. Say it has already processed data
-        mainQueues[qIndex].data[dataIndex].isOccupied = NOT_OCCUPIED;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied = NOT_OCCUPIED;
+        PHASE(PARSE);
 
         //increment the number of packets passed
         output[threadNum].byteCount += currLength + PACKET_HEADER_SIZE;
 
+        //Add the packet to the flow's stream checksum
+        VERIFY_PACKET(currFlow, *expected, currLength);
+        CHECK_PAYLOAD(packetData, currFlow, *expected, currLength);
+
         //Set what the next expected packet for the flow should be
-        expected[currFlow]++;
+        flow_advance(&flows, currFlow, expected);
 
         //Move to the next spot in the outputQueue to process
         mainQueues[qIndex].toRead++;
         if(mainQueues[qIndex].toRead >= BUFFERSIZE) 
             mainQueues[qIndex].toRead = 0;
+        PHASE(VERIFY);
     }
 
     return NULL;
 }
 
 void init_queues(){
-    //initialize all values for built in input/output queues to 0
+    //Give every queue its slots, they start out empty
     for(int qIndex = 0; qIndex < MAX_NUM_INPUT_THREADS * MAX_NUM_OUTPUT_THREADS; qIndex++){
-        for(int dataIndex = 0; dataIndex < BUFFERSIZE; dataIndex++){
-            mainQueues[qIndex].data[dataIndex].packet.flow = 0;
-            mainQueues[qIndex].data[dataIndex].packet.order = 0;
-            mainQueues[qIndex].data[dataIndex].packet.length = 0;
-            mainQueues[qIndex].data[dataIndex].isOccupied = NOT_OCCUPIED;
-        }
-        mainQueues[qIndex].toRead = 0;
-        mainQueues[qIndex].toWrite = 0;
+        queue_init(&mainQueues[qIndex]);
+    }
+}
+
+//Reports how full each queue is for the occupancy sampler.
+//Queue input * outputThreadCount + output carries packets from input to output.
+size_t queue_occupancy(double *fill){
+    size_t numQueues = inputThreadCount * outputThreadCount;
+
+    for(size_t qIndex = 0; qIndex < numQueues; qIndex++){
+        fill[qIndex] = queue_fill(&mainQueues[qIndex]);
     }
+
+    return numQueues;
 }
 
 pthread_t * run(void *argsv){
+    mainQueues = shared_alloc(sizeof(queue_t) * MAX_NUM_INPUT_THREADS * MAX_NUM_OUTPUT_THREADS);
     init_queues();
     return NULL;
 }
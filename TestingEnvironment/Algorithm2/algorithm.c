@@ -1,5 +1,7 @@
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm2"
 
@@ -18,10 +20,13 @@ function get_output_thread(){
 #define BUFFERLEN 1536
 
 size_t partSize;
-packet_t pktQueue[MAX_NUM_OUTPUT_THREADS][BUFFERLEN];
 
-int inFlag[MAX_NUM_INPUT_THREADS];
-int outFlag[MAX_NUM_OUTPUT_THREADS];
+//Shared between input and output threads, allocated in run() with shared_alloc()
+//BUFFERLEN packet slots per output thread, slot i of output out is PKT_SLOT(out, i)
+unsigned char *pktQueue;
+#define PKT_SLOT(out, i) PACKET_AT(pktQueue, (size_t)(out) * BUFFERLEN + (i))
+int *inFlag;
+int *outFlag;
 
 void * input_thread(void * args){
 	threadArgs_t *threadArgs = (threadArgs_t*) args;
@@ -43,13 +48,12 @@ void * input_thread(void * args){
 		toWrite[i] = startPart; // set write pointer to correct partition
 	}
 	
-    register unsigned int g_seed0 = (unsigned int)time(NULL);
-    register unsigned int g_seed1 = (unsigned int)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, threadID);
 	
 	unsigned int mask; 
 	unsigned int outMask;
-	unsigned int flowNum[FLOWS_PER_THREAD] = {0};
-	unsigned int offset = (core - 2)*FLOWS_PER_THREAD;
 	
 	// set mask
 	if(outCount >= 7)
@@ -62,43 +66,48 @@ void * input_thread(void * args){
 		mask = 1;
 		
 	int outIndx = outCount - 1;
-	packet_t currPkt;
+	packetBuffer_t currBuf;
+	packet_t *currPkt = &currBuf.packet;
 	
     input[threadID].readyFlag = 1;
 	
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+	PHASE_MARK();
 
 	while(1){
 		
 		// *** FAST PACKET GENERATOR ***
-		g_seed1 = (214013*g_seed1+2531011);
-		//length = ((g_seed1>>16)&0x1FFF) + 64; //Min value 64: Max value 8191 + 64:
-		currPkt.length = ((g_seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+		header = next_header(&gen); // next header of the burst
+		currPkt->length = header->length;
 		
-		g_seed0 = (214013*g_seed0+2531011);
-		//currFlow = ((g_seed0>>16)&0x0007) + offset + 1;//Min value offset + 1: Max value offset + 9:
-		currPkt.flow =  ((g_seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset + 1;//Min value offset + 1: Max value offset + 9:
+		currPkt->flow = header->flow + 1;//Flow ids from 1, 0 marks a free slot
 		
-		currPkt.order = flowNum[currPkt.flow - offset - 1]++;
+		currPkt->order = header->order;
+		FILL_PAYLOAD(currPkt->payload, header->flow, header->order, header->length);
 		// ************
+		PHASE(GENERATE);
 		
 		// find which output queue to write to using flow and mask
-		if((outMask = currPkt.flow & mask) > outIndx)
+		if((outMask = currPkt->flow & mask) > outIndx)
 			outMask = 0;
 		
-		while(pktQueue[outMask][toWrite[outMask]].flow != 0); // wait for space in partition
+		SPIN_WHILE(PKT_SLOT(outMask, toWrite[outMask])->flow != 0); // wait for space in partition
+		PHASE(WAIT);
  
-		memcpy(&pktQueue[outMask][toWrite[outMask]].payload, &currPkt.payload, currPkt.length);
+		memcpy(PKT_SLOT(outMask, toWrite[outMask])->payload, currPkt->payload, currPkt->length);
+		PHASE(COPY);
 		
-		pktQueue[outMask][toWrite[outMask]].length = currPkt.length;
-		pktQueue[outMask][toWrite[outMask]].order = currPkt.order;
-		pktQueue[outMask][toWrite[outMask]].flow = currPkt.flow;
+		PKT_SLOT(outMask, toWrite[outMask])->length = currPkt->length;
+		PKT_SLOT(outMask, toWrite[outMask])->order = currPkt->order;
+		PKT_SLOT(outMask, toWrite[outMask])->flow = currPkt->flow;
 				
 		toWrite[outMask]++;
 		
 		if(toWrite[outMask] > endPart)
 			toWrite[outMask] = startPart;
+		PHASE(STAGE);
 	}
 	return NULL;
 }
@@ -130,50 +139,66 @@ void * output_thread(void * args){
 		
 	// initialize queues and partitions
 	for(int i = 0; i < outCount; i++){
-		pktQueue[outNum][i].flow = 0;
+		PKT_SLOT(outNum, i)->flow = 0;
 	}
 	
-	unsigned int expected[inCount * FLOWS_PER_THREAD + 1];
-	unsigned int currFlow;
+	flowTable_t flows;
+	size_t *expected;
+	size_t currFlow;
 	int readPart = 0;
 	
-	bzero(expected, sizeof(int) * (inCount*FLOWS_PER_THREAD+1));
+	flow_table_init(&flows, flow_table_share());
 	
-	packet_t currPkt;
+	packetBuffer_t currBuf;
+	packet_t *currPkt = &currBuf.packet;
 	
     output[threadID].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
 	
+	PHASE_MARK();
+
 	while(1){
 		
 		// spin lock & cycles through partitions for available packets
-		while(pktQueue[outNum][toRead[readPart]].flow == 0){
+		while(PKT_SLOT(outNum, toRead[readPart])->flow == 0){
+			SPIN_MISS();
 			readPart++;
 			
 			if(readPart >= inCount)
 				readPart = 0;
 		}
+		SPIN_HIT();
+		
+		PHASE(WAIT);
 		
-		memcpy(&currPkt, &pktQueue[outNum][toRead[readPart]], sizeof(packet_t));
-		//rte_memcpy(&currPkt, &pktQueue[outNum][toRead[readPart]], sizeof(packet_t));
+		memcpy(currPkt, PKT_SLOT(outNum, toRead[readPart]), PKT_SLOT(outNum, toRead[readPart])->length + PACKET_HEADER_SIZE);
+		//rte_memcpy(currPkt, PKT_SLOT(outNum, toRead[readPart]), PKT_SLOT(outNum, toRead[readPart])->length + PACKET_HEADER_SIZE);
+		PHASE(COPY);
 		
-		currFlow = currPkt.flow;
+		//Flows are numbered from 1 here so 0 can mark a free slot
+		currFlow = currPkt->flow - 1;
 		
-		if(expected[currFlow] != currPkt.order){
-            		fprintf(stderr,"ERROR: Packet out of order in queue %d for flow %ld\n", outNum, currPkt.flow);						
-           		fprintf(stderr,"Expected: %d\n", expected[currFlow]);			
-            		fprintf(stderr,"Actual: %ld\n", currPkt.order);
+		expected = flow_lookup(&flows, currFlow);
+		if(*expected != currPkt->order){
+            		fprintf(stderr,"ERROR: Packet out of order in queue %d for flow %ld\n", outNum, currFlow);						
+           		fprintf(stderr,"Expected: %ld\n", *expected);			
+            		fprintf(stderr,"Actual: %ld\n", (size_t)currPkt->order);
 			exit(0);
 		}
+		PHASE(VERIFY);
 		
 		// process packet
-		pktQueue[outNum][toRead[readPart]].flow = 0;
+		PKT_SLOT(outNum, toRead[readPart])->flow = 0;
+		PHASE(PARSE);
 		
 		//pktCount[outNum]++;
-		output[threadID].byteCount += currPkt.length + PACKET_HEADER_SIZE;
-		expected[currFlow]++;
+		output[threadID].byteCount += currPkt->length + PACKET_HEADER_SIZE;
+		VERIFY_PACKET(currFlow, currPkt->order, currPkt->length);
+		CHECK_PAYLOAD(currPkt->payload, currFlow, currPkt->order, currPkt->length);
+		flow_advance(&flows, currFlow, expected);
+		PHASE(VERIFY);
 		
 		toRead[readPart]++;
 		
@@ -187,11 +212,35 @@ void * output_thread(void * args){
 				readPart = 0;
 			
 		}
+		PHASE(PARSE);
 	}
 
 	return NULL;
 }
 
+// reports how full each partition is for the occupancy sampler
+// queue out * inputThreadCount + in is the partition input in writes to in output out's queue
+size_t queue_occupancy(double *fill){
+	size_t numQueues = 0;
+	
+	if(partSize == 0)
+		return 0;
+	
+	for(int outNum = 0; outNum < outputThreadCount; outNum++){
+		for(int part = 0; part < inputThreadCount; part++){
+			size_t used = 0;
+			
+			// a slot holds a packet until the output thread clears its flow
+			for(size_t i = part*partSize; i < (part + 1)*partSize; i++){
+				if(PKT_SLOT(outNum, i)->flow != 0)
+					used++;
+			}
+			fill[numQueues++] = (double)used / partSize;
+		}
+	}
+	return numQueues;
+}
+
 pthread_t * run(void *argsv){
     int inCount = inputThreadCount;
 	
@@ -201,6 +250,10 @@ pthread_t * run(void *argsv){
 
     //Tell the system we are setting the schedule for the thread, instead of inheriting
     Pthread_attr_setinheritsched(&attrs, PTHREAD_EXPLICIT_SCHED);
+
+    pktQueue = shared_alloc(packetStride * MAX_NUM_OUTPUT_THREADS * BUFFERLEN);
+    inFlag = shared_alloc(sizeof(int) * MAX_NUM_INPUT_THREADS);
+    outFlag = shared_alloc(sizeof(int) * MAX_NUM_OUTPUT_THREADS);
 	
 	// calculate cache lined partitions based on 1024 sized queue
 	if((1024/inCount % 64) == 0)
@@ -20,6 +20,8 @@ Last Modified: 3 June 2019
 
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm3"
 
@@ -30,12 +32,15 @@ Last Modified: 3 June 2019
 struct VSegment
 -   isOccupied (size_t) -  Whether all the data there is ready to copy 
 -                           or not
--   data (packet_t array) - Space for packets in the queue. Size defined
-                            by macro VBUFFERSIZE
+-   data (unsigned char *) - Space for VBUFFERSIZE packets in the shared 
+                             region, packetStride bytes each (PACKET_AT())
+-   padding (size_t array) - Keeps the flags of the segments on separate
+                             cache lines
 */
 typedef struct VSegment {
     size_t isOccupied;
-    packet_t data[VBUFFERSIZE];
+    unsigned char *data;
+    size_t padding[6];
 }vseg_t;
 
 /*
@@ -47,8 +52,8 @@ typedef struct VQueue {
     vseg_t segments[NUM_SEGS];
 }vqueue_t;
 
-//Shared memory space to write packets to
-vqueue_t mainQueues[MAX_NUM_INPUT_THREADS];
+//Shared memory space to write packets to, allocated in run() with shared_alloc()
+vqueue_t *mainQueues;
 size_t outputBaseQueues[MAX_NUM_OUTPUT_THREADS];
 size_t outputNumQueues[MAX_NUM_OUTPUT_THREADS];
 
@@ -116,57 +121,60 @@ void * input_thread(void * args){
     size_t dataIndex = 0;
 
     //Each input buffer has 8 flows associated with it that it generates
-    size_t orderForFlow[FLOWS_PER_THREAD] = {0};
-    size_t currFlow, currLength;
-    size_t offset = threadNum * FLOWS_PER_THREAD;
+    size_t currFlow, currOrder, currLength;
 	
     //Used to randomly generate packets and their headers
-    register size_t seed0 = (size_t)time(NULL);
-    register size_t seed1 = (size_t)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, threadNum);
 
     //Say this thread is ready to generate and pass
     input[threadNum].readyFlag = 1;
 
     //Wait until the start flag is given by the framework
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Write packets to their corresponding queues
     while(1){
         //If the queue spot is filled then that means the input buffer is
         //full so continuously check until it becomes open
-        while(mainQueues[qIndex].segments[segIndex].isOccupied == OCCUPIED){
-            ;//Do Nothing until the queue is free to write to
-        }
+        SPIN_WHILE(mainQueues[qIndex].segments[segIndex].isOccupied == OCCUPIED);
+        TRACE(TRACE_ACQUIRE);
+        PHASE(WAIT);
 
         //Write the entire queue block
         for(dataIndex = 0; dataIndex < VBUFFERSIZE; dataIndex++){
             // *** START PACKET GENERATOR ***
-            //Min value: offset || Max value: offset + 7
-            seed0 = (214013 * seed0 + 2531011);   
-            currFlow = ((seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset;
-
-            //Min value: 64 || Max value: 8191 + 64
-            seed1 = (214013 * seed1 + 2531011); 
-            currLength = ((seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+            //Next header of the burst, flow and order come numbered from the generator
+            header = next_header(&gen);
+            currFlow = header->flow;
+            currOrder = header->order;
+            currLength = header->length;
+            FILL_PAYLOAD(packetData, currFlow, currOrder, currLength);
             // *** END PACKET GENERATOR  ***
+            PHASE(GENERATE);
 
             //Write the packet data to the queue
-            memcpy(&mainQueues[qIndex].segments[segIndex].data[dataIndex].payload, packetData, currLength);
-            mainQueues[qIndex].segments[segIndex].data[dataIndex].order = orderForFlow[currFlow - offset];
-            mainQueues[qIndex].segments[segIndex].data[dataIndex].flow = currFlow;
-            mainQueues[qIndex].segments[segIndex].data[dataIndex].length = currLength;
-
-            //Update the next flow number to assign
-            orderForFlow[currFlow - offset]++;
+            memcpy(PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->payload, packetData, currLength);
+            PHASE(COPY);
+            PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->order = currOrder;
+            PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->flow = currFlow;
+            PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->length = currLength;
+            PHASE(STAGE);
         }
 
         //Say that the segment is ready to be read and move onto the next queue it is managing
         mainQueues[qIndex].segments[segIndex].isOccupied = OCCUPIED;
+        TRACE(TRACE_RELEASE);
 
         //Move to the next segment in the queue
         segIndex++;
         if(segIndex >= NUM_SEGS) 
             segIndex = 0;
+        TRACE(TRACE_FLIP);
+        PHASE(STAGE);
     }
 
     return NULL;
@@ -208,7 +216,8 @@ void * output_thread(void * args){
     //used to "process" packets to confirm they are in the correct order 
     //before consuming more. Processing threads process until they get 
     //to a spot with no packets
-    size_t expected[MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD] = {0}; 
+    flowTable_t flows;
+    size_t *expected;
     size_t qIndex;
     size_t baseQIndex = outputBaseQueues[threadNum];
     size_t maxQIndex = baseQIndex + outputNumQueues[threadNum];
@@ -218,71 +227,89 @@ void * output_thread(void * args){
     //Dummy Packet data to write to
     unsigned char packetData[MAX_PAYLOAD_SIZE];
 
+    flow_table_init(&flows, flow_table_share());
+
     //Say this thread is ready to process
     output[threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Go through an entire output queue and consume all packets
     while(1){
         //Cycle through all the queues its managing
         for(qIndex = baseQIndex; qIndex < maxQIndex; qIndex++){
             //Wait till the queue is ready to be read from
-            while(mainQueues[qIndex].segments[segIndex].isOccupied == NOT_OCCUPIED){
-                ; //Wait
-            }
+            SPIN_WHILE(mainQueues[qIndex].segments[segIndex].isOccupied == NOT_OCCUPIED);
+            TRACE(TRACE_ACQUIRE);
+            PHASE(WAIT);
+
+#ifdef FLOW_PREFETCH
+            //Start loading the flow table buckets of the whole segment before passing any of it
+            for(dataIndex = 0; dataIndex < VBUFFERSIZE; dataIndex++)
+                flow_prefetch(&flows, PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->flow);
+#endif
 
             //Go through the entire queue as we know its full and take the packets out
             for(dataIndex = 0; dataIndex < VBUFFERSIZE; dataIndex++){
                 //Get the current flow for the packet
-                size_t currFlow = mainQueues[qIndex].segments[segIndex].data[dataIndex].flow;
+                size_t currFlow = PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->flow;
                 
                 //Packets order must be equal to the expected order.
                 //Implementing less than currflow causes race conditions with writing
                 //Any line that starts with a * is ignored by python script
-                if(expected[currFlow] != mainQueues[qIndex].segments[segIndex].data[dataIndex].order){
+                expected = flow_lookup(&flows, currFlow);
+                if(*expected != PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->order){
                     //Print out the specific packet that caused the error to the user
-                    printf("\nError Packet: Flow %lu | Order %lu\n", mainQueues[qIndex].segments[segIndex].data[dataIndex].flow,mainQueues[qIndex].segments[segIndex].data[dataIndex].order);
-                    printf("Packet out of order in Output Queue %lu. Expected %lu | Got %lu\n", qIndex, expected[currFlow], mainQueues[qIndex].segments[segIndex].data[dataIndex].order);
+                    printf("\nError Packet: Flow %lu | Order %lu\n", (size_t)PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->flow,(size_t)PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->order);
+                    printf("Packet out of order in Output Queue %lu. Expected %lu | Got %lu\n", qIndex, *expected, (size_t)PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->order);
                     exit(1);
                 }    
+                PHASE(VERIFY);
                 //Get the length
-                size_t currLength = mainQueues[qIndex].segments[segIndex].data[dataIndex].length;
+                size_t currLength = PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->length;
+                PHASE(PARSE);
 
                 //Pull the data out of the packet
-                memcpy(packetData, mainQueues[qIndex].segments[segIndex].data[dataIndex].payload, currLength);
+                memcpy(packetData, PACKET_AT(mainQueues[qIndex].segments[segIndex].data, dataIndex)->payload, currLength);
+                PHASE(COPY);
 
                 //increment the number of bits passed
                 output[threadNum].byteCount += currLength + PACKET_HEADER_SIZE;
 
+                //Add the packet to the flow's stream checksum
+                VERIFY_PACKET(currFlow, *expected, currLength);
+                CHECK_PAYLOAD(packetData, currFlow, *expected, currLength);
+
                 //Set what the next expected packet for the flow should be
-                expected[currFlow]++;
+                flow_advance(&flows, currFlow, expected);
+                PHASE(VERIFY);
             }
 
             //Say that the queue is ready to be written to again
             mainQueues[qIndex].segments[segIndex].isOccupied = NOT_OCCUPIED;
+            TRACE(TRACE_RELEASE);
+            PHASE(PARSE);
         } 
 
         //Move to the next segment in the queues it is managing
         segIndex++;
         if(segIndex >= NUM_SEGS) 
             segIndex = 0;
+        TRACE(TRACE_FLIP);
     }
 
     return NULL;
 }
 
 void init_queues(){
-    //initialize all values for built in input/output queues to 0
+    //Give every segment its packet slots, shared_alloc() zeroes them
     for(int qIndex = 0; qIndex < MAX_NUM_INPUT_THREADS; qIndex++){
         for(int segIndex = 0; segIndex < NUM_SEGS; segIndex++){
-            for(int dataIndex = 0; dataIndex < VBUFFERSIZE; dataIndex++){
-                mainQueues[qIndex].segments[segIndex].data[dataIndex].flow = 0;
-                mainQueues[qIndex].segments[segIndex].data[dataIndex].order = 0;
-                mainQueues[qIndex].segments[segIndex].data[dataIndex].length = 0;
-                mainQueues[qIndex].segments[segIndex].isOccupied = NOT_OCCUPIED;
-            }
+            mainQueues[qIndex].segments[segIndex].data = shared_alloc(packetStride * VBUFFERSIZE);
+            mainQueues[qIndex].segments[segIndex].isOccupied = NOT_OCCUPIED;
         }
     }
 
@@ -316,7 +343,23 @@ void assign_queues(size_t numQueuesToAssign[], size_t baseQueuesToAssign[], size
     }
 }
 
+//Reports how full each queue is for the occupancy sampler.
+//Queue i is written by input thread i, a segment counts as full once it is handed over.
+size_t queue_occupancy(double *fill){
+    for(size_t qIndex = 0; qIndex < inputThreadCount; qIndex++){
+        size_t used = 0;
+        for(size_t segIndex = 0; segIndex < NUM_SEGS; segIndex++){
+            if(mainQueues[qIndex].segments[segIndex].isOccupied == OCCUPIED)
+                used++;
+        }
+        fill[qIndex] = (double)used / NUM_SEGS;
+    }
+
+    return inputThreadCount;
+}
+
 pthread_t * run(void *argsv){
+    mainQueues = shared_alloc(sizeof(vqueue_t) * MAX_NUM_INPUT_THREADS);
     init_queues();
     if(inputThreadCount > outputThreadCount){
         assign_queues(outputNumQueues, outputBaseQueues, outputThreadCount, inputThreadCount);
@@ -13,6 +13,8 @@ multiple queues.
 
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm4"
 
@@ -39,53 +41,56 @@ void * input_thread(void * args){
     set_thread_props(inputArgs->coreNum, 2);
 
     //Each input buffer has 5 flows associated with it that it generates
-    size_t orderForFlow[FLOWS_PER_THREAD] = {0};
-    size_t currFlow, currLength;
-    size_t offset = threadNum * FLOWS_PER_THREAD;
+    size_t currFlow, currOrder, currLength;
 	
     size_t index = 0;
+
+    //The packet is put together here before it is copied into the queue
+    packetBuffer_t packetBuffer;
+    packet_t *packet = &packetBuffer.packet;
     
-    register unsigned int seed0 = (unsigned int)time(NULL);
-    register unsigned int seed1 = (unsigned int)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, threadNum);
 
     input[threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     while(1){
         // *** START PACKET GENERATOR ***
-        //Min value: offset || Max value: offset + 7
-        seed0 = (214013 * seed0 + 2531011);   
-        currFlow = ((seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset;
-
-        //Min value: 64 || Max value: 8191 + 64
-        seed1 = (214013 * seed1 + 2531011); 
-        currLength = ((seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+        //Next header of the burst, flow and order come numbered from the generator
+        header = next_header(&gen);
+        currFlow = header->flow;
+        currOrder = header->order;
+        currLength = header->length;
+        FILL_PAYLOAD(packet->payload, currFlow, currOrder, currLength);
         // *** END PACKET GENERATOR  ***
+        PHASE(GENERATE);
 
         //If the queue spot is filled then that means the input buffer is full so continuously check until it becomes open
-        while((*inputQueue).data[index].isOccupied == OCCUPIED){
-            ;
-        }
+        SPIN_WHILE(QUEUE_SLOT(inputQueue, index)->isOccupied == OCCUPIED);
+        PHASE(WAIT);
 
-        packet_t packet;
-        packet.order = orderForFlow[currFlow - offset];
-        packet.length = currLength;
-        packet.flow = currFlow;
+        packet->order = currOrder;
+        packet->length = currLength;
+        packet->flow = currFlow;
+        PHASE(STAGE);
    
         //memcpy simulates the packets data actually being written into the queue by the input thread
-        memcpy(&(*inputQueue).data[index].packet, &packet, currLength + PACKET_HEADER_SIZE);
-
-        //Update the next flow number to assign
-        orderForFlow[currFlow - offset]++;
+        memcpy(&QUEUE_SLOT(inputQueue, index)->packet, packet, currLength + PACKET_HEADER_SIZE);
+        PHASE(COPY);
 
         //Say that the spot is ready to be read
-        (*inputQueue).data[index].isOccupied = OCCUPIED;
+        QUEUE_SLOT(inputQueue, index)->isOccupied = OCCUPIED;
 
         //Update the next spot to be written in the queue
         index++;
         index = index % BUFFERSIZE;
+        PHASE(STAGE);
     }
     return NULL;
 }
@@ -106,67 +111,94 @@ void * output_thread(void * args){
     set_thread_props(outputArgs->coreNum, 2);
 
     //Verifies order for a given flow
-    size_t expected[MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD] = {0}; 
+    flowTable_t flows;
+    size_t *expected;
     size_t index; 
 
+    flow_table_init(&flows, flow_table_share());
+
     output[currentQueue].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     while(1){
         index = (*outputQueue).toRead;
 
-        if ((*outputQueue).data[index].isOccupied == NOT_OCCUPIED) {
+        if (QUEUE_SLOT(outputQueue, index)->isOccupied == NOT_OCCUPIED) {
             //Move to the next queue this output thread is responsible for
             currentQueue = currentQueue + outputThreadCount;
             if(currentQueue >= inputThreadCount) {
                 currentQueue = threadNum;
             }
             outputQueue = &(input[currentQueue].queue);
+            SPIN_MISS();
             continue;
         }
+        SPIN_HIT();
+        PHASE(WAIT);
         //Get the current flow for the packet
-        size_t currFlow = (*outputQueue).data[index].packet.flow;
+        size_t currFlow = QUEUE_SLOT(outputQueue, index)->packet.flow;
 
         // set expected order for given flow to the first packet that it sees
-        if(expected[currFlow] == 0){
-            expected[currFlow] = (*outputQueue).data[index].packet.order;
+        expected = flow_lookup(&flows, currFlow);
+        if(*expected == 0){
+            *expected = QUEUE_SLOT(outputQueue, index)->packet.order;
         }
 		
         //Packets order must be equal to the expected order.
-        if(expected[currFlow] != (*outputQueue).data[index].packet.order){
+        if(*expected != QUEUE_SLOT(outputQueue, index)->packet.order){
             //Print out the contents of the processing queue that caused an error
             for(int i = 0; i < BUFFERSIZE; i++){
-                printf("Position: %d, Flow: %ld, Order: %ld\n", i, (*outputQueue).data[i].packet.flow, (*outputQueue).data[i].packet.order);
+                printf("Position: %d, Flow: %ld, Order: %ld\n", i, (size_t)QUEUE_SLOT(outputQueue, i)->packet.flow, (size_t)QUEUE_SLOT(outputQueue, i)->packet.order);
             }
             
             //Print out the specific packet that caused the error to the user
-            printf("Error Packet: Flow %lu | Order %lu\n", (*outputQueue).data[index].packet.flow, (*outputQueue).data[index].packet.order);
-            printf("Packet out of order in Output Queue %lu. Expected %lu | Got %lu\n", threadNum, expected[currFlow], (*outputQueue).data[index].packet.order);
+            printf("Error Packet: Flow %lu | Order %lu\n", (size_t)QUEUE_SLOT(outputQueue, index)->packet.flow, (size_t)QUEUE_SLOT(outputQueue, index)->packet.order);
+            printf("Packet out of order in Output Queue %lu. Expected %lu | Got %lu\n", threadNum, *expected, (size_t)QUEUE_SLOT(outputQueue, index)->packet.order);
             exit(0);
         }
         else{            
-            
+            //Add the packet to the flow's stream checksum
+            VERIFY_PACKET(currFlow, *expected, QUEUE_SLOT(outputQueue, index)->packet.length);
+
             //Set what the next expected packet for the flow should be
-            expected[currFlow]++;
+            flow_advance(&flows, currFlow, expected);
+            PHASE(VERIFY);
 
             //Move to the next spot in the outputQueue to process
             (*outputQueue).toRead++;
             (*outputQueue).toRead = (*outputQueue).toRead % BUFFERSIZE;
+            PHASE(PARSE);
 	 
             //memcpy simulates the packets data being processed by the output thread.
-	        memcpy(dummyDestination, (*outputQueue).data[index].packet.payload, (*outputQueue).data[index].packet.length);
+	        memcpy(dummyDestination, QUEUE_SLOT(outputQueue, index)->packet.payload, QUEUE_SLOT(outputQueue, index)->packet.length);
+            PHASE(COPY);
+            CHECK_PAYLOAD(dummyDestination, currFlow, QUEUE_SLOT(outputQueue, index)->packet.order, QUEUE_SLOT(outputQueue, index)->packet.length);
+            PHASE(VERIFY);
 
             //increment the number of bits passed
-            output[threadNum].byteCount += (*outputQueue).data[index].packet.length + PACKET_HEADER_SIZE;
+            output[threadNum].byteCount += QUEUE_SLOT(outputQueue, index)->packet.length + PACKET_HEADER_SIZE;
             //Set the position to free. Say it has already processed data
-            (*outputQueue).data[index].isOccupied = NOT_OCCUPIED;
+            QUEUE_SLOT(outputQueue, index)->isOccupied = NOT_OCCUPIED;
+            PHASE(PARSE);
         }
     }
     return NULL;
 }
 
+//Reports how full each queue is for the occupancy sampler.
+//Queue i is the built in queue of input thread i.
+size_t queue_occupancy(double *fill){
+    for(size_t qIndex = 0; qIndex < inputThreadCount; qIndex++){
+        fill[qIndex] = queue_fill(&input[qIndex].queue);
+    }
+
+    return inputThreadCount;
+}
+
 pthread_t * run(void *argsv){
 
     //Initialize thread attributes
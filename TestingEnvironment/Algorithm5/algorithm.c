@@ -21,11 +21,14 @@ Last Modified: 3 June 2019
 */
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm5"
 
 //The middle man queues with a maximum of max(# input threads, # output threads)
-queue_t mainQueues[MAX_NUM_INPUT_THREADS];
+//Allocated in run() with shared_alloc()
+queue_t *mainQueues;
 
 //Base queue to write to and the max queue to write to for the input side
 size_t inputBaseQueues[MAX_NUM_INPUT_THREADS];
@@ -95,70 +98,65 @@ void * input_thread(void * args){
     //The base and limit queues that the thread should write to
     size_t baseQueueIndex = inputBaseQueues[threadNum];
 
-    //Each input buffer has a certain number flows associated with it that it generates
-    size_t orderForFlow[FLOWS_PER_THREAD] = {0};
-
     //Temporary variables that allow superscalar execution
-    size_t currFlow, currLength;
+    size_t currFlow, currOrder, currLength;
 
     //Used to index into the queue struct
     size_t qIndex = 0;
     size_t dataIndex = 0;
 
-    //The offset to not allow duplicate flows
-    //Ex: Thread 1 generates flows: 1, 2, 3, 4 ...
-    //    Thread 2 generates flows: 1 + offset, 2 + offset, 3 + offset ...
-    size_t offset = threadNum * FLOWS_PER_THREAD;
-	
     //Used for the fast random number generator
     //Used a lot for this code so it is a register variable
-    register unsigned int seed0 = (unsigned int)time(NULL);
-    register unsigned int seed1 = (unsigned int)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, threadNum);
 
     //Say this thread is ready to generate and pass
     input[threadNum].readyFlag = 1;
 
     //Wait until the start flag is given by the framework
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Write packets to their corresponding queues the input thread is manageing
     while(1){
         // *** START PACKET GENERATOR ***
-        //Min value: offset || Max value: offset + 7
-        seed0 = (214013 * seed0 + 2531011);   
-        currFlow = ((seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset;
+        //Flows are numbered by the generator so no two threads generate the same flow
+        header = next_header(&gen);
+        currFlow = header->flow;
+        currOrder = header->order;
 
         //Get which queue the flow should go to
         qIndex = (currFlow % numQueuesMan) + baseQueueIndex;
 
         //Min value: 64 || Max value: 8191 + 64
-        seed1 = (214013 * seed1 + 2531011); 
-        currLength = ((seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+        currLength = header->length;
+        FILL_PAYLOAD(packetData, currFlow, currOrder, currLength);
         // *** END PACKET GENERATOR  ***
+        PHASE(GENERATE);
 
         //get the next available index to write the packet to
         dataIndex = mainQueues[qIndex].toWrite;
 
         //If the queue spot is filled then that means the input buffer is full so continuously check until it becomes open
-        while(mainQueues[qIndex].data[dataIndex].isOccupied == OCCUPIED){
-            ;//Do Nothing until the queue is free to write to
-        }
+        SPIN_WHILE(QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied == OCCUPIED);
+        PHASE(WAIT);
 
         //Write the packet data to the queue
-        memcpy(&mainQueues[qIndex].data[dataIndex].packet.payload, packetData, currLength);
-        mainQueues[qIndex].data[dataIndex].packet.order = orderForFlow[currFlow - offset];
-        mainQueues[qIndex].data[dataIndex].packet.flow = currFlow;
-        mainQueues[qIndex].data[dataIndex].packet.length = currLength;
-
-        //Update the next flow number to assign
-        orderForFlow[currFlow - offset]++;
+        memcpy(QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.payload, packetData, currLength);
+        PHASE(COPY);
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order = currOrder;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.flow = currFlow;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length = currLength;
 
         //Say that the segment is ready to be read and move onto the next queue it is managing
-        mainQueues[qIndex].data[dataIndex].isOccupied = OCCUPIED;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied = OCCUPIED;
 
         //Move to the next data index in the queue
         mainQueues[qIndex].toWrite++;
         mainQueues[qIndex].toWrite %= BUFFERSIZE;
+        PHASE(STAGE);
             
     }
 
@@ -200,7 +198,8 @@ void * output_thread(void * args){
 
     //"Process" packets to confirm they are in the correct order before consuming more. 
     //Processing threads process until they get to a spot with no packets
-    size_t expected[MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD] = {0}; 
+    flowTable_t flows;
+    size_t *expected;
 
     //The number of queues that this input thread is writing to
     size_t numQueuesMan = outputNumQueues[threadNum];
@@ -219,11 +218,15 @@ void * output_thread(void * args){
     //Packet data
     unsigned char packetData[MAX_PAYLOAD_SIZE];
 
+    flow_table_init(&flows, flow_table_share());
+
     //Say this thread is ready to process
     output[threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Go through an entire output queue and consume all packets
     while(1){
@@ -231,59 +234,66 @@ void * output_thread(void * args){
         dataIndex = mainQueues[qIndex].toRead;
 
         //If there is no packet to read then move to the next queue it is managing
-        if(mainQueues[qIndex].data[dataIndex].isOccupied == NOT_OCCUPIED){
+        if(QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied == NOT_OCCUPIED){
             qIndex++;
             if(qIndex >= limitQueueIndex)
                 qIndex = baseQueueIndex;
+            SPIN_MISS();
             continue;
         }
+        SPIN_HIT();
+        PHASE(WAIT);
 
         //Get the current flow for the packet
-        currFlow = mainQueues[qIndex].data[dataIndex].packet.flow;
+        currFlow = QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.flow;
 
         //Get the length of the payload of the packet
-        //currLength = mainQueues[qIndex].data[dataIndex].packet.length;
+        //currLength = QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length;
         
         //Packets order must be equal to the expected order.
         //Implementing less than currflow causes race conditions with writing
         //Any line that starts with a * is ignored by python script
-        if(expected[currFlow] != mainQueues[qIndex].data[dataIndex].packet.order){
+        expected = flow_lookup(&flows, currFlow);
+        if(*expected != QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order){
             //Print out the specific packet that caused the error to the user
-            printf("\nError Packet: Flow %lu | Order %lu\n", mainQueues[qIndex].data[dataIndex].packet.flow,mainQueues[qIndex].data[dataIndex].packet.order);
-            printf("Packet out of order in Output thread: %lu at output queue %lu. Expected %lu | Got %lu\n", threadNum, qIndex, expected[currFlow], mainQueues[qIndex].data[dataIndex].packet.order);
+            printf("\nError Packet: Flow %lu | Order %lu\n", (size_t)QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.flow,(size_t)QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order);
+            printf("Packet out of order in Output thread: %lu at output queue %lu. Expected %lu | Got %lu\n", threadNum, qIndex, *expected, (size_t)QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.order);
             exit(1);
         }    
+        PHASE(VERIFY);
 
         //Pull the data out of the packet
-        memcpy(packetData, mainQueues[qIndex].data[dataIndex].packet.payload, mainQueues[qIndex].data[dataIndex].packet.length);
+        memcpy(packetData, QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.payload, QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length);
+        PHASE(COPY);
 
         //increment the number of bits passed
-        output[threadNum].byteCount += mainQueues[qIndex].data[dataIndex].packet.length + PACKET_HEADER_SIZE;
+        output[threadNum].byteCount += QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length + PACKET_HEADER_SIZE;
+
+        //Add the packet to the flow's stream checksum
+        VERIFY_PACKET(currFlow, *expected, QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length);
+        CHECK_PAYLOAD(packetData, currFlow, *expected, QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->packet.length);
 
         //Set what the next expected packet for the flow should be
-        expected[currFlow]++;
+        flow_advance(&flows, currFlow, expected);
+        PHASE(VERIFY);
 
         //Say that the queue is ready to be written to again
-        mainQueues[qIndex].data[dataIndex].isOccupied = NOT_OCCUPIED;
+        QUEUE_SLOT(&mainQueues[qIndex], dataIndex)->isOccupied = NOT_OCCUPIED;
         
         //Move to the next data index to read from in the queue
         mainQueues[qIndex].toRead++;
         if(mainQueues[qIndex].toRead >= BUFFERSIZE)
             mainQueues[qIndex].toRead = 0;
+        PHASE(PARSE);
     }
 
     return NULL;
 }
 
 void init_queues(){
-    //initialize all values for built in input/output queues to 0
+    //Give every queue its slots, they start out empty
     for(int qIndex = 0; qIndex < MAX_NUM_INPUT_THREADS; qIndex++){
-        for(int dataIndex = 0; dataIndex < BUFFERSIZE; dataIndex++){
-            mainQueues[qIndex].data[dataIndex].packet.flow = 0;
-            mainQueues[qIndex].data[dataIndex].packet.order = 0;
-            mainQueues[qIndex].data[dataIndex].packet.length = 0;
-            mainQueues[qIndex].data[dataIndex].isOccupied = NOT_OCCUPIED;
-        }
+        queue_init(&mainQueues[qIndex]);
     }
 
     for(int i = 0; i < MAX_NUM_OUTPUT_THREADS; i++){
@@ -325,6 +335,18 @@ void assignQueues(size_t numQueuesToAssign[], size_t baseQueuesToAssign[], int p
     }
 }
 
+//Reports how full each intermediary queue is for the occupancy sampler.
+//There are max(inputThreadCount, outputThreadCount) of them, see run().
+size_t queue_occupancy(double *fill){
+    size_t numQueues = inputThreadCount >= outputThreadCount ? inputThreadCount : outputThreadCount;
+
+    for(size_t qIndex = 0; qIndex < numQueues; qIndex++){
+        fill[qIndex] = queue_fill(&mainQueues[qIndex]);
+    }
+
+    return numQueues;
+}
+
 pthread_t * run(void *argsv){
     //Get the correct number of intermediary queues
     //This number is equivalent to max(inputThreadCount, outputThreadCount)
@@ -337,6 +359,7 @@ pthread_t * run(void *argsv){
         passerQueueCount = outputThreadCount;
     }
 
+    mainQueues = shared_alloc(sizeof(queue_t) * MAX_NUM_INPUT_THREADS);
     init_queues();
 
     //Determine which input queues go with which passing thread
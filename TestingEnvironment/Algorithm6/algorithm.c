@@ -23,20 +23,28 @@ space. Input queues are merged into output queues with a simple static mapping
 
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm6"
 
 //This buffer size had the best throughput since it matches the cache size
 //on our test system but buffers half this size only performed slightly worse.
 //Change this to match the cache size on your system.
-#define BUFFSIZEBYTES 65536
+//Can be overridden at build time, e.g. make AP=... DEFS=-DBUFFSIZEBYTES=32768
+#ifndef BUFFSIZEBYTES
+    #define BUFFSIZEBYTES 65536
+#endif
 
+//used is how many bytes of the buffer hold packets. It is kept as an offset rather than
+//a pointer into the buffer so a shared queue means the same in every process mapping it.
 typedef struct custom_queue_t{
     unsigned char buffer[BUFFSIZEBYTES];
-    unsigned char *ptr;
+    size_t used;
 } custom_queue_t;
 
-custom_queue_t queues[MAX_NUM_INPUT_THREADS];
+//Shared queues, allocated in run() with shared_alloc()
+custom_queue_t *queues;
 
 char* get_name(){
     return ALGNAME;
@@ -52,7 +60,7 @@ function get_output_thread(){
 
 void initializeCustomQueues(){
     for (int i = 0; i < MAX_NUM_INPUT_THREADS; i++){
-        queues[i].ptr = queues[i].buffer;
+        queues[i].used = 0;
     }
 }
 
@@ -68,64 +76,69 @@ void * input_thread(void * args){
 
     //Initialize a local queue
     custom_queue_t local;
-    local.ptr = local.buffer;
+    local.used = 0;
 
     //Used to write packets to local buffer
-    packet_t packet;
+    packetBuffer_t packetBuffer;
+    packet_t *packet = &packetBuffer.packet;
 
     //Keep track of next order number for a given flow
-    size_t orderForFlow[FLOWS_PER_THREAD] = {0};
-    size_t currFlow; 
+    size_t currFlow;
+    size_t currOrder;
     size_t currLength;
-    size_t offset = inputArgs->threadNum * FLOWS_PER_THREAD;
 	
-    register unsigned int seed0 = (unsigned int)time(NULL);
-    register unsigned int seed1 = (unsigned int)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, inputArgs->threadNum);
 
     input[inputArgs->threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Each iteration writes a packet to the local buffer, when the local buffer
     //is full the entire vector is copied to the shared buffer.
     while(1){
         // *** START PACKET GENERATOR ***
-        //Min value: offset || Max value: offset + 7
-        seed0 = (214013 * seed0 + 2531011);   
-        currFlow = ((seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset;
-
-        //Min value: 64 || Max value: 8191 + 64
-        seed1 = (214013 * seed1 + 2531011); 
-        currLength = ((seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+        //Next header of the burst, flow and order come numbered from the generator
+        header = next_header(&gen);
+        currFlow = header->flow;
+        currOrder = header->order;
+        currLength = header->length;
+        FILL_PAYLOAD(packet->payload, currFlow, currOrder, currLength);
         // *** END PACKET GENERATOR  ***
+        PHASE(GENERATE);
 
         //Generate a packet and write it to the local buffer
-        packet.order = orderForFlow[currFlow - offset];
-        packet.length = currLength;
-        packet.flow = currFlow;
-        memcpy(local.ptr, &packet, currLength + PACKET_HEADER_SIZE);
-
-        //Update local.ptr to the next address we'll write a packet
-        local.ptr += (currLength + PACKET_HEADER_SIZE);
-
-        //Update the next flow number to assign
-        orderForFlow[currFlow - offset]++;
+        packet->order = currOrder;
+        packet->length = currLength;
+        packet->flow = currFlow;
+        memcpy(local.buffer + local.used, packet, currLength + PACKET_HEADER_SIZE);
+
+        //Update local.used to where we'll write the next packet
+        local.used += (currLength + PACKET_HEADER_SIZE);
+        PHASE(STAGE);
         
         //If we don't have room in the local buffer for another packet it's time to memcpy to shared memory.
         //A timeout could be added for real-world situations where few packets are coming in and local buffers
         //take a long time to fill.
-        if ((local.ptr - local.buffer + MAX_PACKET_SIZE) >= BUFFSIZEBYTES) {
+        if ((local.used + MAX_PACKET_SIZE) >= BUFFSIZEBYTES) {
             //Wait while there's still data in the shared buffer
-            while (shared->ptr > shared->buffer) {
-                ;
-            }
+            SPIN_WHILE(shared->used > 0);
+            TRACE(TRACE_ACQUIRE);
+            PHASE(WAIT);
             //Copy the entire vector to shared memory
-            memcpy(shared->buffer, local.buffer, (local.ptr - local.buffer));
+            memcpy(shared->buffer, local.buffer, local.used);
+            TRACE(TRACE_FLUSH);
+            PHASE(COPY);
             //Signal to output_thread there's more data in shared memory and how much
-            shared->ptr = shared->buffer + (local.ptr - local.buffer);
+            shared->used = local.used;
+            TRACE(TRACE_RELEASE);
             //Reset the local queue
-            local.ptr = local.buffer;
+            local.used = 0;
+            PHASE(STAGE);
         }
     }
     return NULL;
@@ -146,74 +159,96 @@ void * output_thread(void * args){
 
     //Initialize local queue;
     custom_queue_t local;
-    local.ptr = local.buffer;
+    local.used = 0;
 
     //Used to read packets from local buffer
-    packet_t packet;
+    packetBuffer_t packetBuffer;
+    packet_t *packet = &packetBuffer.packet;
 
     //Points to the current packet in the local buffer
     unsigned char *readPtr;
 
     //Used to verify order for a given flow
-    size_t expected[MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD] = {0}; 
+    flowTable_t flows;
+    size_t *expected;
+    flow_table_init(&flows, flow_table_share());
 
     output[outputArgs->threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Each iteration copies a full vector from shared memory and processes it.
     while(1){
         //Output threads may have to handle more than one shared queue
         shared = &queues[qIndex];
         //Wait until more data has been written to shared memory
-        while (shared->ptr == shared->buffer) {
-            ;
-        }
+        SPIN_WHILE(shared->used == 0);
+        TRACE(TRACE_ACQUIRE);
+        PHASE(WAIT);
         //Copy the entire vector from shared to local memory
-        memcpy(local.buffer, shared->buffer, (shared->ptr - shared->buffer));
-        //local.ptr marks where data in the local buffer ends
-        local.ptr = local.buffer + (shared->ptr - shared->buffer);
+        memcpy(local.buffer, shared->buffer, shared->used);
+        PHASE(COPY);
+        //local.used marks where data in the local buffer ends
+        local.used = shared->used;
         //Signal to input_thread that shared memory can be written to again
-        shared->ptr = shared->buffer;
+        shared->used = 0;
+        TRACE(TRACE_RELEASE);
+        PHASE(PARSE);
         //readPtr points to the current packet in the local buffer
         readPtr = local.buffer;
 
+#ifdef FLOW_PREFETCH
+        //Start loading the flow table buckets of the whole buffer before passing any of it
+        for(unsigned char *ahead = local.buffer; ahead < local.buffer + local.used; ahead += ((packet_t*) ahead)->length + PACKET_HEADER_SIZE)
+            flow_prefetch(&flows, ((packet_t*) ahead)->flow);
+#endif
+
         //Process all packets in the local buffer.
-        while (readPtr < local.ptr) {
+        while (readPtr < local.buffer + local.used) {
             //This second memcpy arguably isn't needed since all the packet data is local to this
             //thread at this point but I didn't want there to be any confusion over whether this
             //accurately models individual packets being parsed and found that adding it doesn't
             //affect the speed.
-            memcpy(&packet, readPtr, ((packet_t*) readPtr)->length + PACKET_HEADER_SIZE);
+            memcpy(packet, readPtr, ((packet_t*) readPtr)->length + PACKET_HEADER_SIZE);
+            PHASE(PARSE);
         
             //Packets order must be equal to the expected order.
-            if(expected[packet.flow] != packet.order){
+            expected = flow_lookup(&flows, packet->flow);
+            if(*expected != packet->order){
                 //Print out the contents of the local buffer that caused an error
                 int index = 0;
                 unsigned char* indexPtr = local.buffer;
-                while (indexPtr < local.ptr) {
+                while (indexPtr < local.buffer + local.used) {
                     packet_t * errPacket = (packet_t*) indexPtr;
-                    printf("Position: %d, Flow: %ld, Order: %ld\n", index, errPacket->flow, errPacket->order);
+                    printf("Position: %d, Flow: %ld, Order: %ld\n", index, (size_t)errPacket->flow, (size_t)errPacket->order);
                     index++;
                     indexPtr += (errPacket->length + PACKET_HEADER_SIZE);
                 }
                 //Print out the specific packet that caused the error to the user
-                printf("Error Packet: Flow %lu | Order %lu\n", packet.flow, packet.order);
-                printf("Packet out of order in thread: %lu. Expected %lu | Got %lu\n", outputArgs->threadNum, expected[packet.flow], packet.order);
+                printf("Error Packet: Flow %lu | Order %lu\n", (size_t)packet->flow, (size_t)packet->order);
+                printf("Packet out of order in thread: %lu. Expected %lu | Got %lu\n", outputArgs->threadNum, *expected, (size_t)packet->order);
                 exit(0);
             }
             else{              
+                //Add the packet to the flow's stream checksum
+                VERIFY_PACKET(packet->flow, packet->order, packet->length);
+                CHECK_PAYLOAD(packet->payload, packet->flow, packet->order, packet->length);
+
                 //Set what the next expected packet for the flow should be
-                expected[packet.flow]++;
+                flow_advance(&flows, packet->flow, expected);
 
                 //Move readPtr to address of next packet
-                readPtr += (packet.length + PACKET_HEADER_SIZE);
+                readPtr += (packet->length + PACKET_HEADER_SIZE);
 
             }
+            PHASE(VERIFY);
         }
         //At the end of this loop all packets in the local buffer have been processed and we update byteCount
         output[outputArgs->threadNum].byteCount += (readPtr - local.buffer);
+        PHASE(VERIFY);
 
         //Move to the next shared queue this output thread is responsible for
         qIndex = qIndex + outputThreadCount;
@@ -225,8 +260,24 @@ void * output_thread(void * args){
 }
 
 
+//Reports how full each shared buffer is for the occupancy sampler.
+//Queue i is written by input thread i.
+size_t queue_occupancy(double *fill){
+    for(size_t qIndex = 0; qIndex < inputThreadCount; qIndex++){
+        fill[qIndex] = (double)queues[qIndex].used / BUFFSIZEBYTES;
+    }
+
+    return inputThreadCount;
+}
+
 pthread_t * run(void *argsv){
+    //A buffer must have room for at least one packet of the size profile
+    if(MAX_PACKET_SIZE >= BUFFSIZEBYTES){
+        printf("ERROR: %lu byte packets don't fit in BUFFSIZEBYTES (%d), build with a larger one\n", MAX_PACKET_SIZE, BUFFSIZEBYTES);
+        exit(1);
+    }
 
+    queues = shared_alloc(sizeof(custom_queue_t) * MAX_NUM_INPUT_THREADS);
     initializeCustomQueues();
 
     return NULL;
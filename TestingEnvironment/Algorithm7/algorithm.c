@@ -26,13 +26,18 @@ Last Modified: 3 June 2019
 
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm7"
 
 //This buffer size had the best throughput but if latency is considered
 //it could be adjusted. For example, buffers half this size were only 
 //1 Gbps slower for 8 to 8.
-#define BUFFSIZEBYTES 65536
+//Can be overridden at build time, e.g. make AP=... DEFS=-DBUFFSIZEBYTES=32768
+#ifndef BUFFSIZEBYTES
+    #define BUFFSIZEBYTES 65536
+#endif
 
 //Number of segments for the queue
 #define NUM_SEGS 2
@@ -40,11 +45,13 @@ Last Modified: 3 June 2019
 /*
 struct VBSegment
 -   buffer (unsigned char array) -  where all the data is written to.
--   ptr (unsigned char *) - where we currently are in the buffer.
+-   used (size_t) - how many bytes of the buffer hold packets. An offset
+-                   rather than a pointer into the buffer so a shared segment
+-                   means the same in every process that maps it.
 */
 typedef struct VBSegment{
     unsigned char buffer[BUFFSIZEBYTES];
-    unsigned char *ptr;
+    size_t used;
 } vbseg_t;
 
 /*
@@ -56,8 +63,8 @@ typedef struct VBQueue{
     vbseg_t segment[NUM_SEGS];
 } vbqueue_t;
 
-//Custom queues that the threads read and write to
-vbqueue_t queues[MAX_NUM_INPUT_THREADS];
+//Custom queues that the threads read and write to, allocated in run() with shared_alloc()
+vbqueue_t *queues;
 
 //Standard interface to framework for returning the algorithm name
 char* get_name(){
@@ -77,7 +84,7 @@ function get_output_thread(){
 void initializeCustomQueues(){
     for (int i = 0; i < MAX_NUM_INPUT_THREADS; i++){
         for(int j = 0; j < NUM_SEGS; j++){
-            queues[i].segment[j].ptr = queues[i].segment[j].buffer;
+            queues[i].segment[j].used = 0;
         }
     }
 }
@@ -100,7 +107,7 @@ Attributes:
 -   local buffer again.
 
 -   Packets are written back to back in a byte array that is of size
--   BUFFSIZEBYTES. the ptr is used to index into the array. Each time
+-   BUFFSIZEBYTES. used is the index into the array. Each time
 -   a packet is written we check if another packet can fit or not into
 -   the buffer. If not we copy the buffer to shared memory.
 
@@ -139,26 +146,29 @@ void * input_thread(void * args){
 
     //Initialize a local queue
     vbseg_t local;
-    local.ptr = local.buffer;
+    local.used = 0;
 
     //Dummy data to copy
     unsigned char data[MAX_PAYLOAD_SIZE];
+    packet_t *staged;
 
     //Keep track of next order number for a given flow
-    size_t orderForFlow[FLOWS_PER_THREAD] = {0};
     size_t currFlow;
+    size_t currOrder;
     size_t currLength;
-    size_t offset = inputArgs->threadNum * FLOWS_PER_THREAD;
 	
     //Used for generating packets randomly
-    register unsigned int seed0 = (unsigned int)time(NULL);
-    register unsigned int seed1 = (unsigned int)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, threadIndex);
 
     //Signal that this thread is ready to start passing
     input[inputArgs->threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Each iteration writes a packet to the local buffer, when the local buffer
     //is full the entire vector is copied to the shared buffer.
@@ -166,46 +176,48 @@ void * input_thread(void * args){
         //Cycle through each segment we want to write to.
         for(size_t i = 0; i < NUM_SEGS; i++){
             shared1 = &queues[threadIndex].segment[i];
+            TRACE(TRACE_FLIP);
             while(1){
                 // *** START PACKET GENERATOR ***
-                //Min value: offset || Max value: offset + 7
-                seed0 = (214013 * seed0 + 2531011);   
-                currFlow = ((seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset;
-
-                //Min value: 64 || Max value: 8191 + 64
-                seed1 = (214013 * seed1 + 2531011); 
-                currLength = ((seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+                //Next header of the burst, flow and order come numbered from the generator
+                header = next_header(&gen);
+                currFlow = header->flow;
+                currOrder = header->order;
+                currLength = header->length;
+                FILL_PAYLOAD(data, currFlow, currOrder, currLength);
                 // *** END PACKET GENERATOR  ***
+                PHASE(GENERATE);
 
                 //Write the packet data to the local buffer
-                memcpy(local.ptr, &currFlow, 8);
-                local.ptr += 8;
-                memcpy(local.ptr, &currLength, 8);
-                local.ptr += 8;
-                memcpy(local.ptr, &orderForFlow[currFlow - offset], 8);
-                local.ptr += 8;
-                memcpy(local.ptr, data, currLength);
-                local.ptr += currLength;
-
-                //Update the next flow number to assign
-                orderForFlow[currFlow - offset]++;
+                //The header is written through packet_t so it matches the build's header layout
+                staged = (packet_t *)(local.buffer + local.used);
+                staged->flow = currFlow;
+                staged->length = currLength;
+                staged->order = currOrder;
+                memcpy(staged->payload, data, currLength);
+                local.used += currLength + PACKET_HEADER_SIZE;
+                PHASE(STAGE);
                 
                 //If we don't have room in the local buffer for another packet it's time to memcopy to shared memory.
                 //A timeout could be added for real-world situations where few packets are coming in and local buffers
                 //take a long time to fill.
-                if ((local.ptr - local.buffer + MAX_PACKET_SIZE) >= BUFFSIZEBYTES) {
+                if ((local.used + MAX_PACKET_SIZE) >= BUFFSIZEBYTES) {
                     //If there's still data in the shared buffer, wait
-                    while (shared1->ptr > shared1->buffer) {
-                        ;
-                    }
+                    SPIN_WHILE(shared1->used > 0);
+                    TRACE(TRACE_ACQUIRE);
+                    PHASE(WAIT);
                     //Copy the entire vector to shared memory
-                    memcpy(shared1->buffer, local.buffer, (local.ptr - local.buffer));
+                    memcpy(shared1->buffer, local.buffer, local.used);
+                    TRACE(TRACE_FLUSH);
+                    PHASE(COPY);
 
                     //Signal to output_thread there's more data in shared memory and how much
-                    shared1->ptr = shared1->buffer + (local.ptr - local.buffer);
+                    shared1->used = local.used;
+                    TRACE(TRACE_RELEASE);
 
                     //Reset the local queue
-                    local.ptr = local.buffer;
+                    local.used = 0;
+                    PHASE(STAGE);
                     break;
                 }
             }
@@ -265,80 +277,103 @@ void * output_thread(void * args){
 
     //Initialize local queue;
     vbseg_t local;
-    local.ptr = local.buffer;
+    local.used = 0;
 
     //Used to convert into a packet struct
-    packet_t packet;
+    packetBuffer_t packetBuffer;
+    packet_t *packet = &packetBuffer.packet;
 
     //readPtr points to the current packet in the local buffer
     unsigned char *readPtr;
 
     //Used to verify order for a given flow
-    size_t expected[MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD] = {0}; 
+    flowTable_t flows;
+    size_t *expected;
+    flow_table_init(&flows, flow_table_share());
 
     output[outputArgs->threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Each iteration copies a full vector from shared memory and processes it.
     while(1){
         for(size_t i = 0; i < NUM_SEGS; i++){
             //Get a local variable for readability
             shared1 = &queues[qIndex].segment[i];
+            TRACE(TRACE_FLIP);
 
             //Wait until more data has been written to shared memory
-            while (shared1->ptr == shared1->buffer) {
-                ;
-            }
+            SPIN_WHILE(shared1->used == 0);
+            TRACE(TRACE_ACQUIRE);
+            PHASE(WAIT);
             //Copy the entire vector from shared to local memory
-            memcpy(local.buffer, shared1->buffer, (shared1->ptr - shared1->buffer));
+            memcpy(local.buffer, shared1->buffer, shared1->used);
+            PHASE(COPY);
 
-            //local.ptr marks where data in the local buffer ends
-            local.ptr = local.buffer + (shared1->ptr - shared1->buffer);
+            //local.used marks where data in the local buffer ends
+            local.used = shared1->used;
 
             //Signal to input_thread that shared memory can be written to again
-            shared1->ptr = shared1->buffer;
+            shared1->used = 0;
+            TRACE(TRACE_RELEASE);
+            PHASE(PARSE);
 
             //readPtr points to the current packet in the local buffer
             readPtr = local.buffer;
 
+#ifdef FLOW_PREFETCH
+            //Start loading the flow table buckets of the whole buffer before passing any of it
+            for(unsigned char *ahead = local.buffer; ahead < local.buffer + local.used; ahead += ((packet_t*) ahead)->length + PACKET_HEADER_SIZE)
+                flow_prefetch(&flows, ((packet_t*) ahead)->flow);
+#endif
+
             //Process all packets in the local buffer.
-            while (readPtr < local.ptr) {
+            while (readPtr < local.buffer + local.used) {
                 //This second memcpy arguably isn't needed since all the packet data is local to this
                 //thread at this point but I didn't want there to be any confusion over whether this
                 //accurately models individual packets being parsed and found that adding it doesn't
                 //affect the speed.  
-                memcpy(&packet, readPtr, ((packet_t*) readPtr)->length + PACKET_HEADER_SIZE);
+                memcpy(packet, readPtr, ((packet_t*) readPtr)->length + PACKET_HEADER_SIZE);
+                PHASE(PARSE);
 
                 //Packets order must be equal to the expected order.
-                if(expected[packet.flow] != packet.order){
+                expected = flow_lookup(&flows, packet->flow);
+                if(*expected != packet->order){
                     //Print out the contents of the local buffer that caused an error
                     int index = 0;
                     unsigned char* indexPtr = local.buffer;
-                    while (indexPtr < local.ptr) {
+                    while (indexPtr < local.buffer + local.used) {
                         packet_t * errPacket = (packet_t*) indexPtr;
-                        printf("Position: %d, Flow: %ld, Order: %ld\n", index, errPacket->flow, errPacket->order);
+                        printf("Position: %d, Flow: %ld, Order: %ld\n", index, (size_t)errPacket->flow, (size_t)errPacket->order);
                         index++;
                         indexPtr += (errPacket->length + PACKET_HEADER_SIZE);
                     }
 
                     //Print out the specific packet that caused the error to the user
-                    printf("Error Packet: Flow %lu | Order %lu\n", packet.flow, packet.order);
-                    printf("Packet out of order in thread: %lu. Expected %lu | Got %lu\n", outputArgs->threadNum, expected[packet.flow], packet.order);
+                    printf("Error Packet: Flow %lu | Order %lu\n", (size_t)packet->flow, (size_t)packet->order);
+                    printf("Packet out of order in thread: %lu. Expected %lu | Got %lu\n", outputArgs->threadNum, *expected, (size_t)packet->order);
                     exit(0);
                 }
                 else{              
+                    //Add the packet to the flow's stream checksum
+                    VERIFY_PACKET(packet->flow, packet->order, packet->length);
+                    CHECK_PAYLOAD(packet->payload, packet->flow, packet->order, packet->length);
+
                     //Set what the next expected packet for the flow should be
-                    expected[packet.flow]++;
+                    flow_advance(&flows, packet->flow, expected);
 
                     //Move readPtr to address of next packet
-                    readPtr += (packet.length + PACKET_HEADER_SIZE);
+                    readPtr += (packet->length + PACKET_HEADER_SIZE);
                 }
+                PHASE(VERIFY);
             }
 
             //At the end of this loop all packets in the local buffer have been processed and we update byteCount
             output[outputArgs->threadNum].byteCount += (readPtr - local.buffer);
+            PHASE(VERIFY);
         }
 
         //Move to the next shared queue this output thread is responsible for
@@ -351,8 +386,28 @@ void * output_thread(void * args){
     return NULL;
 }
 
+//Reports how full each queue is for the occupancy sampler, averaged over its segments.
+//Queue i is written by input thread i.
+size_t queue_occupancy(double *fill){
+    for(size_t qIndex = 0; qIndex < inputThreadCount; qIndex++){
+        double used = 0;
+        for(size_t segIndex = 0; segIndex < NUM_SEGS; segIndex++){
+            used += (double)queues[qIndex].segment[segIndex].used / BUFFSIZEBYTES;
+        }
+        fill[qIndex] = used / NUM_SEGS;
+    }
+
+    return inputThreadCount;
+}
+
 pthread_t * run(void *argsv){
+    //A buffer must have room for at least one packet of the size profile
+    if(MAX_PACKET_SIZE >= BUFFSIZEBYTES){
+        printf("ERROR: %lu byte packets don't fit in BUFFSIZEBYTES (%d), build with a larger one\n", MAX_PACKET_SIZE, BUFFSIZEBYTES);
+        exit(1);
+    }
 
+    queues = shared_alloc(sizeof(vbqueue_t) * MAX_NUM_INPUT_THREADS);
     initializeCustomQueues();
 
     return NULL;
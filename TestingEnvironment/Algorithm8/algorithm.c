@@ -35,21 +35,28 @@ Last Modified: 3 June 2019
 
 #include "../FrameworkSRC/global.h"
 #include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
 
 #define ALGNAME "Algorithm8"
 
 //This buffer size had the best throughput but if latency is considered it could be 
 //adjusted. For example, buffers half this size were only 1 Gbps slower for 8 to 8.
-#define BUFFSIZEBYTES 65536
+//Can be overridden at build time, e.g. make AP=... DEFS=-DBUFFSIZEBYTES=32768
+#ifndef BUFFSIZEBYTES
+    #define BUFFSIZEBYTES 65536
+#endif
 
 /*
 struct VBSegment
 -   buffer (unsigned char array) -  where all the data is written to.
--   ptr (unsigned char *) - where we currently are in the buffer.
+-   used (size_t) - how many bytes of the buffer hold packets. An offset
+-                   rather than a pointer into the buffer so a shared segment
+-                   means the same in every process that maps it.
 */
 typedef struct VBSeg{
     unsigned char buffer[BUFFSIZEBYTES];
-    unsigned char *ptr;
+    size_t used;
 } vbseg_t;
 
 /*
@@ -65,8 +72,8 @@ typedef struct VBQueue{
     size_t paddingR[8];
 } vbqueue_t;
 
-//Shared queues
-vbqueue_t queues[MAX_NUM_OUTPUT_THREADS][MAX_NUM_INPUT_THREADS];
+//Shared queues, queues[output][input], allocated in run() with shared_alloc()
+vbqueue_t (*queues)[MAX_NUM_INPUT_THREADS];
 
 //Standard interface to framework for returning the algorithm name
 char* get_name(){
@@ -87,7 +94,7 @@ void initializeCustomQueues(){
     for (int i = 0; i < MAX_NUM_OUTPUT_THREADS; i++){
         for (int j = 0; j < MAX_NUM_INPUT_THREADS; j++){
             for(int k = 0; k < 2; k ++){
-                queues[i][j].seg[k].ptr = queues[i][j].seg[k].buffer;
+                queues[i][j].seg[k].used = 0;
             }
         }
     }
@@ -139,7 +146,7 @@ void * input_thread(void * args){
     //Initialize all local queues
     vbseg_t * local = (vbseg_t *)Malloc(sizeof(vbseg_t) * outputThreadCount);
     for(size_t i = 0; i < outputThreadCount; i++){
-        local[i].ptr = local[i].buffer;
+        local[i].used = 0;
     }
 
     //Which segment we are currently writing for a given queue
@@ -163,76 +170,81 @@ void * input_thread(void * args){
 
     //Dummy data to copy
     unsigned char data[MAX_PAYLOAD_SIZE];
+    packet_t *staged;
 
     //Keep track of next order number for a given flow
-    size_t orderForFlow[FLOWS_PER_THREAD] = {0};
     size_t currFlow;
+    size_t currOrder;
     size_t currLength;
-    size_t offset = inputArgs->threadNum * FLOWS_PER_THREAD;
 	
     //Used for generating random numbers
-    register unsigned int seed0 = (unsigned int)time(NULL);
-    register unsigned int seed1 = (unsigned int)time(NULL);
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, threadIndex);
 
     //Signal that this thread is ready
     input[inputArgs->threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Each iteration writes a packet to the local buffer, when the local buffer
     //is full the entire vector is copied to the shared buffer.
     while(1){
         // *** START PACKET GENERATOR ***
-        //Min value: offset || Max value: offset + 7
-        seed0 = (214013 * seed0 + 2531011);   
-        currFlow = ((seed0 >> 16) & FLOWS_PER_THREAD_MOD) + offset;
-
-        //Min value: 64 || Max value: 8191 + 64
-        seed1 = (214013 * seed1 + 2531011); 
-        currLength = ((seed1 >> 16) % (MAX_PAYLOAD_SIZE_MOD - MIN_PAYLOAD_SIZE)) + MIN_PAYLOAD_SIZE; 
+        //Next header of the burst, flow and order come numbered from the generator
+        header = next_header(&gen);
+        currFlow = header->flow;
+        currOrder = header->order;
+        currLength = header->length;
+        FILL_PAYLOAD(data, currFlow, currOrder, currLength);
         // *** END PACKET GENERATOR  ***
+        PHASE(GENERATE);
 
         qIndex = (currFlow & mask);
         if(qIndex > maxIndex)
             qIndex = qIndex >> 1;
 
         //Write the packet to the local buffer
-        memcpy(local[qIndex].ptr, &currFlow, 8);
-        local[qIndex].ptr += 8;
-        memcpy(local[qIndex].ptr, &currLength, 8);
-        local[qIndex].ptr += 8;
-        memcpy(local[qIndex].ptr, &orderForFlow[currFlow - offset], 8);
-        local[qIndex].ptr += 8;
-        memcpy(local[qIndex].ptr, data, currLength);
-        local[qIndex].ptr += currLength;
-
-        //Update the next flow number to assign
-        orderForFlow[currFlow - offset]++;
+        //The header is written through packet_t so it matches the build's header layout
+        staged = (packet_t *)(local[qIndex].buffer + local[qIndex].used);
+        staged->flow = currFlow;
+        staged->length = currLength;
+        staged->order = currOrder;
+        memcpy(staged->payload, data, currLength);
+        local[qIndex].used += currLength + PACKET_HEADER_SIZE;
+        PHASE(STAGE);
         
         //If we don't have room in the local buffer for another packet it's time to memcpy to shared memory.
         //A timeout could be added for real-world situations where few packets are coming in and local buffers
         //take a long time to fill.
         //For as fast as possible, this will almost always skip the while loop
-        if ((local[qIndex].ptr - local[qIndex].buffer + MAX_PACKET_SIZE) >= BUFFSIZEBYTES) {
+        if ((local[qIndex].used + MAX_PACKET_SIZE) >= BUFFSIZEBYTES) {
             shared1 = &queues[qIndex][threadIndex].seg[segIndex[qIndex]];
 
             //If there's still data in the shared buffer, wait
-            while (shared1->ptr > shared1->buffer) {
-                ;
-            }
+            SPIN_WHILE(shared1->used > 0);
+            TRACE(TRACE_ACQUIRE);
+            PHASE(WAIT);
 
             //Copy the entire vector to shared memory
-            memcpy(shared1->buffer, local[qIndex].buffer, (local[qIndex].ptr - local[qIndex].buffer));
+            memcpy(shared1->buffer, local[qIndex].buffer, local[qIndex].used);
+            TRACE(TRACE_FLUSH);
+            PHASE(COPY);
 
             //Signal to output_thread there's more data in shared memory and how much
-            shared1->ptr =shared1->buffer + (local[qIndex].ptr - local[qIndex].buffer);
+            shared1->used = local[qIndex].used;
+            TRACE(TRACE_RELEASE);
 
             //Reset the local queue
-            local[qIndex].ptr = local[qIndex].buffer;
+            local[qIndex].used = 0;
 
             //Cycle between which segment we are writing to
             segIndex[qIndex] ^= 1;
+            TRACE(TRACE_FLIP);
+            PHASE(STAGE);
         }
     }
     return NULL;
@@ -294,21 +306,26 @@ void * output_thread(void * args){
 
     //Initialize local queue;
     vbseg_t local;
-    local.ptr = local.buffer;
+    local.used = 0;
 
     //Used to convert into a packet struct
-    packet_t packet;
+    packetBuffer_t packetBuffer;
+    packet_t *packet = &packetBuffer.packet;
 
     //readPtr points to the current packet in the local buffer
     unsigned char *readPtr;
 
     //Used to verify order for a given flow
-    size_t expected[MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD] = {0}; 
+    flowTable_t flows;
+    size_t *expected;
+    flow_table_init(&flows, flow_table_share());
 
     output[outputArgs->threadNum].readyFlag = 1;
 
     //Wait until everything else is ready
-    while(startFlag == 0);
+    WAIT_FOR_START();
+
+    PHASE_MARK();
 
     //Each iteration copies a full vector from shared memory and processes it.
     while(1){
@@ -318,70 +335,113 @@ void * output_thread(void * args){
             shared1 = &queues[qIndex][i].seg[segIndex[i]];
 
             //Wait until more data has been written to shared memory
-            if (shared1->ptr == shared1->buffer) {
+            if (shared1->used == 0) {
+                SPIN_MISS();
                 continue;
             }
             else{
                 //Flip which segment we are reading from
                 segIndex[i] ^= 1;
             }
+            SPIN_HIT();
+            TRACE(TRACE_ACQUIRE);
+            TRACE(TRACE_FLIP);
+            PHASE(WAIT);
 
             //Copy the entire vector from shared to local memory
-            memcpy(local.buffer, shared1->buffer, (shared1->ptr - shared1->buffer));
+            memcpy(local.buffer, shared1->buffer, shared1->used);
+            PHASE(COPY);
 
-            //local.ptr marks where data in the local buffer ends
-            local.ptr = local.buffer + (shared1->ptr - shared1->buffer);
+            //local.used marks where data in the local buffer ends
+            local.used = shared1->used;
 
             //Signal to input_thread that shared memory can be written to again
-            shared1->ptr = shared1->buffer;
+            shared1->used = 0;
+            TRACE(TRACE_RELEASE);
+            PHASE(PARSE);
 
             //readPtr points to the current packet in the local buffer
             readPtr = local.buffer;
 
+#ifdef FLOW_PREFETCH
+            //Start loading the flow table buckets of the whole buffer before passing any of it
+            for(unsigned char *ahead = local.buffer; ahead < local.buffer + local.used; ahead += ((packet_t*) ahead)->length + PACKET_HEADER_SIZE)
+                flow_prefetch(&flows, ((packet_t*) ahead)->flow);
+#endif
+
             //Process all packets in the local buffer.
-            while (readPtr < local.ptr) {
+            while (readPtr < local.buffer + local.used) {
                 //This second memcpy arguably isn't needed since all the packet data is local to this
                 //thread at this point but I didn't want there to be any confusion over whether this
                 //accurately models individual packets being parsed and found that adding it doesn't
                 //affect the speed.  
-                memcpy(&packet, readPtr, ((packet_t*) readPtr)->length + PACKET_HEADER_SIZE);
+                memcpy(packet, readPtr, ((packet_t*) readPtr)->length + PACKET_HEADER_SIZE);
+                PHASE(PARSE);
 
                 //Packets order must be equal to the expected order.
-                if(expected[packet.flow] != packet.order){
+                expected = flow_lookup(&flows, packet->flow);
+                if(*expected != packet->order){
                     //Print out the contents of the local buffer that caused an error
                     int index = 0;
                     unsigned char* indexPtr = local.buffer;
-                    while (indexPtr < local.ptr) {
+                    while (indexPtr < local.buffer + local.used) {
                         packet_t * errPacket = (packet_t*) indexPtr;
-                        printf("\nPosition: %d, Flow: %ld, Order: %ld", index, errPacket->flow, errPacket->order);
+                        printf("\nPosition: %d, Flow: %ld, Order: %ld", index, (size_t)errPacket->flow, (size_t)errPacket->order);
                         index++;
                         indexPtr += (errPacket->length + PACKET_HEADER_SIZE);
                     }
 
                     //Print out the specific packet that caused the error to the user
-                    printf("\nError Packet: Flow %lu | Order %lu\n", packet.flow, packet.order);
-                    printf("Packet out of order in thread: %lu. Expected %lu | Got %lu\n", outputArgs->threadNum, expected[packet.flow], packet.order);
+                    printf("\nError Packet: Flow %lu | Order %lu\n", (size_t)packet->flow, (size_t)packet->order);
+                    printf("Packet out of order in thread: %lu. Expected %lu | Got %lu\n", outputArgs->threadNum, *expected, (size_t)packet->order);
                     exit(0);
                 }
                 else{              
+                    //Add the packet to the flow's stream checksum
+                    VERIFY_PACKET(packet->flow, packet->order, packet->length);
+                    CHECK_PAYLOAD(packet->payload, packet->flow, packet->order, packet->length);
+
                     //Set what the next expected packet for the flow should be
-                    expected[packet.flow]++;
+                    flow_advance(&flows, packet->flow, expected);
 
                     //Move readPtr to address of next packet
-                    readPtr += (packet.length + PACKET_HEADER_SIZE);
+                    readPtr += (packet->length + PACKET_HEADER_SIZE);
                 }
+                PHASE(VERIFY);
             }
 
             //At the end of this loop all packets in the local buffer have been processed and we update byteCount
             output[outputArgs->threadNum].byteCount += (readPtr - local.buffer);
+            PHASE(VERIFY);
         }
     }
 
     return NULL;
 }
 
+//Reports how full each queue is for the occupancy sampler, averaged over both segments.
+//Queue output * inputThreadCount + input carries packets from input to output.
+size_t queue_occupancy(double *fill){
+    size_t numQueues = 0;
+
+    for(size_t outIndex = 0; outIndex < outputThreadCount; outIndex++){
+        for(size_t inIndex = 0; inIndex < inputThreadCount; inIndex++){
+            vbqueue_t *queue = &queues[outIndex][inIndex];
+            fill[numQueues++] = ((double)queue->seg[0].used + (double)queue->seg[1].used) / (2.0 * BUFFSIZEBYTES);
+        }
+    }
+
+    return numQueues;
+}
+
 pthread_t * run(void *argsv){
+    //A buffer must have room for at least one packet of the size profile
+    if(MAX_PACKET_SIZE >= BUFFSIZEBYTES){
+        printf("ERROR: %lu byte packets don't fit in BUFFSIZEBYTES (%d), build with a larger one\n", MAX_PACKET_SIZE, BUFFSIZEBYTES);
+        exit(1);
+    }
 
+    queues = shared_alloc(sizeof(vbqueue_t) * MAX_NUM_OUTPUT_THREADS * MAX_NUM_INPUT_THREADS);
     initializeCustomQueues();
 
     return NULL;
@@ -0,0 +1,530 @@
+/*
+Algorithm 9 emulates an input node and an output node connected by a kernel
+transport. It passes the same vectors as algorithm 6, but instead of copying
+them through shared memory each input thread frames its full local buffer and
+sends it over a stream socket with sendmsg(). Every input thread has its own
+connection, so the stream keeps the packets of its flows in order, and output
+threads read one whole frame at a time from the connections they are assigned
+with the same static mapping as algorithm 6.
+
+Run it with PROCS=1 so the input and output side are separate processes that
+only share the sockets. The vector size is the batch every send and receive
+system call has to amortize, build with DEFS=-DBUFFSIZEBYTES=<bytes> (or run
+batchSweep.sh) to find the size where the system calls stop dominating.
+
+Transport (pick with DEFS):
+-   default: Unix domain stream sockets from socketpair()
+-   -DSOCKET_TCP: TCP over the loopback interface with Nagle's algorithm off
+-   -DSOCKET_TCP -DZEROCOPY: sends with MSG_ZEROCOPY. The kernel reads the
+    vector after sendmsg() returns, so input threads alternate between two
+    local buffers and only refill one once its send has completed. On
+    loopback the kernel still copies, so this measures the cost of the
+    completion handling rather than a saved copy.
+
+Sockets never block: threads spin on EAGAIN like they would on a full or
+empty shared queue, so the wait accounting stays comparable.
+*/
+
+#include "../FrameworkSRC/global.h"
+#include "../FrameworkSRC/wrapper.h"
+#include "../FrameworkSRC/generator.h"
+#include "../FrameworkSRC/flowtable.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+
+#define ALGNAME "Algorithm9"
+
+//Size of the vector sent in one frame, the batch size of the transport.
+//Can be overridden at build time, e.g. make AP=... DEFS=-DBUFFSIZEBYTES=16384
+#ifndef BUFFSIZEBYTES
+    #define BUFFSIZEBYTES 65536
+#endif
+
+//Local buffers per input thread, a zero copy send keeps its buffer busy until it completes
+#ifdef ZEROCOPY
+    #ifndef SOCKET_TCP
+        #error "ZEROCOPY needs SOCKET_TCP, Unix sockets don't support MSG_ZEROCOPY"
+    #endif
+    #define NUM_VECTORS 2
+#else
+    #define NUM_VECTORS 1
+#endif
+
+/*
+struct Frame, sent in front of every vector
+-   bytes (size_t) - length of the vector that follows
+-   packets (size_t) - number of packets in it, checked by the receiver
+*/
+typedef struct Frame{
+    size_t bytes;
+    size_t packets;
+} frame_t;
+
+/*
+struct Zerocopy, zero copy sends of one input thread
+-   sent (uint32_t) - sendmsg() calls made with MSG_ZEROCOPY, the kernel numbers them from 0
+-   completed (uint32_t) - calls whose buffers the kernel is done with
+*/
+typedef struct Zerocopy{
+    uint32_t sent;
+    uint32_t completed;
+} zerocopy_t;
+
+//Connection of each input thread, set up in run() before any thread starts.
+//The descriptors are only read afterwards so plain globals work across processes.
+int sendFds[MAX_NUM_INPUT_THREADS];
+int recvFds[MAX_NUM_INPUT_THREADS];
+
+//Receive buffer size of each connection, used to report how full it is
+int recvBufSize[MAX_NUM_INPUT_THREADS];
+
+//Standard interface to framework for returning the algorithm name
+char* get_name(){
+    return ALGNAME;
+}
+
+//Standard interface to framework for returning the input method
+function get_input_thread(){
+    return input_thread;
+}
+
+//Standard interface to framework for returning the output method
+function get_output_thread(){
+    return output_thread;
+}
+
+//The other side closed its end. That only happens once the window is over, when the
+//worker processes are killed, so park the thread. Anything else is an error.
+void connection_closed(const char *call){
+    if(!endFlag){
+        if(errno != 0)
+            perror(call);
+        else
+            printf("ERROR: %s: connection closed during the window\n", call);
+        exit(1);
+    }
+    while(1){
+        pause();
+    }
+}
+
+//Reads the kernel's zero copy completions and returns 1 while send id is still pending
+int zerocopy_pending(int fd, zerocopy_t *zc, uint32_t id){
+    char control[128];
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    while(recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0){
+        for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)){
+            struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+            //Completions cover the range of sends ee_info to ee_data
+            if(err->ee_origin == SO_EE_ORIGIN_ZEROCOPY && err->ee_errno == 0 && (int32_t)(err->ee_data + 1 - zc->completed) > 0)
+                zc->completed = err->ee_data + 1;
+        }
+        msg.msg_controllen = sizeof(control);
+    }
+
+    return (int32_t)(zc->completed - id) <= 0;
+}
+
+//Sends a frame and its vector, spinning while the socket buffer is full.
+//Stream sockets may take part of the data, so the iovecs are advanced until all of it is sent.
+void send_frame(int fd, struct iovec *iov, int iovcnt, zerocopy_t *zc){
+    struct msghdr msg;
+    int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+#ifdef ZEROCOPY
+    flags |= MSG_ZEROCOPY;
+#endif
+
+    while(msg.msg_iovlen > 0){
+        ssize_t bytes = sendmsg(fd, &msg, flags);
+        if(bytes < 0){
+            //ENOBUFS: too many zero copy sends outstanding, reap completions and retry
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS){
+                if(zc != NULL)
+                    zerocopy_pending(fd, zc, zc->sent);
+                SPIN_MISS();
+                continue;
+            }
+            connection_closed("sendmsg");
+        }
+        SPIN_HIT();
+        if(zc != NULL)
+            zc->sent++;
+
+        //Skip what was sent
+        while(msg.msg_iovlen > 0 && (size_t)bytes >= msg.msg_iov->iov_len){
+            bytes -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if(msg.msg_iovlen > 0){
+            msg.msg_iov->iov_base = (unsigned char *)msg.msg_iov->iov_base + bytes;
+            msg.msg_iov->iov_len -= bytes;
+        }
+    }
+}
+
+//Reads exactly len bytes, spinning while the socket has nothing to read
+void recv_all(int fd, void *buf, size_t len){
+    size_t got = 0;
+
+    while(got < len){
+        ssize_t bytes = recv(fd, (unsigned char *)buf + got, len - got, MSG_DONTWAIT);
+        if(bytes > 0){
+            SPIN_HIT();
+            got += bytes;
+        }
+        else if(bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            SPIN_MISS();
+        }
+        else{
+            if(bytes == 0)
+                errno = 0;
+            connection_closed("recv");
+        }
+    }
+}
+
+/*
+The job of the input threads is to make packets and send them to the output side.
+
+Attributes:
+-   Each input thread writes packets back to back into a local buffer
+-   exactly like algorithm 6. When another packet might not fit, the
+-   buffer is sent as one frame over the thread's connection: a frame_t
+-   header and the vector, gathered into one sendmsg() call.
+
+-   With ZEROCOPY the thread switches to its second local buffer after a
+-   send and waits for the kernel to complete the earlier send from that
+-   buffer before writing to it again.
+*/
+void * input_thread(void * args){
+    //Get arguments for input threads
+    threadArgs_t *inputArgs = (threadArgs_t *)args;
+
+    //Set the thread to its own core
+    set_thread_props(inputArgs->coreNum, 2);
+
+    //Each input thread sends over its own connection
+    int fd = sendFds[inputArgs->threadNum];
+
+    //Local buffers and the frame header sent with each, both must stay untouched
+    //until a zero copy send of them has completed
+    unsigned char buffers[NUM_VECTORS][BUFFSIZEBYTES];
+    frame_t frames[NUM_VECTORS];
+    size_t current = 0;
+    size_t used = 0;
+    size_t packets = 0;
+    struct iovec iov[2];
+
+    zerocopy_t *zc = NULL;
+#ifdef ZEROCOPY
+    zerocopy_t zerocopy = {0, 0};
+    uint32_t lastSend[NUM_VECTORS];
+    int inFlight[NUM_VECTORS] = {0};
+    zc = &zerocopy;
+#endif
+
+    //Used to write packets to local buffer
+    packetBuffer_t packetBuffer;
+    packet_t *packet = &packetBuffer.packet;
+
+    //Keep track of next order number for a given flow
+    size_t currFlow;
+    size_t currOrder;
+    size_t currLength;
+
+    generator_t gen;
+    header_t *header;
+    generator_init(&gen, inputArgs->threadNum);
+
+    input[inputArgs->threadNum].readyFlag = 1;
+
+    //Wait until everything else is ready
+    WAIT_FOR_START();
+
+    PHASE_MARK();
+
+    //Each iteration writes a packet to the local buffer, when the local buffer
+    //is full the entire vector is sent to the output side.
+    while(1){
+        // *** START PACKET GENERATOR ***
+        //Next header of the burst, flow and order come numbered from the generator
+        header = next_header(&gen);
+        currFlow = header->flow;
+        currOrder = header->order;
+        currLength = header->length;
+        FILL_PAYLOAD(packet->payload, currFlow, currOrder, currLength);
+        // *** END PACKET GENERATOR  ***
+        PHASE(GENERATE);
+
+        //Generate a packet and write it to the local buffer
+        packet->order = currOrder;
+        packet->length = currLength;
+        packet->flow = currFlow;
+        memcpy(buffers[current] + used, packet, currLength + PACKET_HEADER_SIZE);
+        used += (currLength + PACKET_HEADER_SIZE);
+        packets++;
+        PHASE(STAGE);
+
+        //If we don't have room in the local buffer for another packet it's time to send the vector
+        if ((used + MAX_PACKET_SIZE) >= BUFFSIZEBYTES) {
+            frames[current].bytes = used;
+            frames[current].packets = packets;
+            iov[0].iov_base = &frames[current];
+            iov[0].iov_len = sizeof(frame_t);
+            iov[1].iov_base = buffers[current];
+            iov[1].iov_len = used;
+
+            //Send the frame, waiting while the socket buffer is full
+            TRACE(TRACE_ACQUIRE);
+            send_frame(fd, iov, 2, zc);
+            TRACE(TRACE_FLUSH);
+            PHASE(COPY);
+
+#ifdef ZEROCOPY
+            //Move to the other buffer, once the kernel is done sending from it
+            lastSend[current] = zerocopy.sent - 1;
+            inFlight[current] = 1;
+            current ^= 1;
+            if(inFlight[current]){
+                SPIN_WHILE(zerocopy_pending(fd, zc, lastSend[current]));
+                inFlight[current] = 0;
+            }
+            PHASE(WAIT);
+#endif
+            TRACE(TRACE_RELEASE);
+
+            //Reset the local buffer
+            used = 0;
+            packets = 0;
+            PHASE(STAGE);
+        }
+    }
+    return NULL;
+}
+
+/*
+The job of the output threads is to receive vectors and process their packets.
+
+Attributes:
+-   Output thread t reads from the connections of input threads t,
+-   t + N, t + 2N ... one whole frame at a time, like algorithm 6 reads
+-   its shared queues. Output threads without a connection (M < N) idle.
+
+-   A frame is read in two steps: the header, then exactly the number of
+-   bytes it announces, straight into the local buffer. The packets are
+-   then checked for order the same way as in algorithm 6.
+*/
+void * output_thread(void * args){
+    //Get arguments for output threads
+    threadArgs_t *outputArgs = (threadArgs_t *)args;
+
+    //Set the thread to its own core
+    set_thread_props(outputArgs->coreNum, 2);
+
+    //Start on the first connection this output thread is reponsible for
+    size_t qIndex = outputArgs->threadNum;
+
+    //Frame header and the vector it carries
+    frame_t frame;
+    unsigned char local[BUFFSIZEBYTES];
+
+    //Used to read packets from local buffer
+    packetBuffer_t packetBuffer;
+    packet_t *packet = &packetBuffer.packet;
+
+    //Points to the current packet in the local buffer
+    unsigned char *readPtr;
+
+    //Used to verify order for a given flow
+    flowTable_t flows;
+    size_t *expected;
+    flow_table_init(&flows, flow_table_share());
+
+    output[outputArgs->threadNum].readyFlag = 1;
+
+    //Wait until everything else is ready
+    WAIT_FOR_START();
+
+    PHASE_MARK();
+
+    //Nothing will ever arrive for an output thread without a connection
+    SPIN_WHILE(qIndex >= inputThreadCount);
+
+    //Each iteration receives one vector and processes it.
+    while(1){
+        //Wait for the next frame, then read the vector it announces
+        recv_all(recvFds[qIndex], &frame, sizeof(frame_t));
+        TRACE(TRACE_ACQUIRE);
+        PHASE(WAIT);
+        if(frame.bytes > BUFFSIZEBYTES){
+            printf("Corrupt frame from input thread %lu: %lu bytes\n", qIndex, frame.bytes);
+            exit(1);
+        }
+        recv_all(recvFds[qIndex], local, frame.bytes);
+        TRACE(TRACE_RELEASE);
+        PHASE(COPY);
+
+#ifdef FLOW_PREFETCH
+        //Start loading the flow table buckets of the whole buffer before passing any of it
+        for(unsigned char *ahead = local; ahead < local + frame.bytes; ahead += ((packet_t*) ahead)->length + PACKET_HEADER_SIZE)
+            flow_prefetch(&flows, ((packet_t*) ahead)->flow);
+#endif
+
+        //Process all packets in the local buffer.
+        size_t packets = 0;
+        readPtr = local;
+        while (readPtr < local + frame.bytes) {
+            memcpy(packet, readPtr, ((packet_t*) readPtr)->length + PACKET_HEADER_SIZE);
+            PHASE(PARSE);
+
+            //Packets order must be equal to the expected order.
+            expected = flow_lookup(&flows, packet->flow);
+            if(*expected != packet->order){
+                printf("Error Packet: Flow %lu | Order %lu\n", (size_t)packet->flow, (size_t)packet->order);
+                printf("Packet out of order in thread: %lu. Expected %lu | Got %lu\n", outputArgs->threadNum, *expected, (size_t)packet->order);
+                exit(0);
+            }
+            else{
+                //Add the packet to the flow's stream checksum
+                VERIFY_PACKET(packet->flow, packet->order, packet->length);
+                CHECK_PAYLOAD(packet->payload, packet->flow, packet->order, packet->length);
+
+                //Set what the next expected packet for the flow should be
+                flow_advance(&flows, packet->flow, expected);
+
+                //Move readPtr to address of next packet
+                readPtr += (packet->length + PACKET_HEADER_SIZE);
+                packets++;
+            }
+            PHASE(VERIFY);
+        }
+
+        //A frame must hold exactly the packets its header announced
+        if(packets != frame.packets){
+            printf("Corrupt frame from input thread %lu: %lu packets, header announced %lu\n", qIndex, packets, frame.packets);
+            exit(1);
+        }
+
+        //At the end of this loop all packets in the local buffer have been processed and we update byteCount
+        output[outputArgs->threadNum].byteCount += frame.bytes;
+        PHASE(VERIFY);
+
+        //Move to the next connection this output thread is responsible for
+        qIndex = qIndex + outputThreadCount;
+        if(qIndex >= inputThreadCount) {
+            qIndex = outputArgs->threadNum;
+        }
+    }
+    return NULL;
+}
+
+//Connects input thread index to the output side
+void connect_pair(size_t index, int listenFd, struct sockaddr_in *addr){
+    int fds[2];
+
+#ifdef SOCKET_TCP
+    int one = 1;
+
+    if((fds[0] = socket(AF_INET, SOCK_STREAM, 0)) < 0){
+        perror("ERROR: socket() failed");
+        exit(1);
+    }
+    if(connect(fds[0], (struct sockaddr *)addr, sizeof(*addr)) < 0){
+        perror("ERROR: connect() failed");
+        exit(1);
+    }
+    if((fds[1] = accept(listenFd, NULL, NULL)) < 0){
+        perror("ERROR: accept() failed");
+        exit(1);
+    }
+
+    //Frames are sent whole, don't hold back the tail of one waiting for more data
+    setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef ZEROCOPY
+    if(setsockopt(fds[0], SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0){
+        perror("ERROR: setsockopt(SO_ZEROCOPY) failed");
+        exit(1);
+    }
+#endif
+#else
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0){
+        perror("ERROR: socketpair() failed");
+        exit(1);
+    }
+#endif
+
+    socklen_t size = sizeof(recvBufSize[index]);
+    if(getsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &recvBufSize[index], &size) < 0)
+        recvBufSize[index] = 0;
+
+    sendFds[index] = fds[0];
+    recvFds[index] = fds[1];
+}
+
+//Reports how much of each connection's receive buffer holds data for the occupancy sampler.
+//Queue i is the connection of input thread i.
+size_t queue_occupancy(double *fill){
+    for(size_t qIndex = 0; qIndex < inputThreadCount; qIndex++){
+        int queued = 0;
+        if(recvBufSize[qIndex] <= 0 || ioctl(recvFds[qIndex], FIONREAD, &queued) < 0)
+            queued = 0;
+        fill[qIndex] = recvBufSize[qIndex] > 0 ? (double)queued / recvBufSize[qIndex] : 0;
+        if(fill[qIndex] > 1)
+            fill[qIndex] = 1;
+    }
+
+    return inputThreadCount;
+}
+
+pthread_t * run(void *argsv){
+    int listenFd = -1;
+    struct sockaddr_in addr;
+
+    //A buffer must have room for at least one packet of the size profile
+    if(MAX_PACKET_SIZE >= BUFFSIZEBYTES){
+        printf("ERROR: %lu byte packets don't fit in BUFFSIZEBYTES (%d), build with a larger one\n", MAX_PACKET_SIZE, BUFFSIZEBYTES);
+        exit(1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+#ifdef SOCKET_TCP
+    //Listen on an ephemeral loopback port just long enough to accept every connection
+    socklen_t size = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if((listenFd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+       listen(listenFd, MAX_NUM_INPUT_THREADS) < 0 || getsockname(listenFd, (struct sockaddr *)&addr, &size) < 0){
+        perror("ERROR: setting up the loopback listener failed");
+        exit(1);
+    }
+#endif
+
+    for(size_t i = 0; i < MAX_NUM_INPUT_THREADS; i++){
+        sendFds[i] = -1;
+        recvFds[i] = -1;
+    }
+    for(size_t i = 0; i < inputThreadCount; i++){
+        connect_pair(i, listenFd, &addr);
+    }
+
+    if(listenFd >= 0)
+        close(listenFd);
+
+    return NULL;
+}
@@ -0,0 +1,375 @@
+//Per thread cost reporting
+//Hardware performance counters using perf_event_open:
+//Every worker thread opens its own counter group before running the algorithm
+//(see thread_entry() in framework.c) so the counters follow it to its core.
+//With PROCS=1 the main process opens them by thread id instead (process.c).
+//The main thread reads every group at the start and end of the timed window.
+//Phase cycle accounting:
+//Algorithms charge TSC cycles to phases of their loops with PHASE() (global.h)
+//and the breakdown is reported here when built with PHASES=1.
+//Spin wait accounting:
+//Algorithms wait for queue space or data with SPIN_WHILE()/SPIN_MISS() (global.h).
+//The share of the window each side spent waiting decides which side was the bottleneck.
+
+#include<global.h>
+#include<wrapper.h>
+#include<counters.h>
+#include<sim.h>
+#include<sys/syscall.h>
+#include<linux/perf_event.h>
+
+//Used to build the config for the generic cache events
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+//Event to open for each counter, indexed by the CTR_* defines in global.h
+static const struct {
+    unsigned int type;
+    unsigned long long config;
+} events[NUM_COUNTERS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+};
+
+//glibc does not provide a wrapper for this system call
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu, int groupFd, unsigned long flags){
+    return (int)syscall(SYS_perf_event_open, attr, pid, cpu, groupFd, flags);
+}
+
+//Opens the counter group for a thread, tid 0 is the calling thread.
+//The cycle counter leads the group so all counters are scheduled together. If it
+//can't be opened the thread has no counters, other counters are skipped individually
+//when the CPU or hypervisor does not support them.
+void counters_open(counters_t *ctrs, pid_t tid){
+    struct perf_event_attr attr;
+    int slot = 0;
+
+    ctrs->groupFd = -1;
+    ctrs->error = 0;
+    memset(ctrs->start, 0, sizeof(ctrs->start));
+    memset(ctrs->end, 0, sizeof(ctrs->end));
+
+    for(int i = 0; i < NUM_COUNTERS; i++){
+        ctrs->fds[i] = -1;
+        ctrs->slot[i] = -1;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = perf_event_open(&attr, tid, -1, ctrs->groupFd, 0);
+        if(fd < 0){
+            //Without the group leader there is nothing to attach the other counters to
+            if(i == CTR_CYCLES){
+                ctrs->error = errno;
+                return;
+            }
+            continue;
+        }
+
+        if(i == CTR_CYCLES)
+            ctrs->groupFd = fd;
+        ctrs->fds[i] = fd;
+        ctrs->slot[i] = slot++;
+    }
+}
+
+//Reads the group of a single thread into dst
+//read() is async signal safe so this can be called from sig_alrm()
+void counters_read(counters_t *ctrs, unsigned long long *dst){
+    if(ctrs->groupFd < 0)
+        return;
+
+    if(read(ctrs->groupFd, dst, sizeof(unsigned long long) * COUNTERS_READ_SIZE) < 0){
+        memset(dst, 0, sizeof(unsigned long long) * COUNTERS_READ_SIZE);
+    }
+}
+
+//Takes the start or end reading for every input and output thread
+void counters_snapshot(int which){
+    for(int i = 0; i < inputThreadCount; i++){
+        counters_read(&input[i].counters, which == COUNTERS_START ? input[i].counters.start : input[i].counters.end);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        counters_read(&output[i].counters, which == COUNTERS_START ? output[i].counters.start : output[i].counters.end);
+    }
+#ifdef COROUTINE_SIM
+    //Every routine runs on the main thread, which has the only group (sim.c)
+    counters_read(&simCounters, which == COUNTERS_START ? simCounters.start : simCounters.end);
+#endif
+}
+
+//Returns the change in a counter over the timed window, scaled up if the kernel had
+//to multiplex the group. Returns -1 if the counter is not available.
+double counters_delta(counters_t *ctrs, int counter){
+    int slot = ctrs->slot[counter];
+
+    if(ctrs->groupFd < 0 || slot < 0)
+        return -1;
+
+    double enabled = (double)(ctrs->end[1] - ctrs->start[1]);
+    double running = (double)(ctrs->end[2] - ctrs->start[2]);
+    double value = (double)(ctrs->end[3 + slot] - ctrs->start[3 + slot]);
+
+    //The group was never on the PMU so there is nothing to scale
+    if(running <= 0)
+        return -1;
+
+    return value * (enabled / running);
+}
+
+//Packets a thread is credited with over the timed window.
+//Output threads are credited with the bytes they counted. Input threads don't count
+//packets so each one is credited an equal share of everything that was passed.
+static double credited_packets(io_t *io, int isInput){
+    if(isInput)
+        return ((double)finalTotal / avgPacketSize) / inputThreadCount;
+    return (double)io->finalCount / avgPacketSize;
+}
+
+//Prints a counter divided by the packet count, or a dash if it is unavailable
+static void print_per_packet(double value, double packets){
+    if(value < 0 || packets <= 0)
+        printf("%12s", "-");
+    else
+        printf("%12.2f", value / packets);
+}
+
+//Writes a counter value to the csv file, leaving the field empty if it is unavailable
+static void write_value(FILE *fptr, double value, double divisor){
+    if(value < 0 || divisor <= 0)
+        fprintf(fptr, ",");
+    else
+        fprintf(fptr, ",%.3f", value / divisor);
+}
+
+static void report_thread(FILE *fptr, char *algName, char *side, size_t threadNum, io_t *io, double packets){
+    double values[NUM_COUNTERS];
+
+    for(int i = 0; i < NUM_COUNTERS; i++){
+        values[i] = counters_delta(&io->counters, i);
+    }
+
+    //Print the per packet figures to the user
+    printf("%-6s %-4lu %5lu %14.0f", side, threadNum, io->threadArgs.coreNum, packets);
+    print_per_packet(values[CTR_CYCLES], packets);
+    if(values[CTR_CYCLES] > 0 && values[CTR_INSTRUCTIONS] >= 0)
+        printf("%8.2f", values[CTR_INSTRUCTIONS] / values[CTR_CYCLES]);
+    else
+        printf("%8s", "-");
+    print_per_packet(values[CTR_L1D_MISSES], packets);
+    print_per_packet(values[CTR_LLC_MISSES], packets);
+    print_per_packet(values[CTR_DTLB_MISSES], packets);
+    print_per_packet(values[CTR_BRANCH_MISSES], packets);
+    printf("\n");
+
+    //Write the raw counts and the per packet figures to the results file
+    fprintf(fptr, "%s,%lu,%lu,%s,%lu,%lu,%.0f", algName, inputThreadCount, outputThreadCount, side, threadNum, io->threadArgs.coreNum, packets);
+    for(int i = 0; i < NUM_COUNTERS; i++){
+        if(values[i] < 0)
+            fprintf(fptr, ",");
+        else
+            fprintf(fptr, ",%.0f", values[i]);
+    }
+    write_value(fptr, values[CTR_CYCLES], packets);
+    write_value(fptr, values[CTR_INSTRUCTIONS], values[CTR_CYCLES] > 0 ? values[CTR_CYCLES] : -1);
+    write_value(fptr, values[CTR_L1D_MISSES], packets);
+    write_value(fptr, values[CTR_LLC_MISSES], packets);
+    write_value(fptr, values[CTR_DTLB_MISSES], packets);
+    write_value(fptr, values[CTR_BRANCH_MISSES], packets);
+    fprintf(fptr, "\n");
+}
+
+//Prints the counters for every thread and writes them to RESULTS_DIR/<algName>_counters.csv
+void counters_report(char *algName){
+    char fileName[10000];
+    int available = 0;
+    int error = 0;
+
+#ifdef COROUTINE_SIM
+    //The routines share one thread, sim_report() reports its counters per packet
+    return;
+#endif
+
+    for(int i = 0; i < inputThreadCount; i++){
+        if(input[i].counters.groupFd >= 0) available = 1;
+        else error = input[i].counters.error;
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        if(output[i].counters.groupFd >= 0) available = 1;
+        else error = output[i].counters.error;
+    }
+
+    if(!available){
+        printf("\nHardware counters unavailable: %s\n", strerror(error));
+        printf("Run as root or lower /proc/sys/kernel/perf_event_paranoid to collect them.\n");
+        return;
+    }
+
+    snprintf(fileName, sizeof(fileName), "%s_counters.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Side,Thread,Core,Packets,"
+        "Cycles,Instructions,L1DMisses,LLCMisses,DTLBMisses,BranchMisses,"
+        "CyclesPerPacket,IPC,L1DPerPacket,LLCPerPacket,DTLBPerPacket,BranchMissPerPacket\n");
+
+    printf("\nHardware Counters (per packet):\n");
+    printf("%-6s %-4s %5s %14s%12s%8s%12s%12s%12s%12s\n", "Side", "Num", "Core", "Packets", "Cycles", "IPC", "L1D Miss", "LLC Miss", "dTLB Miss", "Br Miss");
+
+    for(int i = 0; i < inputThreadCount; i++){
+        report_thread(fptr, algName, "Input", i, &input[i], credited_packets(&input[i], 1));
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        report_thread(fptr, algName, "Output", i, &output[i], credited_packets(&output[i], 0));
+    }
+
+    fclose(fptr);
+}
+
+#ifdef PHASE_TIMING
+//Names of the phases, indexed by the PHASE_* defines in global.h
+static const char *phaseNames[NUM_PHASES] = {"Generate", "Stage", "Wait", "Copy", "Parse", "Verify", "Idle"};
+
+static void report_phases(FILE *fptr, char *algName, char *side, size_t threadNum, io_t *io, double packets){
+    tsc_t total = 0;
+
+    for(int i = 0; i < NUM_PHASES; i++){
+        total += io->finalPhases.cycles[i];
+    }
+
+    printf("%-6s %-4lu", side, threadNum);
+    for(int i = 0; i < NUM_PHASES; i++){
+        if(io->finalPhases.cycles[i] == 0 || packets <= 0)
+            printf("%10s", "-");
+        else
+            printf("%10.1f", io->finalPhases.cycles[i] / packets);
+    }
+    printf("%10.1f\n", packets > 0 ? total / packets : 0);
+
+    for(int i = 0; i < NUM_PHASES; i++){
+        if(io->finalPhases.cycles[i] == 0)
+            continue;
+        fprintf(fptr, "%s,%lu,%lu,%s,%lu,%.0f,%s,%llu,%.3f,%.4f\n", algName, inputThreadCount, outputThreadCount, side, threadNum,
+            packets, phaseNames[i], io->finalPhases.cycles[i], packets > 0 ? io->finalPhases.cycles[i] / packets : 0,
+            (double)io->finalPhases.cycles[i] / total);
+    }
+}
+#endif
+
+//Prints the cycles per packet spent in each phase for every thread and writes them
+//to RESULTS_DIR/<algName>_phases.csv. Only reported when built with PHASES=1.
+void phases_report(char *algName){
+#ifdef PHASE_TIMING
+    char fileName[10000];
+
+    snprintf(fileName, sizeof(fileName), "%s_phases.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Side,Thread,Packets,Phase,Cycles,CyclesPerPacket,Share\n");
+
+    printf("\nPhase Breakdown (cycles per packet):\n");
+    printf("%-6s %-4s", "Side", "Num");
+    for(int i = 0; i < NUM_PHASES; i++){
+        printf("%10s", phaseNames[i]);
+    }
+    printf("%10s\n", "Total");
+
+    for(int i = 0; i < inputThreadCount; i++){
+        report_phases(fptr, algName, "Input", i, &input[i], credited_packets(&input[i], 1));
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        report_phases(fptr, algName, "Output", i, &output[i], credited_packets(&output[i], 0));
+    }
+
+    fclose(fptr);
+#endif
+}
+
+//Share of the timed window a thread spent waiting
+static double spin_share(io_t *io){
+    double window = (double)(windowEnd - windowStart);
+
+    if(window <= 0)
+        return 0;
+    return io->finalSpin.cycles / window;
+}
+
+//Averages the share of the timed window input threads spent waiting for space (producerWait)
+//and output threads spent waiting for data (consumerWait), and returns which side held
+//the other back. Output threads that passed nothing are left out: algorithms that map
+//flows to fixed outputs leave them idle by design when there are more outputs than flows.
+//A side whose threads polled without timing it (built without SPIN=1) gets a wait of -1
+//and NULL is returned, since which side held the other back can't be told.
+char * spin_classify(double *producerWait, double *consumerWait){
+    int consumers = 0;
+    size_t producerUntimed = 0;
+    size_t consumerUntimed = 0;
+
+    *producerWait = 0;
+    *consumerWait = 0;
+
+    for(int i = 0; i < inputThreadCount; i++){
+        *producerWait += spin_share(&input[i]);
+        producerUntimed += input[i].finalSpin.untimedPolls;
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        if(output[i].finalCount == 0)
+            continue;
+        *consumerWait += spin_share(&output[i]);
+        consumerUntimed += output[i].finalSpin.untimedPolls;
+        consumers++;
+    }
+
+    if(inputThreadCount > 0)
+        *producerWait /= inputThreadCount;
+    if(consumers > 0)
+        *consumerWait /= consumers;
+
+    if(producerUntimed > 0)
+        *producerWait = -1;
+    if(consumerUntimed > 0)
+        *consumerWait = -1;
+    if(producerUntimed > 0 || consumerUntimed > 0)
+        return NULL;
+
+    //Output threads starving for data means the input side can't keep up
+    if(*consumerWait >= BOUND_MIN_WAIT && *consumerWait >= *producerWait * BOUND_RATIO)
+        return "producer-bound";
+    //Input threads waiting for space means the output side can't keep up
+    if(*producerWait >= BOUND_MIN_WAIT && *producerWait >= *consumerWait * BOUND_RATIO)
+        return "consumer-bound";
+    return "balanced";
+}
+
+static void report_spin(FILE *fptr, char *algName, char *side, size_t threadNum, io_t *io){
+    spin_t *spin = &io->finalSpin;
+    double share = spin_share(io);
+
+    printf("%-6s %-4lu %12lu %14lu %16llu %8.1f%%\n", side, threadNum, spin->waits, spin->iterations, spin->cycles, share * 100);
+    fprintf(fptr, "%s,%lu,%lu,%s,%lu,%lu,%lu,%llu,%.4f\n", algName, inputThreadCount, outputThreadCount, side, threadNum,
+        spin->waits, spin->iterations, spin->cycles, share);
+}
+
+//Prints how long every thread spent waiting and writes it to RESULTS_DIR/<algName>_spin.csv
+void spin_report(char *algName){
+    char fileName[10000];
+
+    snprintf(fileName, sizeof(fileName), "%s_spin.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Side,Thread,Waits,Iterations,Cycles,Share\n");
+
+    printf("\nSpin Waits:\n");
+    printf("%-6s %-4s %12s %14s %16s %9s\n", "Side", "Num", "Waits", "Iterations", "Cycles", "Share");
+
+    for(int i = 0; i < inputThreadCount; i++){
+        report_spin(fptr, algName, "Input", i, &input[i]);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        report_spin(fptr, algName, "Output", i, &output[i]);
+    }
+
+    fclose(fptr);
+}
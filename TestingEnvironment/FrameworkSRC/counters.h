@@ -0,0 +1,19 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include<global.h>
+
+//Which read to take for the timed window
+#define COUNTERS_START 0
+#define COUNTERS_END 1
+
+void counters_open(counters_t *ctrs, pid_t tid);
+void counters_read(counters_t *ctrs, unsigned long long *dst);
+double counters_delta(counters_t *ctrs, int counter);
+void counters_snapshot(int which);
+void counters_report(char *algName);
+void phases_report(char *algName);
+char * spin_classify(double *producerWait, double *consumerWait);
+void spin_report(char *algName);
+
+#endif
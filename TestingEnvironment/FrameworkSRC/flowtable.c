@@ -0,0 +1,158 @@
+//Output side flow state
+//Output threads keep the order each flow's next packet must have in a flow table of their
+//own instead of an array indexed by flow. Flows are added the first time a packet of
+//theirs arrives and, under flow churn (-c), dropped after their last packet, so the cost
+//of looking flows up, adding and removing them shows up in the output threads' loops the
+//way per flow state does in production. With a large flow space (-n) the table holds up to
+//millions of flows and most lookups miss the cache.
+//
+//Entries are 16 bytes, four to a 64 byte bucket with the flow ids together, so a lookup
+//compares a whole bucket at once and usually touches one cache line. Linear probing runs
+//over the entries with each probe starting at a bucket boundary. Removal shifts the entries
+//of the probe after it back instead of leaving a tombstone, so a table with flows coming
+//and going never fills up with dead entries. Tables of 2MB and up ask for huge pages, a
+//flow table in production would not pay a TLB miss per lookup either.
+
+#include<global.h>
+#include<flowtable.h>
+#include<sys/mman.h>
+
+#define FLOW_HUGE_PAGE (2UL << 20)
+
+//Flow id held by an entry, entries are numbered across buckets
+#define ENTRY_FLOW(table, index) ((table)->buckets[(index) >> FLOW_BUCKET_BITS].flows[(index) & (FLOW_BUCKET_ENTRIES - 1)])
+#define ENTRY_EXPECTED(table, index) ((table)->buckets[(index) >> FLOW_BUCKET_BITS].expected[(index) & (FLOW_BUCKET_ENTRIES - 1)])
+
+//Gives the table room for flows entries at three quarters full, all free
+static void flow_table_alloc(flowTable_t *table, size_t flows){
+    size_t entries = FLOW_TABLE_MIN;
+    int bits = 0;
+
+    while(3 * entries < 4 * flows)
+        entries <<= 1;
+    while(((size_t)FLOW_BUCKET_ENTRIES << bits) < entries)
+        bits++;
+
+    size_t size = sizeof(flowBucket_t) * (entries >> FLOW_BUCKET_BITS);
+    void *buckets = NULL;
+    if(posix_memalign(&buckets, size >= FLOW_HUGE_PAGE ? FLOW_HUGE_PAGE : sizeof(flowBucket_t), size) != 0){
+        printf("ERROR: no memory for a flow table of %lu flows\n", entries);
+        exit(1);
+    }
+    if(size >= FLOW_HUGE_PAGE)
+        madvise(buckets, size, MADV_HUGEPAGE);
+
+    //Every byte set makes every flow id FLOW_EMPTY, placing a flow sets its order
+    memset(buckets, 0xFF, size);
+    table->buckets = buckets;
+    table->mask = entries - 1;
+    table->shift = 64 - bits;
+    table->count = 0;
+}
+
+//Allocates an empty table for flow_table_init()
+void flow_table_create(flowTable_t *table, size_t flows){
+    flow_table_alloc(table, flows);
+}
+
+void flow_table_free(flowTable_t *table){
+    free(table->buckets);
+    table->buckets = NULL;
+}
+
+//Flows an output thread can expect to hold at once, its even share of all the input
+//threads' flows. A thread that gets more grows its table.
+size_t flow_table_share(){
+    size_t flows = inputThreadCount * FLOWS_PER_THREAD * flowLanes;
+    return (flows + outputThreadCount - 1) / outputThreadCount;
+}
+
+//Places a flow that isn't in the table yet, returns its order
+static size_t * flow_place(flowTable_t *table, size_t flow, size_t expected){
+    size_t index = flow_home(table, flow) << FLOW_BUCKET_BITS;
+    while(ENTRY_FLOW(table, index) != FLOW_EMPTY){
+        index = (index + 1) & table->mask;
+    }
+    ENTRY_FLOW(table, index) = flow;
+    ENTRY_EXPECTED(table, index) = expected;
+    table->count++;
+    return &ENTRY_EXPECTED(table, index);
+}
+
+//Doubles the table, called when it gets three quarters full
+static void flow_table_grow(flowTable_t *table){
+    flowTable_t old = *table;
+
+    flow_table_alloc(table, old.mask + 1);
+    for(size_t i = 0; i <= old.mask; i++){
+        if(ENTRY_FLOW(&old, i) != FLOW_EMPTY)
+            flow_place(table, ENTRY_FLOW(&old, i), ENTRY_EXPECTED(&old, i));
+    }
+    flow_table_free(&old);
+}
+
+//Adds a flow seen for the first time, expecting order 0. flow_lookup() calls it when the
+//flow's probe reaches a bucket with a free entry.
+size_t * flow_insert(flowTable_t *table, size_t flow){
+    if(4 * (table->count + 1) > 3 * (table->mask + 1))
+        flow_table_grow(table);
+
+    size_t *expected = flow_place(table, flow, 0);
+
+    if(!endFlag){
+        threadVerify.flowsStarted++;
+        if(table->count > threadVerify.flowsPeak)
+            threadVerify.flowsPeak = table->count;
+    }
+    return expected;
+}
+
+//Drops a flow's state, moving back the entries of the probe after it that would otherwise
+//no longer be reached
+void flow_remove(flowTable_t *table, size_t flow){
+    size_t index = flow_home(table, flow) << FLOW_BUCKET_BITS;
+    while(ENTRY_FLOW(table, index) != flow){
+        if(ENTRY_FLOW(table, index) == FLOW_EMPTY)
+            return;
+        index = (index + 1) & table->mask;
+    }
+
+    size_t hole = index;
+    while(1){
+        index = (index + 1) & table->mask;
+        size_t moved = ENTRY_FLOW(table, index);
+        if(moved == FLOW_EMPTY)
+            break;
+        //An entry can fill the hole if its probe starts at or before the hole
+        size_t home = flow_home(table, moved) << FLOW_BUCKET_BITS;
+        if(((index - home) & table->mask) >= ((index - hole) & table->mask)){
+            ENTRY_FLOW(table, hole) = moved;
+            ENTRY_EXPECTED(table, hole) = ENTRY_EXPECTED(table, index);
+            hole = index;
+        }
+    }
+    ENTRY_FLOW(table, hole) = FLOW_EMPTY;
+    table->count--;
+
+    if(!endFlag)
+        threadVerify.flowsFinished++;
+}
+
+//Sums what the output threads' flow tables did in the window
+void flow_stats(flowStats_t *stats){
+    memset(stats, 0, sizeof(*stats));
+    stats->probe = "none";
+    for(int i = 0; i < outputThreadCount; i++){
+        verify_t *verify = output[i].verify;
+        if(verify == NULL)
+            continue;
+        if(verify->flowProbe != NULL){
+            stats->probe = verify->flowProbe;
+            stats->prefetch = verify->flowPrefetch;
+        }
+        stats->started += verify->flowsStarted;
+        stats->finished += verify->flowsFinished;
+        if(verify->flowsPeak > stats->peak)
+            stats->peak = verify->flowsPeak;
+    }
+}
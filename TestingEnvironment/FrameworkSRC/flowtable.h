@@ -0,0 +1,164 @@
+#ifndef FLOWTABLE_H
+#define FLOWTABLE_H
+
+#include"global.h"
+
+//Flows a table starts with room for, it doubles when it gets three quarters full
+#define FLOW_TABLE_MIN 256
+
+//Entries of a bucket, one cache line of flow ids and orders
+#define FLOW_BUCKET_ENTRIES 4
+#define FLOW_BUCKET_BITS 2 //log2 of FLOW_BUCKET_ENTRIES
+
+//Flow id of a free entry, no generated flow gets it
+#define FLOW_EMPTY SIZE_MAX
+
+//Buckets are probed with the widest compare the build targets, picked at compile time since
+//the lookup is inlined into the algorithms. MODE=release (-march=native) gets AVX2 on CPUs
+//that have it, PROBE=scalar in options.mk forces the plain loop to compare against.
+#if !defined(FLOW_PROBE_FORCE_SCALAR) && defined(__AVX2__)
+    #include<immintrin.h>
+    #define FLOW_PROBE_AVX2
+    #define FLOW_PROBE_NAME "avx2"
+#elif !defined(FLOW_PROBE_FORCE_SCALAR) && defined(__SSE4_1__)
+    #include<immintrin.h>
+    #define FLOW_PROBE_SSE4
+    #define FLOW_PROBE_NAME "sse4.1"
+#elif !defined(FLOW_PROBE_FORCE_SCALAR) && defined(__SSE2__)
+    #include<immintrin.h>
+    #define FLOW_PROBE_SSE2
+    #define FLOW_PROBE_NAME "sse2"
+#else
+    #define FLOW_PROBE_NAME "scalar"
+#endif
+
+//PREFETCH=1 in options.mk: algorithms that take packets a batch at a time prefetch the
+//buckets of the whole batch before passing any of it (flow_prefetch())
+#ifdef FLOW_PREFETCH
+    #define FLOW_PREFETCH_ON 1
+#else
+    #define FLOW_PREFETCH_ON 0
+#endif
+
+//Four 16 byte entries (a flow id and the order its next packet must have) in one cache line,
+//the ids side by side so one vector compare checks the whole bucket
+//flows (size_t array) - Global flow id of each entry, FLOW_EMPTY if the entry is free
+//expected (size_t array) - Order the next packet of each entry's flow must have
+typedef struct FlowBucket{
+    size_t flows[FLOW_BUCKET_ENTRIES];
+    size_t expected[FLOW_BUCKET_ENTRIES];
+}__attribute__((aligned(64))) flowBucket_t;
+
+//Flows an output thread has seen and not yet seen end, open addressing with linear probing
+//over the entries. A flow's probe starts at the first entry of its bucket and goes a bucket
+//at a time.
+//buckets (flowBucket_t *) - (mask + 1) / FLOW_BUCKET_ENTRIES buckets, a power of two
+//mask (size_t) - Entries - 1, the probe wraps around with it
+//shift (int) - 64 - log2 of the buckets, the hash keeps its top bits
+//count (size_t) - Entries in use
+typedef struct FlowTable{
+    flowBucket_t *buckets;
+    size_t mask;
+    int shift;
+    size_t count;
+}flowTable_t;
+
+//Flow table activity of the output threads, summed after the run
+//started (size_t) - Flows added in the timed window
+//finished (size_t) - Flows dropped after their last packet in the timed window
+//peak (size_t) - Most flows one output thread's table held at once
+//probe (const char *) - FLOW_PROBE_NAME of the algorithm's output threads, "none" if they keep no flow table
+//prefetch (int) - 1 if the algorithm was built with PREFETCH=1
+typedef struct FlowStats{
+    size_t started;
+    size_t finished;
+    size_t peak;
+    const char *probe;
+    int prefetch;
+}flowStats_t;
+
+void flow_table_create(flowTable_t *table, size_t flows);
+void flow_table_free(flowTable_t *table);
+size_t flow_table_share();
+size_t * flow_insert(flowTable_t *table, size_t flow);
+void flow_remove(flowTable_t *table, size_t flow);
+void flow_stats(flowStats_t *stats);
+
+//Sets up an empty table sized for flows flows at once, called by the output thread that
+//uses it so the memory is placed on its node. Inlined like flow_lookup(), so the thread
+//records the probe it was compiled with: the algorithm's CFLAGS can pick a wider one than
+//the framework's (Algorithm2 builds with -march=native).
+static inline void flow_table_init(flowTable_t *table, size_t flows){
+    threadVerify.flowProbe = FLOW_PROBE_NAME;
+    threadVerify.flowPrefetch = FLOW_PREFETCH_ON;
+    flow_table_create(table, flows);
+}
+
+//Bucket a flow's probe starts at
+static inline size_t flow_home(const flowTable_t *table, size_t flow){
+    return (size_t)((flow * 0x9E3779B97F4A7C15ULL) >> table->shift);
+}
+
+//Compares a flow id with every entry of a bucket, bit i of the result is set if entry i holds it
+static inline unsigned int flow_match(const flowBucket_t *bucket, size_t flow){
+#if defined(FLOW_PROBE_AVX2)
+    __m256i keys = _mm256_load_si256((const __m256i *)bucket->flows);
+    return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(keys, _mm256_set1_epi64x(flow))));
+#elif defined(FLOW_PROBE_SSE4)
+    __m128i key = _mm_set1_epi64x(flow);
+    unsigned int low = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(_mm_load_si128((const __m128i *)bucket->flows), key)));
+    unsigned int high = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(_mm_load_si128((const __m128i *)bucket->flows + 1), key)));
+    return low | (high << 2);
+#elif defined(FLOW_PROBE_SSE2)
+    //SSE2 compares 32 bits at a time, an id matches when both of its halves do
+    __m128i key = _mm_set1_epi64x(flow);
+    __m128i low = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)bucket->flows), key);
+    __m128i high = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)bucket->flows + 1), key);
+    low = _mm_and_si128(low, _mm_shuffle_epi32(low, _MM_SHUFFLE(2, 3, 0, 1)));
+    high = _mm_and_si128(high, _mm_shuffle_epi32(high, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_movemask_pd(_mm_castsi128_pd(low)) | (_mm_movemask_pd(_mm_castsi128_pd(high)) << 2);
+#else
+    unsigned int match = 0;
+    for(int entry = 0; entry < FLOW_BUCKET_ENTRIES; entry++)
+        match |= (unsigned int)(bucket->flows[entry] == flow) << entry;
+    return match;
+#endif
+}
+
+//Returns the order the flow's next packet must have, a flow seen for the first time is
+//added expecting order 0. Output threads replace a flow indexed expected[] array with it.
+//A bucket with a free entry ends the probe, the flow would have been placed there.
+//Example: size_t *expected = flow_lookup(&flows, currFlow); if(*expected != order) ...
+static inline size_t * flow_lookup(flowTable_t *table, size_t flow){
+    size_t index = flow_home(table, flow);
+    size_t bucketMask = table->mask >> FLOW_BUCKET_BITS;
+    while(1){
+        flowBucket_t *bucket = &table->buckets[index];
+        unsigned int match = flow_match(bucket, flow);
+        if(match != 0)
+            return &bucket->expected[__builtin_ctz(match)];
+        if(flow_match(bucket, FLOW_EMPTY) != 0)
+            return flow_insert(table, flow);
+        index = (index + 1) & bucketMask;
+    }
+}
+
+//Moves the flow on to its next packet once the current one passed. After the last packet
+//of a flow instance (flow churn, -c) the flow's state is dropped.
+static inline void flow_advance(flowTable_t *table, size_t flow, size_t *expected){
+    if(++*expected == flow_packets(flow))
+        flow_remove(table, flow);
+}
+
+//Starts loading the bucket a flow's lookup begins at, so the misses of a batch of packets
+//overlap instead of each stalling its own lookup. Does nothing unless built with PREFETCH=1.
+static inline void flow_prefetch(const flowTable_t *table, size_t flow){
+#ifdef FLOW_PREFETCH
+    __builtin_prefetch(&table->buckets[flow_home(table, flow)]);
+#else
+    (void)table;
+    (void)flow;
+#endif
+}
+
+#endif
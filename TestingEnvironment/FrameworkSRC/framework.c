@@ -48,6 +48,19 @@
 
 #include"global.h" 
 #include"wrapper.h"
+#include"counters.h"
+#include"trace.h"
+#include"occupancy.h"
+#include"host.h"
+#include"results.h"
+#include"verify.h"
+#include"sim.h"
+#include"process.h"
+#include"generator.h"
+#include"latency.h"
+#include"flowtable.h"
+#include"payload.h"
+#include<sys/syscall.h>
 
 #define sizeIgnore 9
 
@@ -171,29 +184,59 @@ void check_if_ideal_conditions(){
 }
 
 void init_built_in_queues(){
-    //initialize all values for built in input/output queues to 0
-    for(int qIndex = 0; qIndex < inputThreadCount; qIndex++){
-        for(int dataIndex = 0; dataIndex < BUFFERSIZE; dataIndex++){
-            input[qIndex].queue.data[dataIndex].packet.flow = 0;
-            input[qIndex].queue.data[dataIndex].packet.order = 0;
-            input[qIndex].queue.data[dataIndex].packet.length = 0;
-            input[qIndex].queue.data[dataIndex].isOccupied = NOT_OCCUPIED;
-
-            output[qIndex].queue.data[dataIndex].packet.flow = 0;
-            output[qIndex].queue.data[dataIndex].packet.order = 0;
-            output[qIndex].queue.data[dataIndex].packet.length = 0;
-            output[qIndex].queue.data[dataIndex].isOccupied = NOT_OCCUPIED;
-        }
-        input[qIndex].queue.toRead = 0;
-        input[qIndex].queue.toWrite = 0;
-        
-        output[qIndex].queue.toRead = 0;
-        output[qIndex].queue.toWrite = 0;
-
+    //Give every built in queue its slots, shared_alloc() zeroes them so every slot starts out
+    //NOT_OCCUPIED. Queues of threads that aren't running get slots too: an algorithm may poll
+    //them (Algorithm4's output thread i starts at input thread i's queue) and must find them empty.
+    for(int qIndex = 0; qIndex < MAX_NUM_INPUT_THREADS; qIndex++){
+        queue_init(&input[qIndex].queue);
+    }
+    for(int qIndex = 0; qIndex < MAX_NUM_OUTPUT_THREADS; qIndex++){
+        queue_init(&output[qIndex].queue);
         output[qIndex].byteCount = 0;
     }
 }
 
+//Every input and output thread starts here. Sets up the framework's per thread
+//state and then runs the algorithm's input or output method.
+void * thread_entry(void * args){
+    io_t *io = (io_t *)args;
+
+#if defined(COROUTINE_SIM)
+    //Coroutines share the main thread, its counters are opened once in sim_start()
+    io->counters.groupFd = -1;
+#elif defined(MULTI_PROCESS)
+    //Keep the per thread state in the shared region where the main process reads it.
+    //Counters opened here couldn't be read from there, it opens them in process_attach()
+    workerState.phases = &io->phasesState;
+    workerState.spin = &io->spinState;
+    workerState.trace = &io->traceState;
+    workerState.verify = &io->verifyState;
+    io->counters.groupFd = -1;
+#else
+    //Open the hardware counters before the algorithm repins the thread
+    counters_open(&io->counters, 0);
+#endif
+
+    //Remember the kernel thread id so the framework can read its context switches
+    io->tid = (pid_t)syscall(SYS_gettid);
+
+    //Let the framework read this thread's phase and spin wait counters
+    io->phases = &threadPhases;
+    io->spin = &threadSpin;
+    io->verify = &threadVerify;
+
+#ifdef EVENT_TRACE
+    //Allocate the event ring and touch it so recording never page faults
+    //With PROCS=1 it is already allocated in the shared region
+    if(threadTrace.events == NULL)
+        threadTrace.events = Malloc(sizeof(tsc_t) * TRACE_RING_SIZE);
+    memset(threadTrace.events, 0, sizeof(tsc_t) * TRACE_RING_SIZE);
+    io->trace = &threadTrace;
+#endif
+
+    return io->routine(&io->threadArgs);
+}
+
 void spawn_input_threads(pthread_attr_t attrs, function input_thread){
     //Core for each input thread to be assigned to
     int core = INPUT_BASE_CORE;
@@ -204,13 +247,18 @@ void spawn_input_threads(pthread_attr_t attrs, function input_thread){
         //input[index].threadArgs.queue = &input[index].queue;
         input[index].threadArgs.threadNum = index;
         input[index].threadArgs.coreNum = core;
+        input[index].routine = input_thread;
         core++;
 
+#ifdef COROUTINE_SIM
+        sim_spawn(&input[index], thread_entry);
+#else
         //Spawn input thread
-        Pthread_create(&input[index].threadID, &attrs, input_thread, (void *)&input[index].threadArgs);
+        Pthread_create(&input[index].threadID, &attrs, thread_entry, (void *)&input[index]);
 
         //Detach the thread
         Pthread_detach(input[index].threadID);
+#endif
     }
 
     //Indicate to user that input threads have spawned
@@ -227,13 +275,18 @@ void spawn_output_threads(pthread_attr_t attrs, function processing_thread){
         //output[index].threadArgs.queue = &output[index].queue;
         output[index].threadArgs.threadNum = index;
         output[index].threadArgs.coreNum = core;
+        output[index].routine = processing_thread;
         core++;
 
+#ifdef COROUTINE_SIM
+        sim_spawn(&output[index], thread_entry);
+#else
         //Spawn the thread
-        Pthread_create(&output[index].threadID, &attrs, processing_thread, (void *)&output[index].threadArgs);
+        Pthread_create(&output[index].threadID, &attrs, thread_entry, (void *)&output[index]);
         
         //Detach the thread
         Pthread_detach(output[index].threadID);
+#endif
     }
 
     //Indicate to user that output threads have spawned
@@ -273,7 +326,7 @@ void check_threads(){
 void monitor_threads(){
     size_t prevCount = 0;
     size_t count = 0;
-    int timer = RUNTIME;
+    int timer = runTime;
     while(endFlag == 0){
         if(timer % 2 == 0){
             for(int i = 0; i < outputThreadCount; i++){
@@ -291,6 +344,7 @@ void monitor_threads(){
             fflush(NULL);
             timer--;  
         }
+        host_sample();
         usleep(1000000);
     }
 }
@@ -299,8 +353,21 @@ void output_data(){
     //Get the algorithm name
     char* algName = get_name();
 
-    //Print to the user that the tests ran successfully
-    printf("Success, passed all packets in order!\n");
+    //Check what the outputs passed against the traffic the seed generates
+    streamCheck_t check;
+    printf("Checking passed packets against the golden stream of seed %u\n", runSeed);
+    verify_stream(&check);
+    if(check.verified){
+        //Print to the user that the tests ran successfully
+        printf("Success, passed all packets in order! Stream checksum %016llx over %lu flow%s\n", (unsigned long long)check.checksum, check.flows,
+            flowLanes > 1 ? " slots (see FLOW_ID_STRIDE)" : "s");
+    }
+    else{
+        if(check.mismatches > 0)
+            printf("ERROR: %lu flow(s) don't match the golden stream. Replay the same traffic with -s %u\n", check.mismatches, runSeed);
+        if(check.corrupt > 0)
+            printf("ERROR: %lu packet(s) were passed with a payload that doesn't match its CRC32C. Replay the same traffic with -s %u\n", check.corrupt, runSeed);
+    }
 	
     //Create the file to write the data to
     FILE *fptr;
@@ -309,9 +376,46 @@ void output_data(){
     //append .csv to algorithm name
     snprintf(fileName, sizeof(fileName),"%s.csv", algName);
 
+    //Find which side of the algorithm was waiting on the other
+    double producerWait, consumerWait;
+    char *bound = spin_classify(&producerWait, &consumerWait);
+
+    //Check whether the host disturbed the run
+    hostNoise_t noise;
+    host_check(&noise);
+
+    //Energy used over the window, if the host exposes it
+    hostEnergy_t energy;
+    host_energy(&energy);
+
     //Output the data to the user
-    printf("\nAlgorithm %s passed %.3f Gbs on average.", algName, (double)((finalTotal/RUNTIME) * 8) / 1000000000);
-    printf("\nAlgorithm %s passed %'lu Packets Per Second on average.\n", algName, (finalTotal/RUNTIME) / ((MAX_PACKET_SIZE + MIN_PACKET_SIZE) / 2));
+    printf("\nAlgorithm %s passed %.3f Gbs on average.", algName, (double)((finalTotal/runTime) * 8) / 1000000000);
+    printf("\nAlgorithm %s passed %'lu Packets Per Second on average.\n", algName, (size_t)((finalTotal/runTime) / avgPacketSize));
+    printf("Goodput: %.3f Gbs of payload, %.1f%% of the bytes passed with %d byte headers\n", (double)((finalTotal/runTime) * 8) * PAYLOAD_SHARE / 1000000000, PAYLOAD_SHARE * 100, PACKET_HEADER_SIZE);
+    if(bound != NULL)
+        printf("Input threads waited %.1f%% and output threads waited %.1f%% of the time: %s\n", producerWait * 100, consumerWait * 100, bound);
+    else
+        printf("Bound unknown (build with SPIN=1): the %s threads polled several queues without timing the waits\n",
+            producerWait < 0 && consumerWait < 0 ? "input and output" : producerWait < 0 ? "input" : "output");
+    printf("The busiest output thread passed %.2fx the mean of the output threads (flow model %s)\n", output_imbalance(), flowModel);
+    if(churnPackets > 0){
+        flowStats_t flows;
+        flow_stats(&flows);
+        printf("Flow churn: %'lu flows started and %'lu ended, %'.0f per second. The output threads held up to %lu flows each\n",
+            flows.started, flows.finished, (double)flows.finished / runTime, flows.peak);
+    }
+    else if(flowLanes > 1){
+        flowStats_t flows;
+        flow_stats(&flows);
+        printf("Flow space: the output threads held up to %'lu flows each, their tables probed with %s%s\n",
+            flows.peak, flows.probe, flows.prefetch ? " and prefetched by batch" : "");
+    }
+    if(energy.available)
+        printf("Algorithm %s used %.1f W, %.1f nJ per packet, %.3f J per gigabit.\n", algName, energy.watts, energy.nanojoulesPerPacket, energy.joulesPerGigabit);
+    else
+        printf("Energy counters unavailable: no readable RAPL domains in /sys/class/powercap\n");
+    if(strcmp(noise.flags, "none") != 0)
+        printf("WARNING: the host disturbed this run (%s), see %s/%s_host.csv\n", noise.flags, RESULTS_DIR, algName);
 
     //if the file alreadty exists, open it
     if(access(fileName, F_OK) != -1){
@@ -324,29 +428,131 @@ void output_data(){
     }	
 	
     //Output the data to the file
-    fprintf(fptr, "%s,%lu,%lu,%lu\n", algName, inputThreadCount, outputThreadCount, (finalTotal/RUNTIME) * 8);
+    fprintf(fptr, "%s,%lu,%lu,%lu\n", algName, inputThreadCount, outputThreadCount, (finalTotal/runTime) * 8);
     fclose(fptr);
+
+    //The columns mainScript.sh and visualization.py don't read go to a file of their own, so
+    //older "algorithm name".csv files keep a header that matches their rows
+    snprintf(fileName, sizeof(fileName), "%s_summary.csv", algName);
+    fptr = open_results_file(fileName, "Algorithm,Input,Output,Bits,ProducerWait,ConsumerWait,Bound,MinMHz,MaxInterrupts,MaxSwitches,Noise,Watts,NanojoulesPerPacket\n");
+    //Waits and bound that weren't timed are left empty
+    fprintf(fptr, "%s,%lu,%lu,%lu,", algName, inputThreadCount, outputThreadCount, (finalTotal/runTime) * 8);
+    if(producerWait >= 0)
+        fprintf(fptr, "%.4f", producerWait);
+    fprintf(fptr, ",");
+    if(consumerWait >= 0)
+        fprintf(fptr, "%.4f", consumerWait);
+    fprintf(fptr, ",%s,", bound != NULL ? bound : "");
+    if(noise.minMHz > 0)
+        fprintf(fptr, "%.0f", noise.minMHz);
+    fprintf(fptr, ",%lld,%lld,%s,", noise.maxInterrupts, noise.maxSwitches, noise.flags);
+    if(energy.available)
+        fprintf(fptr, "%.3f,%.3f", energy.watts, energy.nanojoulesPerPacket);
+    else
+        fprintf(fptr, ",");
+    fprintf(fptr, "\n");
+    fclose(fptr);
+
+    //Keep a record of the run and how it was set up
+    results_record(algName, producerWait, consumerWait, bound, &noise, &energy, &check);
 }
 
 int main(int argc, char**argv){
+    //Remember how the run was started for the results store
+    //before getopt reorders the arguments
+    results_init(argc, argv);
+
+    //Optional flags, they can go before or after the thread counts
+    // -t <seconds>: length of the timed window, RUNTIME by default
+    // -s <seed>: seed of the generated traffic, the same seed gives every algorithm the same packets
+    // -f <model>: how popular each flow is, uniform by default (see generator.c)
+    // -p <pattern>: when input threads send, back to back (steady) by default (see pacer.c)
+    // -r <capture>: pcap or pcapng file the input threads replay instead of generating traffic (see pcap.c)
+    // -l <profile>: payload lengths, fixed:64 by default, up to jumbo frames (see generator.c)
+    // -c <packets>: flow churn, flows end after this many packets on average and new ones take their place
+    // -n <flows>: concurrent flows each input thread sends to, FLOWS_PER_THREAD by default (see generator.h)
+    // -d: fill payloads with data and check their CRC32C on the output side (see payload.c)
+    int opt;
+    runTime = RUNTIME;
+    runSeed = (unsigned int)time(NULL);
+    flowModel = "uniform";
+    trafficPattern = "steady";
+    replayFile = NULL;
+    sizeProfile = "fixed:64";
+    churnPackets = 0;
+    flowLanes = 1;
+    payloadCheck = 0;
+    while((opt = getopt(argc, argv, "t:s:f:p:r:l:c:n:d")) != -1){
+        switch(opt){
+            case 't':
+                runTime = atoi(optarg);
+                if(runTime < 1){
+                    printf("The window must be at least 1 second long\n");
+                    exit(1);
+                }
+                break;
+            case 's':
+                runSeed = (unsigned int)strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                flowModel = optarg;
+                break;
+            case 'p':
+                trafficPattern = optarg;
+                break;
+            case 'r':
+                replayFile = optarg;
+                break;
+            case 'l':
+                sizeProfile = optarg;
+                break;
+            case 'c':
+                churnPackets = strtoul(optarg, NULL, 0);
+                if(churnPackets < 1 || churnPackets > (1UL << 30)){
+                    printf("Flows must last 1 to %lu packets on average\n", 1UL << 30);
+                    exit(1);
+                }
+                break;
+            case 'n':
+                flowLanes = strtoul(optarg, NULL, 0) / FLOWS_PER_THREAD;
+                if(flowLanes < 1 || flowLanes > FLOW_MAX_LANES || strtoul(optarg, NULL, 0) % FLOWS_PER_THREAD != 0){
+                    printf("Input threads send to a multiple of %u flows, %u to %lu\n", FLOWS_PER_THREAD, FLOWS_PER_THREAD, FLOWS_PER_THREAD * FLOW_MAX_LANES);
+                    exit(1);
+                }
+                break;
+            case 'd':
+                payloadCheck = 1;
+                break;
+            default:
+                printf("Usage: sudo ./framework [-t <seconds>] [-s <seed>] [-f <flow model>] [-p <pattern>] [-r <capture>] [-l <size profile>] [-c <packets per flow>] [-n <flows per input thread>] [-d] <# input threads>, <# output threads>\n");
+                exit(1);
+        }
+    }
+
     //Error checking for proper command line arguments
-    if (argc < 3){
-        printf("Usage: sudo ./framework <# input threads>, <# output threads>\n");
+    if (argc - optind < 2){
+        printf("Usage: sudo ./framework [-t <seconds>] [-s <seed>] [-f <flow model>] [-p <pattern>] [-r <capture>] [-l <size profile>] [-c <packets per flow>] [-n <flows per input thread>] [-d] <# input threads>, <# output threads>\n");
         exit(0);
     }
 
     //Used for formatting numbers with commas
     setlocale(LC_NUMERIC, "");
 
+    //With PROCS=1 the flags and io_t arrays are placed in the shared region first
+    process_init();
+
     //Ensure that no other process is running in the background. 
     //If the user passes a flag indicating that they dont care about background processes
     //then dont run this code.
-    if (argc < 4){
+    //The coroutine simulation shares one core with everything else on purpose.
+#ifndef COROUTINE_SIM
+    if (argc - optind < 3){
         check_if_ideal_conditions();
     }
+#endif
 
     //Assign the main thread to run on the first core and dont change its scheduling
-    set_thread_props(0, 2);
+    set_thread_props(MONITOR_CORE, 2);
 
     //Initialize thread attributes
     pthread_attr_t attrs;
@@ -362,14 +568,24 @@ int main(int argc, char**argv){
     }
 
     //Grab the number of input and output threads to use
-    inputThreadCount = atoi(argv[1]);
-    outputThreadCount = atoi(argv[2]);
+    inputThreadCount = atoi(argv[optind]);
+    outputThreadCount = atoi(argv[optind + 1]);
 
     //Make sure that the number of input and output threads is valid
     assert(inputThreadCount <= MAX_NUM_INPUT_THREADS);
     assert(outputThreadCount <= MAX_NUM_OUTPUT_THREADS);
     assert(inputThreadCount >= MIN_INPUT_THREAD_COUNT && outputThreadCount >= MIN_OUTPUT_THREAD_COUNT);
 
+    //Pick the packet generator the input threads will use and check it against the scalar one,
+    //or split the capture to replay between them
+    generator_select();
+
+    //Flow ids go back to a lane's first one after whole rounds of the lanes (see FLOW_ID_INSTANCES),
+    //a capture sets the lanes it needs in generator_select()
+    flowIdWrap = (FLOW_ID_INSTANCES / flowLanes) * flowLanes * FLOW_ID_STRIDE;
+    if(payloadCheck)
+        payload_setup();
+
     //Initialize the sets of queues to 0
     init_built_in_queues();
 
@@ -381,12 +597,35 @@ int main(int argc, char**argv){
     pthread_t *extraThreads;
     extraThreads = run(NULL);
 
+#ifdef MULTI_PROCESS
+    //Each side runs in a worker process of its own that only shares the regions
+    //allocated so far with this one. The workers never return from here.
+    if(process_fork(INPUT_SIDE) == 0){
+        spawn_input_threads(attrs, get_input_thread());
+        process_idle();
+    }
+    if(process_fork(OUTPUT_SIDE) == 0){
+        spawn_output_threads(attrs, get_output_thread());
+        process_idle();
+    }
+#else
     spawn_input_threads(attrs, get_input_thread());
 
     spawn_output_threads(attrs, get_output_thread());
+#endif
 
     //Indicate to the user that the tests are starting
     printf("\nStarting Metric for Algorithm: %s\n", get_name());
+    printf("Traffic seed: %u (replay with -s %u)\n", runSeed, runSeed);
+    printf("Packet generator: %s, flow model: %s, pattern: %s\n", generatorName, flowModel, trafficPattern);
+    printf("Payloads: %s, up to %lu bytes, %.1f byte packets on average with %d byte headers\n", replayFile != NULL ? "capture" : sizeProfile, maxPayload, avgPacketSize, PACKET_HEADER_SIZE);
+    if(churnPackets > 0)
+        printf("Flow churn: every flow ends after %lu packets on average and a new one takes its place\n", churnPackets);
+    if(flowLanes > 1)
+        printf("Flow space: %'lu flows per input thread, %'lu in all\n",
+            FLOWS_PER_THREAD * flowLanes, inputThreadCount * FLOWS_PER_THREAD * flowLanes);
+    if(payloadCheck)
+        printf("Payload check: payloads are filled from the seed and checked with CRC32C (%s)\n", payloadCrcName);
 
     //Setup the alarm
     alarm_init();
@@ -394,8 +633,14 @@ int main(int argc, char**argv){
     //Indicate we are waiting for threads to be ready
     printf("\nWaiting for Threads to be Ready:\n\n");
 
+    //Coroutines only run when scheduled, run them up to their start wait
+    sim_start();
+
     check_threads();
 
+    //Worker threads in other processes get their counters opened from here
+    process_attach();
+
     printf("\nAll Threads Ready. *** Starting Passing ***\n\n\n");
     fflush(NULL);
 
@@ -410,12 +655,20 @@ int main(int argc, char**argv){
     //Reset final results
     finalTotal = 0;
 
+    //Start sampling the queues before the threads start passing
+    occupancy_start();
+
     //Start the alarm and set start flag to signal all threads to start
     alarm_start();
 
+#ifdef COROUTINE_SIM
+    //Run the coroutines for the timed window
+    sim_run();
+#else
     //Wait for threads to finish and print out to the user estimates
     //of how their algorithm is doing
     monitor_threads();
+#endif
 
     //Wait for any threads that were spawed in the run function to finish
     if(extraThreads != NULL){
@@ -427,6 +680,15 @@ int main(int argc, char**argv){
 
     //Output all data to user and files
     output_data();
+    counters_report(get_name());
+    phases_report(get_name());
+    spin_report(get_name());
+    trace_report(get_name());
+    occupancy_report(get_name());
+    host_report(get_name());
+    latency_report(get_name());
+    payload_report(get_name());
+    sim_report(get_name());
 
     return 1;
 } 
\ No newline at end of file
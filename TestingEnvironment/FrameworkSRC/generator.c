@@ -0,0 +1,550 @@
+//Batch packet generator
+//Every algorithm's input threads get their packet headers from here in bursts of
+//GEN_BURST (next_header() in generator.h) instead of stepping the two LCGs of
+//GENERATE_FLOW() and GENERATE_LENGTH() once per packet. The scalar implementation is the
+//reference: it runs those macros. The SSE4.1 and AVX2 implementations run 4 or 8 steps of
+//each LCG at once by jumping ahead: lane i starts at the seed after i + 1 steps and every
+//lane then moves by the lane count. The % of the length is done with a float reciprocal
+//and an integer fix up, so the headers are bit for bit the ones the macros give.
+//
+//Flows are drawn through an alias table (Walker/Vose) built from the flow model picked with
+//-f, so a skewed model costs one table lookup per packet whatever its shape. The most
+//popular ranks are handed to a different flow in every input thread. Payload lengths come
+//from the size profile picked with -l, a modulo for uniform profiles and a table lookup for
+//weighted ones such as IMIX.
+//
+//generator_select() picks the widest implementation the CPU supports at startup (GEN= in
+//options.mk forces one) and checks it against the scalar one before any thread runs, so
+//the generator can't make one algorithm look faster than another by being wrong.
+
+#include<global.h>
+#include<wrapper.h>
+#include<generator.h>
+#include<pcap.h>
+
+//SIMD implementations built, only the forced one with GEN= in options.mk
+#if defined(__x86_64__) || defined(__i386__)
+    #include<immintrin.h>
+    #if defined(GEN_FORCE_AVX2) || (!defined(GEN_FORCE_SSE) && !defined(GEN_FORCE_SCALAR))
+        #define GEN_AVX2
+    #endif
+    #if defined(GEN_FORCE_SSE) || (!defined(GEN_FORCE_AVX2) && !defined(GEN_FORCE_SCALAR))
+        #define GEN_SSE
+    #endif
+#endif
+
+//Headers compared with the scalar generator at startup, not a multiple of any lane count
+//so the scalar tail of the SIMD implementations is checked too
+#define GEN_CHECK_HEADERS (GEN_BURST * 32 + 7)
+
+void (*generate_burst)(generator_t *gen, draw_t *headers, size_t count);
+const char *generatorName;
+
+//Share of the traffic each rank of flow gets under the flow model, most popular first
+static double rankWeights[FLOWS_PER_THREAD];
+
+//Payload lengths of the size profile
+payloadSizes_t payloadSizes;
+
+//Simple IMIX: 64, 594 and 1518 byte packets in a 7:4:1 ratio
+static const uint32_t imixLengths[] = {64, 594, 1518};
+static const double imixWeights[] = {7, 4, 1};
+
+//Most lengths a table size profile can list
+#define MAX_TABLE_LENGTHS 64
+
+//Multiplier and increment that take an LCG seed i + 1 steps ahead (mod 2^32)
+static uint32_t jumpMul[8];
+static uint32_t jumpAdd[8];
+
+//Sets the share of each rank from the -f argument
+//uniform: every flow gets the same share (the default)
+//zipf:<s>: the flow of rank k gets a share proportional to 1 / k^s
+//mix:<elephants>:<share>: that many elephant flows carry share of the traffic, the mice the rest
+//hot[:<share>]: one flow carries share of the traffic, all of it by default
+static void flow_model_parse(const char *model){
+    double exponent, share, total = 0;
+    int elephants;
+    char extra;
+
+    if(strcmp(model, "uniform") == 0){
+        for(size_t rank = 0; rank < FLOWS_PER_THREAD; rank++){
+            rankWeights[rank] = 1;
+        }
+    }
+    else if(sscanf(model, "zipf:%lf%c", &exponent, &extra) == 1 && exponent > 0){
+        for(size_t rank = 0; rank < FLOWS_PER_THREAD; rank++){
+            rankWeights[rank] = 1 / pow(rank + 1, exponent);
+        }
+    }
+    else if(sscanf(model, "mix:%d:%lf%c", &elephants, &share, &extra) == 2 && elephants >= 1 && elephants < FLOWS_PER_THREAD && share > 0 && share < 1){
+        for(size_t rank = 0; rank < FLOWS_PER_THREAD; rank++){
+            rankWeights[rank] = rank < elephants ? share / elephants : (1 - share) / (FLOWS_PER_THREAD - elephants);
+        }
+    }
+    else if(strcmp(model, "hot") == 0 || (sscanf(model, "hot:%lf%c", &share, &extra) == 1 && share > 0 && share <= 1)){
+        if(strcmp(model, "hot") == 0)
+            share = 1;
+        for(size_t rank = 0; rank < FLOWS_PER_THREAD; rank++){
+            rankWeights[rank] = rank == 0 ? share : (1 - share) / (FLOWS_PER_THREAD - 1);
+        }
+    }
+    else{
+        printf("Unknown flow model %s. Use uniform, zipf:<s>, mix:<elephants>:<share> or hot[:<share>]\n", model);
+        exit(1);
+    }
+
+    for(size_t rank = 0; rank < FLOWS_PER_THREAD; rank++){
+        total += rankWeights[rank];
+    }
+    for(size_t rank = 0; rank < FLOWS_PER_THREAD; rank++){
+        rankWeights[rank] /= total;
+    }
+}
+
+//Hands each length as many entries of the size table as its share of the weight, what
+//rounding leaves over or takes from lengths too rare for an entry goes to the heaviest
+static void size_table_build(const uint32_t *lengths, const double *weights, size_t count){
+    int64_t left = GEN_LENGTH_LEVELS;
+    double total = 0;
+    size_t heaviest = 0;
+    int64_t entries[MAX_TABLE_LENGTHS];
+    size_t next = 0;
+
+    for(size_t i = 0; i < count; i++){
+        total += weights[i];
+        if(weights[i] > weights[heaviest])
+            heaviest = i;
+    }
+    for(size_t i = 0; i < count; i++){
+        entries[i] = (int64_t)(weights[i] / total * GEN_LENGTH_LEVELS);
+        if(entries[i] == 0)
+            entries[i] = 1;
+        left -= entries[i];
+    }
+    entries[heaviest] += left;
+
+    for(size_t i = 0; i < count; i++){
+        for(int64_t entry = 0; entry < entries[i]; entry++){
+            payloadSizes.table[next++] = lengths[i];
+        }
+    }
+    payloadSizes.weighted = 1;
+}
+
+//Sets the payload lengths from the -l argument
+//fixed:<length>: every packet has that payload (fixed:64 is the default)
+//uniform:<min>:<max>: every length from min to max is equally likely
+//imix: Simple IMIX, 64, 594 and 1518 bytes in a 7:4:1 ratio
+//table:<length>=<weight>,...: the lengths in proportion to their weights, 1 if left out
+static void size_profile_parse(const char *profile){
+    unsigned int first, second;
+    char extra;
+
+    payloadSizes.weighted = 0;
+    if(sscanf(profile, "fixed:%u%c", &first, &extra) == 1 && first >= MIN_PAYLOAD_SIZE && first <= MAX_PAYLOAD_SIZE){
+        payloadSizes.min = first;
+        payloadSizes.range = 1;
+    }
+    else if(sscanf(profile, "uniform:%u:%u%c", &first, &second, &extra) == 2 && first >= MIN_PAYLOAD_SIZE && second <= MAX_PAYLOAD_SIZE && first <= second){
+        payloadSizes.min = first;
+        payloadSizes.range = second - first + 1;
+    }
+    else if(strcmp(profile, "imix") == 0){
+        size_table_build(imixLengths, imixWeights, 3);
+    }
+    else if(strncmp(profile, "table:", 6) == 0){
+        uint32_t lengths[MAX_TABLE_LENGTHS];
+        double weights[MAX_TABLE_LENGTHS];
+        size_t count = 0;
+        const char *entry = profile + 6;
+
+        while(1){
+            int used = 0;
+            double weight = 1;
+
+            if(count == MAX_TABLE_LENGTHS || sscanf(entry, "%u%n", &first, &used) != 1 || first < MIN_PAYLOAD_SIZE || first > MAX_PAYLOAD_SIZE)
+                break;
+            entry += used;
+            if(*entry == '='){
+                if(sscanf(entry + 1, "%lf%n", &weight, &used) != 1 || weight <= 0)
+                    break;
+                entry += 1 + used;
+            }
+            lengths[count] = first;
+            weights[count++] = weight;
+
+            if(*entry != ',')
+                break;
+            entry++;
+        }
+        if(*entry == '\0' && count > 0)
+            size_table_build(lengths, weights, count);
+        else
+            profile = NULL;
+    }
+    else{
+        profile = NULL;
+    }
+
+    if(profile == NULL){
+        printf("Unknown size profile %s. Use fixed:<length>, uniform:<min>:<max>, imix or table:<length>=<weight>,... with lengths from %d to %d\n", sizeProfile, MIN_PAYLOAD_SIZE, MAX_PAYLOAD_SIZE);
+        exit(1);
+    }
+}
+
+//Sets the packet layout (global.h) from the lengths the input threads can send: every draw
+//of the size profile, or every packet of the capture
+static void packet_layout(){
+    double total = 0;
+    size_t count = 0;
+
+    maxPayload = 0;
+    if(replayFile != NULL){
+        for(size_t thread = 0; thread < inputThreadCount; thread++){
+            replay_t *replay = pcap_replay(thread);
+            for(size_t i = 0; i < replay->count; i++){
+                total += replay->headers[i].length;
+                if(replay->headers[i].length > maxPayload)
+                    maxPayload = replay->headers[i].length;
+            }
+            count += replay->count;
+        }
+    }
+    else{
+        for(uint32_t bits = 0; bits < (1 << 16); bits++){
+            uint32_t length = pick_length(bits);
+            total += length;
+            if(length > maxPayload)
+                maxPayload = length;
+        }
+        count = 1 << 16;
+    }
+
+    avgPacketSize = PACKET_HEADER_SIZE + total / count;
+    packetStride = (PACKET_HEADER_SIZE + maxPayload + 7) & ~(size_t)7;
+    slotStride = (sizeof(data_t) + maxPayload + 7) & ~(size_t)7;
+}
+
+//Seeds the generator of an input thread from the run seed and builds its alias table
+void generator_init(generator_t *gen, size_t threadNum){
+    double weights[FLOWS_PER_THREAD];
+    uint32_t quota[FLOWS_PER_THREAD];
+    uint32_t small[FLOWS_PER_THREAD], large[FLOWS_PER_THREAD];
+    size_t smallCount = 0, largeCount = 0, biggest = 0;
+    int64_t left = (int64_t)GEN_FLOW_LEVELS * FLOWS_PER_THREAD;
+
+    //Seeds past the last input thread never generate traffic, so this is a stream of its own
+    unsigned int shuffleSeed = thread_seed(MAX_NUM_INPUT_THREADS + threadNum, FLOW_STREAM);
+
+    gen->flowSeed = thread_seed(threadNum, FLOW_STREAM);
+    gen->lengthSeed = thread_seed(threadNum, LENGTH_STREAM);
+    gen->next = GEN_BURST;
+    pacer_init(&gen->pacer, threadNum);
+
+    replay_t *replay = pcap_replay(threadNum);
+    gen->replay = replay != NULL ? replay->headers : NULL;
+    gen->replayCount = replay != NULL ? replay->count : 0;
+    gen->replayNext = 0;
+
+    //Lane l of a slot is the slot's flow l strides up, see FLOW_ID_STRIDE
+    gen->lanes = Malloc(sizeof(flowLane_t) * FLOWS_PER_THREAD * flowLanes);
+    for(size_t slot = 0; slot < FLOWS_PER_THREAD; slot++){
+        for(size_t lane = 0; lane < flowLanes; lane++){
+            gen->lanes[slot * flowLanes + lane].flow = threadNum * FLOWS_PER_THREAD + slot + lane * FLOW_ID_STRIDE;
+            gen->lanes[slot * flowLanes + lane].order = 0;
+        }
+        gen->cursors[slot] = 0;
+    }
+
+    //Hand the ranks to the flows in a random order (Fisher-Yates), otherwise the most
+    //popular flow of every thread would be the same offset and hash to the same output
+    memcpy(weights, rankWeights, sizeof(weights));
+    for(size_t flow = FLOWS_PER_THREAD - 1; flow > 0; flow--){
+        size_t other = (NEXT_SEED(shuffleSeed) >> 16) % (flow + 1);
+        double weight = weights[flow];
+        weights[flow] = weights[other];
+        weights[other] = weight;
+    }
+
+    //Levels of the table each flow gets, what rounding leaves over goes to the most popular
+    for(size_t flow = 0; flow < FLOWS_PER_THREAD; flow++){
+        quota[flow] = (uint32_t)(weights[flow] * GEN_FLOW_LEVELS * FLOWS_PER_THREAD);
+        left -= quota[flow];
+        if(weights[flow] > weights[biggest])
+            biggest = flow;
+    }
+    quota[biggest] += left;
+
+    //Fill each column short of a full share with the rest of a flow that has more than one,
+    //in integers so every flow gets exactly its quota
+    for(uint32_t flow = 0; flow < FLOWS_PER_THREAD; flow++){
+        if(quota[flow] < GEN_FLOW_LEVELS)
+            small[smallCount++] = flow;
+        else
+            large[largeCount++] = flow;
+    }
+    gen->skewed = smallCount > 0;
+    while(smallCount > 0 && largeCount > 0){
+        uint32_t less = small[--smallCount];
+        uint32_t more = large[largeCount - 1];
+
+        gen->threshold[less] = quota[less];
+        gen->alias[less] = more;
+        quota[more] -= GEN_FLOW_LEVELS - quota[less];
+        if(quota[more] < GEN_FLOW_LEVELS){
+            largeCount--;
+            small[smallCount++] = more;
+        }
+    }
+    while(largeCount > 0){
+        uint32_t flow = large[--largeCount];
+        gen->threshold[flow] = GEN_FLOW_LEVELS;
+        gen->alias[flow] = flow;
+    }
+}
+
+//Frees the lanes of a generator that won't hand out headers any more
+void generator_free(generator_t *gen){
+    free(gen->lanes);
+    gen->lanes = NULL;
+}
+
+//Reference implementation, one step of each LCG per header. With -r it hands out the
+//thread's share of the capture instead, starting over at its end.
+void generate_burst_scalar(generator_t *gen, draw_t *headers, size_t count){
+    unsigned int flowSeed = gen->flowSeed;
+    unsigned int lengthSeed = gen->lengthSeed;
+
+    if(gen->replay != NULL){
+        for(size_t i = 0; i < count; i++){
+            headers[i] = gen->replay[gen->replayNext];
+            if(++gen->replayNext == gen->replayCount)
+                gen->replayNext = 0;
+        }
+        return;
+    }
+
+    for(size_t i = 0; i < count; i++){
+        NEXT_SEED(flowSeed);
+        headers[i].flow = pick_flow(gen, flowSeed >> 16);
+        headers[i].length = GENERATE_LENGTH(lengthSeed);
+    }
+
+    gen->flowSeed = flowSeed;
+    gen->lengthSeed = lengthSeed;
+}
+
+#ifdef GEN_AVX2
+
+//8 headers per step, lanes are split into 128 bit halves by the unpacks so they are
+//put back in order before the store
+__attribute__((target("avx2")))
+static void generate_burst_avx2(generator_t *gen, draw_t *headers, size_t count){
+    size_t i = 0;
+
+    if(count >= 8){
+        __m256i mul = _mm256_loadu_si256((__m256i *)jumpMul);
+        __m256i add = _mm256_loadu_si256((__m256i *)jumpAdd);
+        __m256i stepMul = _mm256_set1_epi32(jumpMul[7]);
+        __m256i stepAdd = _mm256_set1_epi32(jumpAdd[7]);
+        __m256i flowSeeds = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(gen->flowSeed), mul), add);
+        __m256i lengthSeeds = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(gen->lengthSeed), mul), add);
+        __m256i flowMask = _mm256_set1_epi32(FLOWS_PER_THREAD_MOD);
+        __m256i range = _mm256_set1_epi32(payloadSizes.range);
+        __m256i minLength = _mm256_set1_epi32(payloadSizes.min);
+        __m256i zero = _mm256_setzero_si256();
+        __m256 reciprocal = _mm256_set1_ps(1.0f / payloadSizes.range);
+        __m256i lastFlow, lastLength;
+
+        do{
+            __m256i bits = _mm256_srli_epi32(flowSeeds, 16);
+            __m256i flows = _mm256_and_si256(bits, flowMask);
+            if(gen->skewed){
+                __m256i thresholds = _mm256_i32gather_epi32((const int *)gen->threshold, flows, 4);
+                __m256i aliases = _mm256_i32gather_epi32((const int *)gen->alias, flows, 4);
+                __m256i keep = _mm256_cmpgt_epi32(thresholds, _mm256_srli_epi32(bits, FLOWS_PER_THREAD_BITS));
+                flows = _mm256_blendv_epi8(aliases, flows, keep);
+            }
+
+            //min + (seed >> 16) % range, the float quotient can be one off either way
+            __m256i value = _mm256_srli_epi32(lengthSeeds, 16);
+            __m256i lengths;
+            if(payloadSizes.weighted){
+                lengths = _mm256_i32gather_epi32((const int *)payloadSizes.table, _mm256_srli_epi32(value, GEN_LENGTH_SHIFT), 4);
+            }
+            else{
+                __m256i quotient = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(value), reciprocal));
+                lengths = _mm256_sub_epi32(value, _mm256_mullo_epi32(quotient, range));
+                lengths = _mm256_add_epi32(lengths, _mm256_and_si256(_mm256_cmpgt_epi32(zero, lengths), range));
+                lengths = _mm256_sub_epi32(lengths, _mm256_andnot_si256(_mm256_cmpgt_epi32(range, lengths), range));
+                lengths = _mm256_add_epi32(lengths, minLength);
+            }
+
+            __m256i low = _mm256_unpacklo_epi32(flows, lengths);
+            __m256i high = _mm256_unpackhi_epi32(flows, lengths);
+            _mm256_storeu_si256((__m256i *)&headers[i], _mm256_permute2x128_si256(low, high, 0x20));
+            _mm256_storeu_si256((__m256i *)&headers[i + 4], _mm256_permute2x128_si256(low, high, 0x31));
+
+            lastFlow = flowSeeds;
+            lastLength = lengthSeeds;
+            flowSeeds = _mm256_add_epi32(_mm256_mullo_epi32(flowSeeds, stepMul), stepAdd);
+            lengthSeeds = _mm256_add_epi32(_mm256_mullo_epi32(lengthSeeds, stepMul), stepAdd);
+            i += 8;
+        }while(i + 8 <= count);
+
+        //The last lane holds the seed after the last header stored
+        gen->flowSeed = _mm256_extract_epi32(lastFlow, 7);
+        gen->lengthSeed = _mm256_extract_epi32(lastLength, 7);
+    }
+
+    generate_burst_scalar(gen, headers + i, count - i);
+}
+
+#endif
+
+#ifdef GEN_SSE
+
+//4 headers per step, for CPUs without AVX2
+__attribute__((target("sse4.1")))
+static void generate_burst_sse(generator_t *gen, draw_t *headers, size_t count){
+    size_t i = 0;
+
+    if(count >= 4){
+        __m128i mul = _mm_loadu_si128((__m128i *)jumpMul);
+        __m128i add = _mm_loadu_si128((__m128i *)jumpAdd);
+        __m128i stepMul = _mm_set1_epi32(jumpMul[3]);
+        __m128i stepAdd = _mm_set1_epi32(jumpAdd[3]);
+        __m128i flowSeeds = _mm_add_epi32(_mm_mullo_epi32(_mm_set1_epi32(gen->flowSeed), mul), add);
+        __m128i lengthSeeds = _mm_add_epi32(_mm_mullo_epi32(_mm_set1_epi32(gen->lengthSeed), mul), add);
+        __m128i flowMask = _mm_set1_epi32(FLOWS_PER_THREAD_MOD);
+        __m128i range = _mm_set1_epi32(payloadSizes.range);
+        __m128i minLength = _mm_set1_epi32(payloadSizes.min);
+        __m128i zero = _mm_setzero_si128();
+        __m128 reciprocal = _mm_set1_ps(1.0f / payloadSizes.range);
+        __m128i lastFlow, lastLength;
+
+        do{
+            //Skewed models and weighted sizes keep the whole draw, their tables are looked up below
+            __m128i bits = _mm_srli_epi32(flowSeeds, 16);
+            __m128i flows = gen->skewed ? bits : _mm_and_si128(bits, flowMask);
+
+            __m128i value = _mm_srli_epi32(lengthSeeds, 16);
+            __m128i lengths = value;
+            if(!payloadSizes.weighted){
+                __m128i quotient = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(value), reciprocal));
+                lengths = _mm_sub_epi32(value, _mm_mullo_epi32(quotient, range));
+                lengths = _mm_add_epi32(lengths, _mm_and_si128(_mm_cmpgt_epi32(zero, lengths), range));
+                lengths = _mm_sub_epi32(lengths, _mm_andnot_si128(_mm_cmpgt_epi32(range, lengths), range));
+                lengths = _mm_add_epi32(lengths, minLength);
+            }
+
+            _mm_storeu_si128((__m128i *)&headers[i], _mm_unpacklo_epi32(flows, lengths));
+            _mm_storeu_si128((__m128i *)&headers[i + 2], _mm_unpackhi_epi32(flows, lengths));
+
+            lastFlow = flowSeeds;
+            lastLength = lengthSeeds;
+            flowSeeds = _mm_add_epi32(_mm_mullo_epi32(flowSeeds, stepMul), stepAdd);
+            lengthSeeds = _mm_add_epi32(_mm_mullo_epi32(lengthSeeds, stepMul), stepAdd);
+            i += 4;
+        }while(i + 4 <= count);
+
+        gen->flowSeed = _mm_extract_epi32(lastFlow, 3);
+        gen->lengthSeed = _mm_extract_epi32(lastLength, 3);
+
+        //There is no gather before AVX2
+        if(gen->skewed){
+            for(size_t j = 0; j < i; j++){
+                headers[j].flow = pick_flow(gen, headers[j].flow);
+            }
+        }
+        if(payloadSizes.weighted){
+            for(size_t j = 0; j < i; j++){
+                headers[j].length = pick_length(headers[j].length);
+            }
+        }
+    }
+
+    generate_burst_scalar(gen, headers + i, count - i);
+}
+
+#endif
+
+//Makes sure the selected implementation gives the scalar headers and leaves the same seeds
+static void generator_check(){
+    static draw_t expected[GEN_CHECK_HEADERS];
+    static draw_t generated[GEN_CHECK_HEADERS];
+    generator_t reference, selected;
+
+    generator_init(&reference, 0);
+    generator_init(&selected, 0);
+    generate_burst_scalar(&reference, expected, GEN_CHECK_HEADERS);
+    generate_burst(&selected, generated, GEN_CHECK_HEADERS);
+
+    if(memcmp(expected, generated, sizeof(expected)) != 0 || reference.flowSeed != selected.flowSeed || reference.lengthSeed != selected.lengthSeed){
+        printf("ERROR: the %s packet generator doesn't match the scalar one\n", generatorName);
+        exit(1);
+    }
+    generator_free(&reference);
+    generator_free(&selected);
+}
+
+//Sets up the flow model, size profile, capture and temporal model, sets the packet layout
+//and picks the packet generator, called in main() once the run seed, models and thread
+//counts are known
+void generator_select(){
+    uint32_t mul = 1;
+    uint32_t add = 0;
+
+    flow_model_parse(flowModel);
+    size_profile_parse(sizeProfile);
+    if(replayFile != NULL)
+        pcap_load(replayFile);
+    packet_layout();
+    pacer_setup();
+
+    //Lifetimes of the flow instances under churn, from seeds past the ones the pacer uses
+    churnSalt = ((uint64_t)thread_seed(3 * MAX_NUM_INPUT_THREADS, FLOW_STREAM) << 32) | thread_seed(3 * MAX_NUM_INPUT_THREADS, LENGTH_STREAM);
+
+    for(int i = 0; i < 8; i++){
+        add = 214013 * add + 2531011;
+        mul = 214013 * mul;
+        jumpMul[i] = mul;
+        jumpAdd[i] = add;
+    }
+
+    generate_burst = generate_burst_scalar;
+    generatorName = "scalar";
+
+    //A capture sets the flows and lengths itself, there is nothing to generate
+    if(replayFile != NULL){
+        if(strcmp(flowModel, "uniform") != 0 || strcmp(sizeProfile, "fixed:64") != 0 || churnPackets != 0){
+            printf("ERROR: -f, -l and -c can't be used with -r, the capture decides how popular each flow is, how long each packet is and when flows end\n");
+            exit(1);
+        }
+        generatorName = "pcap";
+        return;
+    }
+
+#ifdef GEN_AVX2
+    if(__builtin_cpu_supports("avx2")){
+        generate_burst = generate_burst_avx2;
+        generatorName = "avx2";
+    }
+#endif
+#ifdef GEN_SSE
+    if(generate_burst == generate_burst_scalar && __builtin_cpu_supports("sse4.1")){
+        generate_burst = generate_burst_sse;
+        generatorName = "sse4.1";
+    }
+#endif
+
+#if defined(GEN_FORCE_AVX2) || defined(GEN_FORCE_SSE)
+    if(generate_burst == generate_burst_scalar){
+        printf("ERROR: this CPU can't run the packet generator forced with GEN=\n");
+        exit(1);
+    }
+#endif
+
+    generator_check();
+}
@@ -0,0 +1,167 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include"global.h"
+#include"pacer.h"
+#include"latency.h"
+
+//Headers an input thread generates at a time with next_header()
+#define GEN_BURST 32
+
+//Levels of an alias table threshold, the bits of a flow draw left over after picking a column
+#define GEN_FLOW_LEVELS (1U << (16 - FLOWS_PER_THREAD_BITS))
+
+//Entries of the table a weighted size profile picks lengths from, the top bits of a length draw index it
+#define GEN_LENGTH_LEVELS 1024
+#define GEN_LENGTH_SHIFT 6 //16 - log2 of GEN_LENGTH_LEVELS
+
+//One draw of the generator, what generate_burst() writes
+//flow (uint32_t) - Flow slot of the packet within its input thread (0 to FLOWS_PER_THREAD - 1),
+//                  for a capture (-r) the id of its flow in the thread (see pcap.c)
+//length (uint32_t) - Payload length of the packet (MIN_PAYLOAD_SIZE to MAX_PAYLOAD_SIZE, see the size profile)
+typedef struct Draw{
+    uint32_t flow;
+    uint32_t length;
+}draw_t;
+
+//Header of the next packet of an input thread, what next_header() hands out
+//flow (size_t) - Global flow id of the packet, a new one for every instance of the slot under churn (-c)
+//order (size_t) - Order of the packet within its flow, from 0
+//length (size_t) - Payload length of the packet
+typedef struct Header{
+    size_t flow;
+    size_t order;
+    size_t length;
+}header_t;
+
+//Flow a slot is sending to, one per lane of the slot (-n)
+//flow (size_t) - Global flow id of the lane's current instance
+//order (size_t) - Packets of the instance handed out, the order the next one gets
+typedef struct FlowLane{
+    size_t flow;
+    size_t order;
+}flowLane_t;
+
+//Payload lengths of the size profile picked with -l, the same for every input thread
+//min (uint32_t) - Smallest length of a uniform profile
+//range (uint32_t) - Lengths of a uniform profile, it gives min + draw % range (range 1 is a fixed length)
+//weighted (int) - 1 if the profile is a weighted table, table is only looked up then
+//table (uint32_t array) - Length of each 1/GEN_LENGTH_LEVELS of the draws, a length gets as many entries as its weight
+typedef struct PayloadSizes{
+    uint32_t min;
+    uint32_t range;
+    int weighted;
+    uint32_t table[GEN_LENGTH_LEVELS];
+}payloadSizes_t;
+
+extern payloadSizes_t payloadSizes;
+
+//Packet generator of one input thread, the same two LCGs as GENERATE_FLOW() and
+//GENERATE_LENGTH() so a burst holds exactly the packets the macros would give one by one,
+//with the flows drawn from the flow model (-f) through an alias table
+//flowSeed (unsigned int) - Seed of the flow stream (thread_seed(threadNum, FLOW_STREAM))
+//lengthSeed (unsigned int) - Seed of the length stream (thread_seed(threadNum, LENGTH_STREAM))
+//skewed (int) - 1 if the flow model isn't uniform, the alias table is only looked up then
+//threshold (uint32_t array) - Alias table of the flow model: a draw that lands in column c
+//                             keeps flow c if its level is below threshold[c] (of GEN_FLOW_LEVELS)
+//alias (uint32_t array) - Flow a draw in column c gets otherwise
+//pacer (pacer_t) - When the thread may send its packets under the temporal model (-p)
+//replay (const draw_t *) - Headers of the thread's share of the capture replayed with -r, NULL if none
+//replayCount (size_t) - Headers in replay
+//replayNext (size_t) - Next header of replay to hand out
+//lanes (flowLane_t *) - flowLanes lanes for each slot, slot s's lanes start at s * flowLanes
+//cursors (size_t array) - Lane of each slot the next packet of the slot goes to
+//next (size_t) - Next draw of burst to hand out, GEN_BURST once it is used up
+//burst (draw_t array) - Draws generated by the last call to generate_burst()
+//header (header_t) - Header last handed out by next_header()
+typedef struct Generator{
+    unsigned int flowSeed;
+    unsigned int lengthSeed;
+    int skewed;
+    uint32_t threshold[FLOWS_PER_THREAD];
+    uint32_t alias[FLOWS_PER_THREAD];
+    pacer_t pacer;
+    const draw_t *replay;
+    size_t replayCount;
+    size_t replayNext;
+    flowLane_t *lanes;
+    size_t cursors[FLOWS_PER_THREAD];
+    size_t next;
+    draw_t burst[GEN_BURST];
+    header_t header;
+}generator_t;
+
+//Writes the next count headers of the generator into headers, picked by generator_select()
+extern void (*generate_burst)(generator_t *gen, draw_t *headers, size_t count);
+
+//Name of the implementation generate_burst points to ("avx2", "sse4.1", "scalar" or "pcap")
+extern const char *generatorName;
+
+void generator_select();
+void generator_init(generator_t *gen, size_t threadNum);
+void generator_free(generator_t *gen);
+void generate_burst_scalar(generator_t *gen, draw_t *headers, size_t count);
+
+//Turns the 16 bits of a flow draw into a flow with the alias table: the low bits pick a
+//column and the rest decide between the column's flow and its alias. Every flow gets the
+//same table when the model is uniform, which gives GENERATE_FLOW().
+static inline uint32_t pick_flow(const generator_t *gen, uint32_t bits){
+    uint32_t column = bits & FLOWS_PER_THREAD_MOD;
+    return (bits >> FLOWS_PER_THREAD_BITS) < gen->threshold[column] ? column : gen->alias[column];
+}
+
+//Turns the 16 bits of a length draw into a payload length of the size profile
+static inline uint32_t pick_length(uint32_t bits){
+    if(payloadSizes.weighted)
+        return payloadSizes.table[bits >> GEN_LENGTH_SHIFT];
+    return payloadSizes.min + bits % payloadSizes.range;
+}
+
+//Numbers the next packet of a slot into gen->header: the slot's lanes take turns and under
+//churn (-c) a lane whose instance sent its last packet starts the next one, with a new flow
+//id and orders from 0. A capture flow (-r) has a lane of its own, slot id % FLOWS_PER_THREAD
+//of lane id / FLOWS_PER_THREAD. The golden replay (verify.c) numbers its packets with it as well.
+static inline void next_flow(generator_t *gen, uint32_t slot){
+    if(gen->replay != NULL){
+        flowLane_t *lane = &gen->lanes[(slot & FLOWS_PER_THREAD_MOD) * flowLanes + (slot >> FLOWS_PER_THREAD_BITS)];
+        gen->header.flow = lane->flow;
+        gen->header.order = lane->order++;
+        return;
+    }
+
+    size_t cursor = gen->cursors[slot];
+    flowLane_t *lane = &gen->lanes[slot * flowLanes + cursor];
+    gen->cursors[slot] = cursor + 1 == flowLanes ? 0 : cursor + 1;
+    if(lane->order == flow_packets(lane->flow)){
+        lane->flow += flowLanes * FLOW_ID_STRIDE;
+        if(lane->flow >= flowIdWrap)
+            lane->flow -= flowIdWrap;
+        lane->order = 0;
+    }
+    gen->header.flow = lane->flow;
+    gen->header.order = lane->order++;
+}
+
+//Returns the input thread's next header, generating a new burst once the last one is used up.
+//Under a temporal model (-p) it first waits until the packet may be sent, under the open
+//loop one it also stamps the packet with its send time. The flow and order come from
+//next_flow(). Every header handed out has to be sent, in order, for the orders to line up.
+//Example: header_t *header = next_header(&gen); currFlow = header->flow; currOrder = header->order; currLength = header->length;
+static inline header_t * next_header(generator_t *gen){
+    tsc_t due = 0;
+    if(gen->pacer.model != PACE_STEADY)
+        due = pace_packet(&gen->pacer);
+    if(gen->next == GEN_BURST){
+        generate_burst(gen, gen->burst, GEN_BURST);
+        gen->next = 0;
+    }
+
+    next_flow(gen, gen->burst[gen->next].flow);
+    gen->header.length = gen->burst[gen->next++].length;
+
+    if(gen->pacer.model == PACE_OPEN)
+        latency_stamp(gen->header.flow, gen->header.order, due);
+    return &gen->header;
+}
+
+#endif
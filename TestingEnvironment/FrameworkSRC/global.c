@@ -3,30 +3,25 @@
 
 #include<global.h>
 #include<wrapper.h>
+#include<counters.h>
+#include<host.h>
+#include<process.h>
+#include<sys/stat.h>
 
-// Get the current value of the TSC.  This is a rolling 64 bit counter
-// and its frequency varies from across x64 CPU models so we have to
-// calibrate it.
+//In the coroutine simulation these follow the running coroutine instead (sim.c)
+//and with PROCS=1 they are kept in the shared region (process.c)
+#if !defined(COROUTINE_SIM) && !defined(MULTI_PROCESS)
+//Phase counters for the calling thread (see PHASE() in global.h)
+__thread phases_t threadPhases;
 
-#if defined(__i386__)
+//Spin wait counters for the calling thread (see SPIN_WHILE() in global.h)
+__thread spin_t threadSpin;
 
-// Not actually used - most chips are x64 nowadays.
-static inline tsc_t rdtsc(void)
-{
-    register tsc_t x;
-    __asm__ volatile (".byte 0x0f, 0x31" : "=A" (x));
-    return x;
-}
-
-#elif defined(__x86_64__)
-
-static inline tsc_t rdtsc(void)
-{
-    register unsigned hi, lo;
-    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
-    return ( (tsc_t)lo)|( ((tsc_t)hi)<<32 );
-}
+//Event ring for the calling thread (see TRACE() in global.h)
+__thread trace_t threadTrace;
 
+//Stream counters for the calling thread (see VERIFY_PACKET() in global.h)
+__thread verify_t threadVerify;
 #endif
 
 // Set thread properties - specifically the ones that make this a
@@ -36,6 +31,11 @@ static inline tsc_t rdtsc(void)
 // that uses the core we pick.  It also assigns it to one core,
 // so that it doesn't move around and invalidate the L1 cache.
 void set_thread_props(int tgt_core, long sched){
+#ifdef COROUTINE_SIM
+    //Every routine shares the main thread, which runs wherever the OS puts it
+    //and needs no realtime scheduling
+    return;
+#endif
     pthread_t self = pthread_self();
     
     if(sched != (long)NULL){
@@ -59,22 +59,43 @@ void set_thread_props(int tgt_core, long sched){
 }
 
 void sig_alrm(int signo){    
+    windowEnd = rdtsc();
     endFlag = 1;
 
+    //Read the hardware counters and the host state before the threads are told to stop
+    counters_snapshot(COUNTERS_END);
+    host_snapshot(HOST_END);
+
+#if defined(MULTI_PROCESS)
+    //The threads belong to the worker processes, end those instead
+    process_stop();
+#elif !defined(COROUTINE_SIM)
     for(int i = 0; i < inputThreadCount; i++){
         pthread_cancel(input[i].threadID);
     }
     for(int i = 0; i < outputThreadCount; i++){
         pthread_cancel(output[i].threadID);
     }
+#endif
 
     printf("\rTime Remaining:  0 Seconds  ");
     printf("\n\nNote: Your Threads are canceled with pthread_cancel().\nTo modify your thread cleanup handler upon recieving a termination signal, see pthread_cleanup_push()\n\n");
     printf("Finished. Waiting for thread cleanup...\n\n");
 
+    //Take a snapshot of the phase and spin wait counters
+    for(int i = 0; i < inputThreadCount; i++){
+        if(input[i].phases != NULL) input[i].finalPhases = *input[i].phases;
+        if(input[i].spin != NULL) input[i].finalSpin = *input[i].spin;
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        if(output[i].phases != NULL) output[i].finalPhases = *output[i].phases;
+        if(output[i].spin != NULL) output[i].finalSpin = *output[i].spin;
+    }
+
     //Take a snapshot of the count
     for(int i = 0; i < MAX_NUM_OUTPUT_THREADS; i++){
-        finalTotal += output[i].byteCount;
+        output[i].finalCount = output[i].byteCount;
+        finalTotal += output[i].finalCount;
     }
 }
 
@@ -96,6 +117,86 @@ void alarm_init(){
 }
 
 void alarm_start(){
-	alarm(RUNTIME); // set alarm for RUNTIME seconds
+    counters_snapshot(COUNTERS_START); // read the hardware counters at the start of the window
+    host_snapshot(HOST_START); // read interrupts, context switches and core frequencies
+	alarm(runTime); // set alarm for runTime seconds
+    windowStart = rdtsc();
     startFlag = 1; // start moving packets
 }
+
+//Opens a file in RESULTS_DIR for appending, creating the directory if needed.
+//The header is only written when the file is new. Without a header the file is
+//overwritten instead, for outputs that hold a single run.
+FILE * open_results_file(char * fileName, char * header){
+    char path[10000];
+    FILE *fptr;
+
+    if(mkdir(RESULTS_DIR, 0777) < 0 && errno != EEXIST){
+        perror("ERROR: mkdir() failed");
+        exit(1);
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", RESULTS_DIR, fileName);
+    if(header == NULL){
+        fptr = Fopen(path, "w");
+    }
+    else if(access(path, F_OK) != -1){
+        fptr = Fopen(path, "a");
+    }
+    else{
+        fptr = Fopen(path, "a");
+        fprintf(fptr, "%s", header);
+    }
+
+    return fptr;
+}
+
+//Returns the packets of the busiest output thread over the mean of all output threads,
+//1 when the flows are spread evenly and outputThreadCount when one thread passes everything
+double output_imbalance(){
+    size_t busiest = 0;
+
+    if(finalTotal == 0)
+        return 0;
+
+    for(int i = 0; i < outputThreadCount; i++){
+        if(output[i].finalCount > busiest)
+            busiest = output[i].finalCount;
+    }
+
+    return (double)busiest * outputThreadCount / finalTotal;
+}
+
+//Gives a queue BUFFERSIZE empty slots of slotStride bytes in the shared region. Called from
+//run() or init_built_in_queues(), once generator_select() has set the packet layout.
+void queue_init(queue_t *queue){
+    queue->slots = shared_alloc(BUFFERSIZE * slotStride);
+    queue->toRead = 0;
+    queue->toWrite = 0;
+}
+
+//Returns how full a built in queue is. Slots fill up in order from toRead so
+//this only reads as many slots as are occupied, and never writes to the queue.
+double queue_fill(queue_t *queue){
+    size_t index = queue->toRead;
+    size_t used = 0;
+
+    while(used < BUFFERSIZE && QUEUE_SLOT(queue, index)->isOccupied == OCCUPIED){
+        used++;
+        index++;
+        if(index >= BUFFERSIZE)
+            index = 0;
+    }
+
+    return (double)used / BUFFERSIZE;
+}
+
+//Splits the run seed into a seed per input thread and generator stream.
+//Mixing keeps the streams of neighbouring threads unrelated while the same run seed
+//always gives the same seeds, so every algorithm sees the same traffic.
+unsigned int thread_seed(size_t threadNum, int stream){
+    uint64_t x = ((uint64_t)runSeed << 32) ^ (threadNum * 2 + stream + 1) * 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return (unsigned int)(x ^ (x >> 31));
+}
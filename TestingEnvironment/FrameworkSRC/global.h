@@ -28,26 +28,56 @@
 //Buffersize for default queues
 #define BUFFERSIZE 512
 
-//Defines how many seconds an algorithm should run for
+//Defines how many seconds an algorithm should run for by default
+//A run can pick its own length with -t <seconds> (see runTime)
 #define RUNTIME 10
 
-//Used to determine payload size
-#define MIN_PAYLOAD_SIZE 64
-#define MAX_PAYLOAD_SIZE 64
-#define MAX_PAYLOAD_SIZE_MOD (MAX_PAYLOAD_SIZE + 1)
+//Payload lengths a size profile (-l, see generator.c) can pick from, up to jumbo frames
+#define MIN_PAYLOAD_SIZE 1
+#define MAX_PAYLOAD_SIZE 9000
 
-//Size of the packet header without payload
-#define PACKET_HEADER_SIZE 24
+//Size of the packet header without payload, see packet_t. HEADER=compact in options.mk
+//packs it into 12 bytes.
+#ifdef COMPACT_HEADER
+    #define PACKET_HEADER_SIZE 12
+#else
+    #define PACKET_HEADER_SIZE 24
+#endif
 
-//Maximum packet size
-#define MIN_PACKET_SIZE (PACKET_HEADER_SIZE + MIN_PAYLOAD_SIZE)
-#define MAX_PACKET_SIZE (PACKET_HEADER_SIZE + MAX_PAYLOAD_SIZE)
+//Largest packet of the run's size profile, what a packet buffer must have room for
+#define MAX_PACKET_SIZE (PACKET_HEADER_SIZE + maxPayload)
 
 //Number of unique flows that each input thread generates
 //The flows per thread is a power of 2 to allow efficient packet generation
 //NOTE: It must be a power of 2 for packet generation
 #define FLOWS_PER_THREAD 8U
 #define FLOWS_PER_THREAD_MOD (FLOWS_PER_THREAD - 1U)
+#define FLOWS_PER_THREAD_BITS 3U //log2 of FLOWS_PER_THREAD
+
+//Flows across all input threads, input thread t owns flows t * FLOWS_PER_THREAD and up
+#define MAX_FLOWS (MAX_NUM_INPUT_THREADS * FLOWS_PER_THREAD)
+
+//Under flow churn (-c) each of those flows is a slot whose flow ends after some packets and
+//is followed by a new one. Instance g of slot s has the flow id s + g * FLOW_ID_STRIDE. The
+//stride is a multiple of every number up to 16 and of 64, so algorithms that route by
+//flow % n or flow & (n - 1) send every instance of a slot the same way and a slot stays
+//one in order stream for the golden check. Output threads still see a new flow every time.
+//A larger flow space (-n) spreads each slot over flowLanes flows at once the same way: lane l
+//of slot s starts at s + l * FLOW_ID_STRIDE and its instances step by flowLanes strides.
+#define FLOW_ID_STRIDE 2882880UL //64 * 9 * 5 * 7 * 11 * 13
+#define FLOW_SLOT(flow) ((flow) % FLOW_ID_STRIDE)
+
+//Strides a flow id can go up before it no longer fits the header's flow field. A lane whose
+//next instance would pass flowIdWrap starts over from its first id, by then every packet of
+//the instance that had it was passed. Only the 32 bit flow of HEADER=compact gets there,
+//which also keeps -n to 4096 flows per input thread so a lane has two ids to alternate.
+#ifdef COMPACT_HEADER
+    #define FLOW_ID_INSTANCES (UINT32_MAX / FLOW_ID_STRIDE)
+    #define FLOW_MAX_LANES (1UL << 9)
+#else
+    #define FLOW_ID_INSTANCES (SIZE_MAX / FLOW_ID_STRIDE)
+    #define FLOW_MAX_LANES (1UL << 18) //-n goes up to 2M flows per input thread
+#endif
 
 //Indicates whether a packet is there or not
 #define NOT_OCCUPIED 0
@@ -58,14 +88,79 @@
 #define LAST_INDEX (BUFFERSIZE - 1)
 
 //Base suggested core repinning assignments
+//The main thread and the occupancy sampler run on MONITOR_CORE
+#define MONITOR_CORE 0
 #define INPUT_BASE_CORE 2 
 #define OUTPUT_BASE_CORE 11
 
+//Occupancy sampling (build with OCCUPANCY=1)
+//OCCUPANCY_HZ - highest rate the queues are sampled at
+//MAX_QUEUES - most queues an algorithm can report
+//OCCUPANCY_BINS - histogram bins, each 10% wide with the last one for full queues
+//HEATMAP_MS - length of the time buckets in the heatmap
+#ifndef OCCUPANCY_HZ
+    #define OCCUPANCY_HZ 10000
+#endif
+#define MAX_QUEUES (MAX_NUM_INPUT_THREADS * MAX_NUM_OUTPUT_THREADS)
+#define OCCUPANCY_BINS 11
+#define HEATMAP_MS 10
+
+//Host noise limits, a run is flagged when a pinned core or worker thread goes past them
+//NOISE_FREQ_DROP - lowest frequency allowed as a share of the fastest pinned core
+//NOISE_IRQ_RATE - interrupts per second allowed on a pinned core
+//NOISE_SWITCH_RATE - context switches per second allowed for a worker thread
+#define NOISE_FREQ_DROP 0.9
+#define NOISE_IRQ_RATE 2000
+#define NOISE_SWITCH_RATE 10
+
 //Define a memory fence that tells the compiler to not reorder instructions
 //In order to make sure writes are in order
 #define FENCE() \
    __asm__ volatile ("mfence" ::: "memory");
 
+//Directory that per thread and per run result files are written to
+#define RESULTS_DIR "Results"
+
+//Results store in RESULTS_DIR, one JSON record with its metadata per run (see results.c)
+#define RUNS_FILE "runs.jsonl"
+
+//Indices of the hardware counters opened on every worker thread (see counters.c)
+#define CTR_CYCLES 0
+#define CTR_INSTRUCTIONS 1
+#define CTR_L1D_MISSES 2
+#define CTR_LLC_MISSES 3
+#define CTR_DTLB_MISSES 4
+#define CTR_BRANCH_MISSES 5
+#define NUM_COUNTERS 6
+
+//Size of a perf_event group read: count, time enabled, time running, then the values
+#define COUNTERS_READ_SIZE (3 + NUM_COUNTERS)
+
+//Phases of the input and output loops used for cycle accounting (see PHASE() below)
+//Input threads:  GENERATE - making the packet header
+//                IDLE     - holding packets back under the temporal traffic model (pacer.c)
+//                STAGE    - writing headers and publishing slots or local buffers
+//                WAIT     - spinning for space in shared memory
+//                COPY     - copying payloads or vectors into shared memory
+//Output threads: WAIT     - spinning or polling for a packet or vector
+//                COPY     - copying payloads or vectors out of shared memory
+//                PARSE    - reading headers, releasing slots and moving to the next packet
+//                VERIFY   - checking order and counting what was passed
+#define PHASE_GENERATE 0
+#define PHASE_STAGE 1
+#define PHASE_WAIT 2
+#define PHASE_COPY 3
+#define PHASE_PARSE 4
+#define PHASE_VERIFY 5
+#define PHASE_IDLE 6
+#define NUM_PHASES 7
+
+//Bottleneck classification from spin waits. A run is producer-bound when output threads
+//wait at least BOUND_RATIO times as long as input threads do (and the reverse for
+//consumer-bound), provided the waiting side spends at least BOUND_MIN_WAIT of the window waiting
+#define BOUND_RATIO 2.0
+#define BOUND_MIN_WAIT 0.05
+
 #if defined (__linux__)
     #define SUPPORTED_PLATFORM 1
 #else 
@@ -78,17 +173,434 @@ typedef void* (*function)(void * args);
 //Used for reading the time stamp counter
 typedef unsigned long long tsc_t;
 
+// Get the current value of the TSC.  This is a rolling 64 bit counter
+// and its frequency varies from across x64 CPU models so we have to
+// calibrate it.
+
+#if defined(__i386__)
+
+// Not actually used - most chips are x64 nowadays.
+static inline tsc_t rdtsc(void)
+{
+    register tsc_t x;
+    __asm__ volatile (".byte 0x0f, 0x31" : "=A" (x));
+    return x;
+}
+
+#elif defined(__x86_64__)
+
+static inline tsc_t rdtsc(void)
+{
+    register unsigned hi, lo;
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ( (tsc_t)lo)|( ((tsc_t)hi)<<32 );
+}
+
+#endif
+
+//Cycles a thread spent in each phase of its loop
+//mark (tsc_t) - TSC value when the last phase ended
+//cycles (tsc_t array) - Cycles charged to each phase, indexed by the PHASE_* defines
+typedef struct Phases{
+    tsc_t mark;
+    tsc_t cycles[NUM_PHASES];
+}phases_t;
+
+//Phase counters for the calling thread. Thread local so charging a phase never
+//touches a cache line another thread writes.
+extern __thread phases_t threadPhases;
+
+//Cycle accounting for the input and output loops. Build with PHASES=1 to enable,
+//otherwise these compile to nothing.
+//PHASE_MARK() starts timing. PHASE(name) charges the cycles since the last mark to
+//the named phase and marks again, so back to back phases cost one rdtsc each.
+//Example: PHASE_MARK(); while(1){ ...generate...; PHASE(GENERATE); ...copy...; PHASE(COPY); }
+#ifdef PHASE_TIMING
+    #define PHASE_MARK() (threadPhases.mark = rdtsc())
+    #define PHASE(name) do{ \
+        tsc_t phaseNow = rdtsc(); \
+        threadPhases.cycles[PHASE_##name] += phaseNow - threadPhases.mark; \
+        threadPhases.mark = phaseNow; \
+    }while(0)
+#else
+    #define PHASE_MARK()
+    #define PHASE(name)
+#endif
+
+//Event trace (build with TRACE=1)
+//Each thread records events into its own ring as single 64 bit words: the TSC value
+//shifted up by TRACE_EVENT_BITS with the event id in the low bits. Recording is one
+//store, and stops when the timed window ends so the ring holds the last events of the run.
+#ifndef TRACE_RING_SIZE
+    #define TRACE_RING_SIZE (1 << 18)
+#endif
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+#define TRACE_EVENT_BITS 8
+#define TRACE_EVENT_MASK ((1 << TRACE_EVENT_BITS) - 1)
+
+//Events that can be recorded, begin events must be one less than their end event
+//TRACE_WAIT_BEGIN/END - the thread is spinning for space or data (SPIN_WHILE()/SPIN_MISS())
+//TRACE_ACQUIRE/RELEASE - the thread holds a shared slot: from finding it free/full to handing it back
+//TRACE_FLUSH - an input thread copied a full local vector into shared memory
+//TRACE_FLIP - the thread moved on to the next segment of a shared queue
+//TRACE_IDLE_BEGIN/END - an input thread is holding its next packet back for the temporal model
+#define TRACE_WAIT_BEGIN 1
+#define TRACE_WAIT_END 2
+#define TRACE_ACQUIRE 3
+#define TRACE_RELEASE 4
+#define TRACE_FLUSH 5
+#define TRACE_FLIP 6
+#define TRACE_IDLE_BEGIN 7
+#define TRACE_IDLE_END 8
+
+//events (tsc_t *) - ring of TRACE_RING_SIZE encoded events
+//index (size_t) - number of events recorded, the next one goes to index & TRACE_RING_MASK
+typedef struct Trace{
+    tsc_t *events;
+    size_t index;
+}trace_t;
+
+//Event ring for the calling thread
+extern __thread trace_t threadTrace;
+
+#ifdef EVENT_TRACE
+    #define TRACE(event) do{ \
+        if(!endFlag) \
+            threadTrace.events[threadTrace.index++ & TRACE_RING_MASK] = (rdtsc() << TRACE_EVENT_BITS) | (event); \
+    }while(0)
+#else
+    #define TRACE(event)
+#endif
+
+//Time a thread spent spinning for space (input threads) or for data (output threads)
+//pollStart (tsc_t) - TSC value when a run of empty polls started, 0 if the thread isn't polling
+//waits (size_t) - Number of times the thread had to wait
+//iterations (size_t) - Number of spin iterations and empty polls
+//cycles (tsc_t) - TSC cycles spent waiting
+//untimedPolls (size_t) - Number of empty polls that weren't timed (built without SPIN=1)
+typedef struct Spin{
+    tsc_t pollStart;
+    size_t waits;
+    size_t iterations;
+    tsc_t cycles;
+    size_t untimedPolls;
+}spin_t;
+
+//Spin wait counters for the calling thread
+extern __thread spin_t threadSpin;
+
+//Keeps the compiler from hoisting the loads out of a spin loop
+#define SPIN_BARRIER() __asm__ volatile ("" ::: "memory")
+
+//Spins until cond is false and charges the wait to the calling thread.
+//Use in place of while(cond); - when cond is already false it costs the same as the bare check.
+#define SPIN_WHILE(cond) do{ \
+    if(cond){ \
+        TRACE(TRACE_WAIT_BEGIN); \
+        tsc_t spinStart = rdtsc(); \
+        size_t spins = 0; \
+        do{ \
+            spins++; \
+            SPIN_BARRIER(); \
+            SIM_YIELD(); \
+        }while(cond); \
+        threadSpin.cycles += rdtsc() - spinStart; \
+        threadSpin.iterations += spins; \
+        threadSpin.waits++; \
+        TRACE(TRACE_WAIT_END); \
+    } \
+}while(0)
+
+//For loops that poll several queues instead of spinning on one.
+//Call SPIN_MISS() every time a poll comes up empty and SPIN_HIT() when one finds work.
+//The wait runs from the first empty poll to the next hit. SPIN_HIT() runs for every packet,
+//so the polls are only timed when built with SPIN=1 (options.mk). Otherwise an empty poll
+//is only counted, which tells spin_classify() (counters.c) that the waits of that side are unknown.
+#ifdef SPIN_POLL_TIMING
+#define SPIN_MISS() do{ \
+    if(threadSpin.pollStart == 0){ \
+        TRACE(TRACE_WAIT_BEGIN); \
+        threadSpin.pollStart = rdtsc(); \
+    } \
+    threadSpin.iterations++; \
+    SPIN_BARRIER(); \
+    SIM_YIELD(); \
+}while(0)
+
+#define SPIN_HIT() do{ \
+    if(threadSpin.pollStart != 0){ \
+        threadSpin.cycles += rdtsc() - threadSpin.pollStart; \
+        threadSpin.pollStart = 0; \
+        threadSpin.waits++; \
+        TRACE(TRACE_WAIT_END); \
+    } \
+}while(0)
+#else
+#define SPIN_MISS() do{ \
+    threadSpin.untimedPolls++; \
+    SPIN_BARRIER(); \
+    SIM_YIELD(); \
+}while(0)
+
+#define SPIN_HIT() do{ }while(0)
+#endif
+
+//Packet generator shared by every algorithm and the golden stream replay (verify.c).
+//Each input thread runs two LCGs, one picks which of its flows the next packet belongs
+//to and the other its payload length. Seed them with thread_seed(threadNum, FLOW_STREAM)
+//and thread_seed(threadNum, LENGTH_STREAM) so the same run seed gives the same traffic.
+//Algorithms take their headers in bursts from generator.h, which gives the same packets.
+#define FLOW_STREAM 0
+#define LENGTH_STREAM 1
+#define NEXT_SEED(seed) ((seed) = 214013 * (seed) + 2531011)
+
+//Advance the seed and return the thread's next flow (0 to FLOWS_PER_THREAD - 1) when every
+//flow is equally popular, generator.h applies the flow model picked with -f on top
+#define GENERATE_FLOW(seed) (NEXT_SEED(seed), ((seed) >> 16) & FLOWS_PER_THREAD_MOD)
+
+//Advance the seed and return the next payload length of the size profile picked with -l,
+//pick_length() is in generator.h
+#define GENERATE_LENGTH(seed) (NEXT_SEED(seed), pick_length((seed) >> 16))
+
+//Flow churn (-c <packets>) and flow space (-n <flows per input thread>)
+//churnPackets (size_t) - Mean packets of a flow instance, 0 if flows never end
+//churnSalt (uint64_t) - Mixed into the flow ids so the lifetimes change with the run seed
+//flowLanes (size_t) - Flows each slot sends to at once, taking turns, 1 unless -n is given
+//flowIdWrap (size_t) - Whole rounds of a slot's lanes that fit in FLOW_ID_INSTANCES strides, in flow id units
+size_t churnPackets;
+uint64_t churnSalt;
+size_t flowLanes;
+size_t flowIdWrap;
+
+//Packets the flow instance sends before it ends, 1 to 2 * churnPackets - 1 with every count
+//equally likely. A function of the flow id, so the input thread, the output thread that
+//drops the flow's state and the golden replay all agree on it without sharing anything.
+static inline size_t flow_packets(size_t flow){
+    if(churnPackets == 0)
+        return SIZE_MAX;
+    uint64_t hash = (flow ^ churnSalt) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+    return 1 + (((hash & 0xFFFFFFFFULL) * (2 * churnPackets - 1)) >> 32);
+}
+
+//Latency of the open loop pattern (-p open, see pacer.c and latency.c)
+//Input threads stamp every packet with the TSC value it was scheduled for, in a ring per
+//flow slot indexed by the packet's sequence. Output threads look the stamp up when they pass the
+//packet, so a packet held up behind a full queue still counts from when it was due.
+//Latencies go into a log-linear histogram of TSC ticks: exact below LATENCY_SUB_COUNT,
+//then LATENCY_SUB_COUNT buckets per power of two (6% wide)
+#define LATENCY_RING 16384 //Stamps kept per flow slot, a power of two
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_COUNT (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+#define LATENCY_NO_ORDER (~(uint64_t)0)
+
+//Send time of one packet
+//order (uint64_t) - Sequence of the packet in its slot (latency_sequence()), LATENCY_NO_ORDER while it is being written
+//due (tsc_t) - TSC value the open loop schedule sent the packet at
+typedef struct Stamp{
+    volatile uint64_t order;
+    volatile tsc_t due;
+}stamp_t;
+
+//LATENCY_RING stamps for each flow, NULL unless the pattern is open loop
+stamp_t *latencyStamps;
+
+//Packets each output thread passed per flow slot, checked against the golden stream after the run
+//counts (size_t array) - Packets of each slot passed in the timed window
+//sums (uint64_t array) - Rolling checksum of each slot's (flow, order, length) stream
+//latency (uint64_t array) - Packets by latency bucket, open loop pattern only
+//unstamped (size_t) - Packets whose stamp was overwritten before they were passed
+//flowsStarted (size_t) - Flows added to the thread's flow table (flowtable.h) in the timed window
+//flowsFinished (size_t) - Flows dropped from it after their last packet in the timed window
+//flowsPeak (size_t) - Most flows the table held at once
+//flowProbe (const char *) - Bucket compare the thread's flow_lookup() was compiled with, NULL without a flow table
+//flowPrefetch (int) - 1 if the thread's algorithm was compiled with PREFETCH=1
+//payloadPackets (size_t) - Payloads filled (input threads) or checked (output threads) with -d in the timed window
+//payloadBytes (size_t) - Bytes of those payloads
+//payloadTicks (uint64_t) - TSC ticks spent filling or checking them
+//payloadErrors (size_t) - Payloads whose CRC32C didn't match, output threads only
+typedef struct Verify{
+    size_t counts[MAX_FLOWS];
+    uint64_t sums[MAX_FLOWS];
+    uint64_t latency[LATENCY_BUCKETS];
+    size_t unstamped;
+    size_t flowsStarted;
+    size_t flowsFinished;
+    size_t flowsPeak;
+    const char *flowProbe;
+    int flowPrefetch;
+    size_t payloadPackets;
+    size_t payloadBytes;
+    uint64_t payloadTicks;
+    size_t payloadErrors;
+}verify_t;
+
+//Stream counters for the calling thread
+extern __thread verify_t threadVerify;
+
+//splitmix64 finalizer, every bit of x reaches every bit of the result
+static inline uint64_t stream_mix(uint64_t x){
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+//One step of the rolling checksum, the golden replay computes the same steps. The multiply
+//only carries bits upward, so the packet is mixed first: the flow on its own so none of its
+//bits are shifted out, then with the order and length, and every bit of the sum depends on all three.
+static inline uint64_t stream_step(uint64_t sum, size_t flow, size_t order, size_t length){
+    uint64_t word = stream_mix(stream_mix(flow) ^ ((uint64_t)order << 16) ^ length);
+    return (sum ^ word) * 0x100000001B3ULL;
+}
+
+//Histogram bucket of a latency in TSC ticks
+static inline size_t latency_bucket(tsc_t ticks){
+    if(ticks < LATENCY_SUB_COUNT)
+        return ticks;
+    int exponent = 63 - __builtin_clzll(ticks);
+    return ((exponent - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + ((ticks >> (exponent - LATENCY_SUB_BITS)) & (LATENCY_SUB_COUNT - 1));
+}
+
+//Position of a packet in its slot's stamp ring. Instances of a slot follow each other in
+//the ring, each with room for its longest possible lifetime. The lanes of a slot (-n) take
+//turns, so without churn the slot's packets get consecutive positions.
+static inline uint64_t latency_sequence(size_t flow, size_t order){
+    uint64_t instance = flow / FLOW_ID_STRIDE;
+    if(flowLanes == 1)
+        return order + instance * 2 * churnPackets;
+    return (order + (instance / flowLanes) * 2 * churnPackets) * flowLanes + instance % flowLanes;
+}
+
+//Counts the latency of a packet from its stamp. The sequence is read on both sides of the
+//send time, the input thread clears it while it rewrites the stamp.
+static inline void latency_record(verify_t *verify, size_t flow, size_t order){
+    uint64_t sequence = latency_sequence(flow, order);
+    stamp_t *stamp = &latencyStamps[FLOW_SLOT(flow) * LATENCY_RING + (sequence & (LATENCY_RING - 1))];
+    tsc_t now = rdtsc();
+    uint64_t before = stamp->order;
+    tsc_t due = stamp->due;
+    if(before != sequence || stamp->order != sequence){
+        verify->unstamped++;
+        return;
+    }
+    verify->latency[latency_bucket(now > due ? now - due : 0)]++;
+}
+
+//Output threads call this for every packet they pass, flow is the global flow id.
+//The checksum is stored before the count so a run can be checked while threads still pass.
+#define VERIFY_PACKET(flow, order, length) do{ \
+    if(!endFlag){ \
+        size_t verifySlot = FLOW_SLOT(flow); \
+        threadVerify.sums[verifySlot] = stream_step(threadVerify.sums[verifySlot], flow, order, length); \
+        SPIN_BARRIER(); \
+        threadVerify.counts[verifySlot]++; \
+        if(latencyStamps != NULL) \
+            latency_record(&threadVerify, flow, order); \
+    } \
+}while(0)
+
+//Payload check (-d, see payload.c)
+//Input threads fill every payload from the seed, the flow and the order and end it with a
+//CRC32C of the rest. Output threads check it on the bytes they copied out, so a copy that
+//was skipped, cut short or read from the wrong packet is caught. Without -d both do nothing.
+int payloadCheck;
+void payload_fill(unsigned char *payload, size_t flow, size_t order, size_t length);
+void payload_check(const unsigned char *payload, size_t flow, size_t order, size_t length);
+
+//Input threads call this for every packet's payload before it is copied into the queue
+#define FILL_PAYLOAD(payload, flow, order, length) do{ \
+    if(payloadCheck) \
+        payload_fill(payload, flow, order, length); \
+}while(0)
+
+//Output threads call this on the payload they copied out of the queue
+#define CHECK_PAYLOAD(payload, flow, order, length) do{ \
+    if(payloadCheck) \
+        payload_check(payload, flow, order, length); \
+}while(0)
+
+//Threads wait here until the framework starts the timed window
+#define WAIT_FOR_START() do{ \
+    while(startFlag == 0){ \
+        SIM_YIELD(); \
+    } \
+}while(0)
+
+//Per thread state the framework reads after the window (threadPhases, threadSpin,
+//threadTrace and threadVerify) is thread local, except in two builds where the names
+//are redirected through workerState:
+//Coroutine simulation (build with SIM=1)
+//Every input and output routine runs as a coroutine on the main thread (sim.c) and
+//SIM_YIELD() switches to the next one wherever a thread would spin. The state then has
+//to follow the running coroutine instead of the thread.
+//Multi-process mode (build with PROCS=1)
+//Input and output threads run in processes of their own (process.c). The state is kept
+//in the thread's io_t in the shared region so the main process can read it.
+#if defined(COROUTINE_SIM) && defined(MULTI_PROCESS)
+    #error "SIM=1 and PROCS=1 can't be combined"
+#endif
+
+#if defined(COROUTINE_SIM) || defined(MULTI_PROCESS)
+    typedef struct WorkerState{
+        phases_t *phases;
+        spin_t *spin;
+        trace_t *trace;
+        verify_t *verify;
+    }workerState_t;
+
+    #ifdef COROUTINE_SIM
+        extern workerState_t workerState;
+    #else
+        extern __thread workerState_t workerState;
+    #endif
+    #define threadPhases (*workerState.phases)
+    #define threadSpin (*workerState.spin)
+    #define threadTrace (*workerState.trace)
+    #define threadVerify (*workerState.verify)
+#endif
+
+#ifdef COROUTINE_SIM
+    void sim_yield();
+    #define SIM_YIELD() sim_yield()
+#else
+    #define SIM_YIELD()
+#endif
+
 //Data structure to represent a packet.
 //length (size_t) - The total size of the data memeber for the packet
 //flow (size_t) - The flow of the packet
 //order (size_t) - The order of the packet within its flow
-//data (unsigned char array) - Payload of the packet
+//payload (unsigned char array) - Payload of the packet, length bytes follow the header
+//The payload is variable length, so packets are kept in slots sized for the largest payload
+//of the run's size profile: step through an array of them with PACKET_AT() and hold one on
+//the stack in a packetBuffer_t.
+//HEADER=compact packs the header into 12 bytes the way a production descriptor would: a 32 bit
+//flow, a 48 bit order and a 16 bit length. The fields read and assign the same, print them
+//cast to size_t. Packed, since the byte buffers of Algorithm 6 to 9 put packets anywhere.
+#ifdef COMPACT_HEADER
+typedef struct __attribute__((packed)) Packet{
+    uint64_t flow : 32;
+    uint64_t order : 48;
+    uint64_t length : 16;
+    unsigned char payload[];
+}packet_t;
+#else
 typedef struct Packet{
     size_t flow; 
     size_t length;
     size_t order;
-    unsigned char payload[MAX_PAYLOAD_SIZE];
+    unsigned char payload[];
 }packet_t;
+#endif
+
+//Room for a packet of any payload length
+typedef union PacketBuffer{
+    packet_t packet;
+    unsigned char bytes[PACKET_HEADER_SIZE + MAX_PAYLOAD_SIZE];
+}packetBuffer_t;
 
 //Data field for the queue
 typedef struct Data{
@@ -99,14 +611,18 @@ typedef struct Data{
 //Data structure for Queue:
 //toRead (size_t) - The next unread position in the queue
 //toWrite (size_t) - The next position to write to in the queue
-//count (size_t) - The number of packets read by the queue
-//data (packet_t array) - Space for packets in the queue
+//slots (unsigned char *) - Space for BUFFERSIZE data_t slots of slotStride bytes in the
+//                          shared region, set up by queue_init(), use QUEUE_SLOT()
 typedef struct Queue {
     size_t toRead;
     size_t toWrite;
-    data_t data[BUFFERSIZE];
+    unsigned char *slots;
 }queue_t;
 
+//Packet index of an array of packet slots, and slot index of a queue
+#define PACKET_AT(base, index) ((packet_t *)((unsigned char *)(base) + (size_t)(index) * packetStride))
+#define QUEUE_SLOT(queue, index) ((data_t *)((queue)->slots + (size_t)(index) * slotStride))
+
 //Arguments to be passed to input threads
 //queue (*queue_t) - pointer to the first queue for the thread to write to/process
 //coreNum (size_t) - used to define which core the processing queue should be assigned to
@@ -117,33 +633,128 @@ typedef struct threadArgs{
     size_t threadNum;
 }threadArgs_t;
 
+//Hardware counters for a single worker thread
+//groupFd (int) - perf_event group leader, -1 if the counters could not be opened
+//error (int) - errno from opening the group leader
+//fds (int array) - File descriptor for each counter, -1 if the counter is unsupported
+//slot (int array) - Position of each counter in a group read, -1 if the counter is unsupported
+//start (unsigned long long array) - Raw group read at the start of the timed window
+//end (unsigned long long array) - Raw group read at the end of the timed window
+typedef struct Counters{
+    int groupFd;
+    int error;
+    int fds[NUM_COUNTERS];
+    int slot[NUM_COUNTERS];
+    unsigned long long start[COUNTERS_READ_SIZE];
+    unsigned long long end[COUNTERS_READ_SIZE];
+}counters_t;
+
 //threadID (pthread_t) - The Id for the thread
 //threadArgs (threadArgs_t) - Arguments to be passed to input/output threads
+//routine (function) - The algorithm's input or output method the thread runs
 //queue (queue_t) - built in queues for passing
 //readyFlag (size_t) - Flag signaling thead is ready
 //byteCount (size_t) - amount of data passed
+//finalCount (size_t) - snapshot of byteCount at the end of the timed window
+//counters (counters_t) - hardware performance counters for the thread
+//phases (phases_t *) - the thread's phase counters (threadPhases)
+//finalPhases (phases_t) - snapshot of the phase counters at the end of the timed window
+//spin (spin_t *) - the thread's spin wait counters (threadSpin)
+//finalSpin (spin_t) - snapshot of the spin wait counters at the end of the timed window
+//trace (trace_t *) - the thread's event ring (threadTrace)
+//tid (pid_t) - kernel thread id, used to read the thread's context switches
+//verify (verify_t *) - the thread's stream counters (threadVerify)
+//phasesState, spinState, traceState, verifyState - storage for the thread's state in the
+//shared region, PROCS=1 only (see workerState above)
 typedef struct io{
     threadArgs_t threadArgs;
     pthread_t threadID;
+    function routine;
     queue_t queue;
     size_t readyFlag;
     size_t byteCount;
+    size_t finalCount;
+    counters_t counters;
+    phases_t *phases;
+    phases_t finalPhases;
+    spin_t *spin;
+    spin_t finalSpin;
+    trace_t *trace;
+    pid_t tid;
+    verify_t *verify;
+#ifdef MULTI_PROCESS
+    phases_t phasesState;
+    spin_t spinState;
+    trace_t traceState;
+    verify_t verifyState;
+#endif
     size_t padding[8];
 }io_t;
 
 //initialize array of input and ouput threads
+//With PROCS=1 they are in the shared region instead, see process_init()
+#ifdef MULTI_PROCESS
+io_t *input;
+io_t *output;
+#else
 io_t input[MAX_NUM_INPUT_THREADS];
 io_t output[MAX_NUM_OUTPUT_THREADS];
+#endif
 
 //Used for number of input and output threads
 size_t inputThreadCount;
 size_t outputThreadCount;
 
+#ifdef MULTI_PROCESS
+//start (int) - startFlag, end (int) - endFlag
+//Kept in the shared region so the worker processes see the main process set them
+typedef struct Control{
+    volatile int start;
+    volatile int end;
+}control_t;
+
+control_t *control;
+#define startFlag (control->start)
+#define endFlag (control->end)
+#else
 //flag used to start moving packets - used by alarm functions
-int startFlag;
+//volatile so optimized builds reload it in the threads' start loops
+volatile int startFlag;
 
 //flag used to end algorithm - used by alarm functions
-int endFlag; 
+volatile int endFlag; 
+#endif
+
+//Length of the timed window in seconds, RUNTIME unless set with -t
+int runTime;
+
+//Seed the traffic of every input thread is derived from, set with -s
+unsigned int runSeed;
+
+//How popular each flow of an input thread is, set with -f (see generator.c)
+char *flowModel;
+
+//When input threads send their packets, set with -p (see pacer.c)
+char *trafficPattern;
+
+//Capture the input threads replay instead of generating traffic, set with -r (see pcap.c)
+char *replayFile;
+
+//Payload lengths the input threads generate, set with -l (see generator.c)
+char *sizeProfile;
+
+//Packet layout of the run, set by generator_select() before run() allocates any queue
+//maxPayload (size_t) - Largest payload of the size profile or capture
+//packetStride (size_t) - Bytes a packet slot takes, header and maxPayload rounded up to 8
+//slotStride (size_t) - Bytes a queue slot (data_t) takes, rounded up to 8
+//avgPacketSize (double) - Mean packet size (header and payload), converts byte counts into packet counts
+size_t maxPayload;
+size_t packetStride;
+size_t slotStride;
+double avgPacketSize;
+
+//Share of the bytes passed that is payload, converts throughput on the wire into goodput
+#define PAYLOAD_SHARE ((avgPacketSize - PACKET_HEADER_SIZE) / avgPacketSize)
 
 //Total to be used for calculating packets passed
 size_t finalTotal;
@@ -151,10 +762,25 @@ size_t finalTotal;
 //Used to store total overhead for generating packets
 size_t overheadTotal;
 
+//TSC values at the start and end of the timed window
+tsc_t windowStart;
+tsc_t windowEnd;
+
 void set_thread_props(int tgt_core, long sched);
 void sig_alrm(int signo);
 void alarm_init();
 void alarm_start();
+FILE * open_results_file(char * fileName, char * header);
+void queue_init(queue_t *queue);
+double queue_fill(queue_t *queue);
+double output_imbalance();
+unsigned int thread_seed(size_t threadNum, int stream);
+
+//Allocates zeroed memory for state the input and output threads share, such as the
+//algorithm's queues (process.c). Algorithms allocate it from run(), PROCS=1 builds then
+//place it where the input and output processes both map it. Keep positions in it as
+//offsets rather than pointers so the layout doesn't depend on where it is mapped.
+void * shared_alloc(size_t size);
 
 void * input_thread(void * args);
 void * output_thread(void * args);
@@ -163,4 +789,9 @@ function get_input_thread();
 function get_output_thread();
 pthread_t * run(void * args);
 
+//Optional: writes the fill level (0 to 1) of every queue the algorithm uses into fill
+//and returns how many queues there are. Called by the occupancy sampler from the
+//monitor core while the algorithm runs, so it must only read the queues.
+size_t queue_occupancy(double *fill) __attribute__((weak));
+
 #endif
\ No newline at end of file
@@ -0,0 +1,421 @@
+//Host noise sampling
+//Records what the rest of the machine did to the pinned cores during the timed window:
+//their frequency (scaling_cur_freq, sampled once a second by monitor_threads()), the
+//interrupts they took (/proc/interrupts) and the context switches of every worker thread
+//(/proc/<tid>/status). The end snapshot is taken from sig_alrm() so it only
+//copies the files with open() and read(), everything is parsed after the run.
+//Runs that cross the NOISE_* limits in global.h are flagged in the result row.
+//Energy is read from the powercap RAPL counters (package and DRAM domains) at the same
+//window boundaries. Hosts without powercap, or where the counters are only readable by
+//root, simply report no energy.
+
+#include<global.h>
+#include<wrapper.h>
+#include<host.h>
+#include<fcntl.h>
+#include<dirent.h>
+
+//Room for /proc/interrupts on machines with a few hundred cores
+#define INTERRUPTS_SIZE (1 << 20)
+#define STATUS_SIZE 4096
+#define MAX_CPUS 4096
+#define POWERCAP_DIR "/sys/class/powercap"
+#define MAX_DOMAINS 16
+
+static char interrupts[2][INTERRUPTS_SIZE];
+static char inputStatus[MAX_NUM_INPUT_THREADS][2][STATUS_SIZE];
+static char outputStatus[MAX_NUM_OUTPUT_THREADS][2][STATUS_SIZE];
+
+//Frequency samples for every core, in kHz
+static long long freqMin[MAX_CPUS];
+static long long freqMax[MAX_CPUS];
+static long long freqSum[MAX_CPUS];
+static size_t freqCount[MAX_CPUS];
+
+//RAPL domains found when the window starts
+//path (char array) - energy_uj file of the domain
+//name (char array) - domain name, package-N or dram
+//range (long long) - value energy_uj wraps around at, in microjoules
+//energy (long long array) - energy_uj at the start and end of the window
+typedef struct Domain{
+    char path[320];
+    char name[64];
+    long long range;
+    long long energy[2];
+}domain_t;
+
+static domain_t domains[MAX_DOMAINS];
+static int domainCount = -1;
+
+//Per thread figures worked out by host_check()
+static long long inputSwitches[MAX_NUM_INPUT_THREADS];
+static long long outputSwitches[MAX_NUM_OUTPUT_THREADS];
+
+//Reads a whole file into buf and null terminates it.
+//Only uses async signal safe calls. Leaves buf empty if the file can't be read.
+static void read_file(const char *path, char *buf, size_t size){
+    ssize_t total = 0;
+    ssize_t bytes;
+    int fd = open(path, O_RDONLY);
+
+    buf[0] = '\0';
+    if(fd < 0)
+        return;
+
+    while(total < (ssize_t)size - 1 && (bytes = read(fd, buf + total, size - 1 - total)) > 0){
+        total += bytes;
+    }
+    buf[total] = '\0';
+    close(fd);
+}
+
+//Writes "/proc/<tid>/status" into path without stdio so it can run in sig_alrm().
+//Not under /proc/self so it also finds the threads of the PROCS=1 worker processes.
+static void status_path(pid_t tid, char *path){
+    char digits[16];
+    int count = 0;
+    char *out = path;
+
+    do{
+        digits[count++] = '0' + tid % 10;
+        tid /= 10;
+    }while(tid > 0);
+
+    for(const char *prefix = "/proc/"; *prefix; prefix++) *out++ = *prefix;
+    while(count > 0) *out++ = digits[--count];
+    for(const char *suffix = "/status"; *suffix; suffix++) *out++ = *suffix;
+    *out = '\0';
+}
+
+//Records the current frequency of one core
+static void sample_core(size_t core){
+    char path[128];
+    char buf[64];
+
+    if(core >= MAX_CPUS)
+        return;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%lu/cpufreq/scaling_cur_freq", core);
+    read_file(path, buf, sizeof(buf));
+    if(buf[0] == '\0')
+        return;
+
+    long long kHz = atoll(buf);
+    if(freqCount[core] == 0 || kHz < freqMin[core]) freqMin[core] = kHz;
+    if(freqCount[core] == 0 || kHz > freqMax[core]) freqMax[core] = kHz;
+    freqSum[core] += kHz;
+    freqCount[core]++;
+}
+
+//Samples the frequency of every pinned core, called once a second during the window
+void host_sample(){
+    for(int i = 0; i < inputThreadCount; i++){
+        sample_core(input[i].threadArgs.coreNum);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        sample_core(output[i].threadArgs.coreNum);
+    }
+}
+
+//Reads the first number in a file, -1 if it can't be read
+static long long read_number(const char *path){
+    char buf[64];
+
+    read_file(path, buf, sizeof(buf));
+    if(buf[0] < '0' || buf[0] > '9')
+        return -1;
+    return atoll(buf);
+}
+
+//Finds the RAPL package and DRAM domains that can be read.
+//core, uncore and psys are skipped since they overlap the package domains.
+static void find_domains(){
+    char path[512];
+    char name[64];
+    struct dirent *entry;
+    DIR *dir = opendir(POWERCAP_DIR);
+
+    domainCount = 0;
+    if(dir == NULL)
+        return;
+
+    while((entry = readdir(dir)) != NULL && domainCount < MAX_DOMAINS){
+        //Zones are named <control type>:<package>[:<subzone>], the control type itself has no counter
+        if(strchr(entry->d_name, ':') == NULL)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s/name", POWERCAP_DIR, entry->d_name);
+        read_file(path, name, sizeof(name));
+        name[strcspn(name, "\n")] = '\0';
+        if(strncmp(name, "package", 7) != 0 && strcmp(name, "dram") != 0)
+            continue;
+
+        domain_t *domain = &domains[domainCount];
+        snprintf(domain->path, sizeof(domain->path), "%s/%s/energy_uj", POWERCAP_DIR, entry->d_name);
+        if(read_number(domain->path) < 0)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s/max_energy_range_uj", POWERCAP_DIR, entry->d_name);
+        domain->range = read_number(path);
+        snprintf(domain->name, sizeof(domain->name), "%s", name);
+        domainCount++;
+    }
+
+    closedir(dir);
+}
+
+//Copies /proc/interrupts and the status of every worker thread at the start or end of the window
+void host_snapshot(int which){
+    char path[64];
+
+    read_file("/proc/interrupts", interrupts[which], INTERRUPTS_SIZE);
+
+    for(int i = 0; i < inputThreadCount; i++){
+        status_path(input[i].tid, path);
+        read_file(path, inputStatus[i][which], STATUS_SIZE);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        status_path(output[i].tid, path);
+        read_file(path, outputStatus[i][which], STATUS_SIZE);
+    }
+
+    //The start snapshot is outside the signal handler so it can look for the RAPL
+    //domains and sample frequencies too
+    if(which == HOST_START){
+        find_domains();
+        host_sample();
+    }
+
+    for(int d = 0; d < domainCount; d++){
+        domains[d].energy[which] = read_number(domains[d].path);
+    }
+}
+
+//Adds up every interrupt line of a /proc/interrupts copy per CPU.
+//Returns the number of CPU columns, 0 if the copy is empty.
+static int count_interrupts(char *text, int *cpus, long long *totals){
+    int columns = 0;
+    char *line = text;
+    char *end;
+
+    //The header names the online CPUs: "CPU0 CPU1 ..."
+    while(*line != '\0' && *line != '\n'){
+        if(strncmp(line, "CPU", 3) == 0 && columns < MAX_CPUS){
+            cpus[columns] = (int)strtol(line + 3, &end, 10);
+            totals[columns] = 0;
+            columns++;
+            line = end;
+        }
+        else{
+            line++;
+        }
+    }
+
+    while(*line == '\n'){
+        line++;
+        char *colon = strchr(line, ':');
+        char *next = strchr(line, '\n');
+        if(colon == NULL || (next != NULL && colon > next))
+            break;
+
+        //Lines such as ERR and MIS only have one count, they aren't per CPU
+        long long counts[MAX_CPUS];
+        int parsed = 0;
+        char *pos = colon + 1;
+        while(parsed < columns){
+            long long value = strtoll(pos, &end, 10);
+            if(end == pos)
+                break;
+            counts[parsed++] = value;
+            pos = end;
+        }
+        if(parsed == columns){
+            for(int c = 0; c < columns; c++){
+                totals[c] += counts[c];
+            }
+        }
+
+        line = next != NULL ? next : line + strlen(line);
+    }
+
+    return columns;
+}
+
+//Returns the interrupts a core took over the window, -1 if it isn't in /proc/interrupts
+static long long core_interrupts(size_t core){
+    static int cpus[2][MAX_CPUS];
+    static long long totals[2][MAX_CPUS];
+    static int columns[2] = {-1, -1};
+    long long values[2];
+
+    for(int which = HOST_START; which <= HOST_END; which++){
+        if(columns[which] < 0)
+            columns[which] = count_interrupts(interrupts[which], cpus[which], totals[which]);
+
+        values[which] = -1;
+        for(int c = 0; c < columns[which]; c++){
+            if(cpus[which][c] == (int)core)
+                values[which] = totals[which][c];
+        }
+    }
+
+    if(values[HOST_START] < 0 || values[HOST_END] < 0)
+        return -1;
+    return values[HOST_END] - values[HOST_START];
+}
+
+//Returns voluntary + nonvoluntary context switches in a status copy, -1 if missing
+static long long status_switches(char *status){
+    char *voluntary = strstr(status, "\nvoluntary_ctxt_switches:");
+    char *nonvoluntary = strstr(status, "nonvoluntary_ctxt_switches:");
+
+    if(voluntary == NULL || nonvoluntary == NULL)
+        return -1;
+    return atoll(voluntary + strlen("\nvoluntary_ctxt_switches:")) + atoll(nonvoluntary + strlen("nonvoluntary_ctxt_switches:"));
+}
+
+//Returns the context switches a thread made over the window, -1 if unknown
+static long long thread_switches(char status[2][STATUS_SIZE]){
+    long long start = status_switches(status[HOST_START]);
+    long long end = status_switches(status[HOST_END]);
+
+    if(start < 0 || end < 0)
+        return -1;
+    return end - start;
+}
+
+//Folds one pinned thread into the summary
+static void check_thread(hostNoise_t *noise, size_t core, long long switches, long long *fastestkHz){
+    long long irqs = core_interrupts(core);
+
+    if(core < MAX_CPUS && freqCount[core] > 0){
+        if(noise->minMHz == 0 || freqMin[core] / 1000.0 < noise->minMHz)
+            noise->minMHz = freqMin[core] / 1000.0;
+        if(freqMax[core] > *fastestkHz)
+            *fastestkHz = freqMax[core];
+    }
+    if(irqs > noise->maxInterrupts)
+        noise->maxInterrupts = irqs;
+    if(switches > noise->maxSwitches)
+        noise->maxSwitches = switches;
+}
+
+//Summarizes the window and flags the run when a pinned core ran slow, took too many
+//interrupts, or a worker thread was switched out too often
+void host_check(hostNoise_t *noise){
+    long long fastestkHz = 0;
+
+    noise->minMHz = 0;
+    noise->maxInterrupts = -1;
+    noise->maxSwitches = -1;
+
+    for(int i = 0; i < inputThreadCount; i++){
+        inputSwitches[i] = thread_switches(inputStatus[i]);
+        check_thread(noise, input[i].threadArgs.coreNum, inputSwitches[i], &fastestkHz);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        outputSwitches[i] = thread_switches(outputStatus[i]);
+        check_thread(noise, output[i].threadArgs.coreNum, outputSwitches[i], &fastestkHz);
+    }
+
+    noise->flags[0] = '\0';
+    if(noise->minMHz > 0 && noise->minMHz < fastestkHz / 1000.0 * NOISE_FREQ_DROP)
+        strcat(noise->flags, "freq");
+    if(noise->maxInterrupts > (long long)NOISE_IRQ_RATE * runTime)
+        strcat(noise->flags, noise->flags[0] ? "+irq" : "irq");
+    if(noise->maxSwitches > (long long)NOISE_SWITCH_RATE * runTime)
+        strcat(noise->flags, noise->flags[0] ? "+ctx" : "ctx");
+    if(noise->flags[0] == '\0')
+        strcpy(noise->flags, "none");
+}
+
+//Returns the microjoules a domain used over the window, -1 if it couldn't be read
+static long long domain_energy(domain_t *domain){
+    long long start = domain->energy[HOST_START];
+    long long end = domain->energy[HOST_END];
+
+    if(start < 0 || end < 0)
+        return -1;
+    //The counter wrapped around during the window
+    if(end < start)
+        return domain->range > 0 ? end + domain->range - start : -1;
+    return end - start;
+}
+
+//Works out the power and energy per packet over the window, summed over the package and DRAM domains
+void host_energy(hostEnergy_t *energy){
+    double microjoules = 0;
+    double packets = (double)finalTotal / avgPacketSize;
+    double gigabits = (double)finalTotal * 8 / 1000000000;
+
+    memset(energy, 0, sizeof(hostEnergy_t));
+
+    for(int d = 0; d < domainCount; d++){
+        long long used = domain_energy(&domains[d]);
+        if(used < 0)
+            continue;
+        microjoules += used;
+        energy->available = 1;
+    }
+
+    if(!energy->available)
+        return;
+
+    energy->watts = microjoules / 1000000 / runTime;
+    if(packets > 0)
+        energy->nanojoulesPerPacket = microjoules * 1000 / packets;
+    if(gigabits > 0)
+        energy->joulesPerGigabit = microjoules / 1000000 / gigabits;
+}
+
+static void report_thread(FILE *fptr, char *algName, char *side, size_t threadNum, io_t *io, long long switches){
+    size_t core = io->threadArgs.coreNum;
+    long long irqs = core_interrupts(core);
+
+    fprintf(fptr, "%s,%lu,%lu,%s,%lu,%lu,%d,", algName, inputThreadCount, outputThreadCount, side, threadNum, core, (int)io->tid);
+    if(core < MAX_CPUS && freqCount[core] > 0)
+        fprintf(fptr, "%.0f,%.0f", freqMin[core] / 1000.0, freqSum[core] / 1000.0 / freqCount[core]);
+    else
+        fprintf(fptr, ",");
+    fprintf(fptr, ",");
+    if(irqs >= 0) fprintf(fptr, "%lld", irqs);
+    fprintf(fptr, ",");
+    if(switches >= 0) fprintf(fptr, "%lld", switches);
+    fprintf(fptr, "\n");
+}
+
+//Writes the frequency, interrupts and context switches of every thread to RESULTS_DIR/<algName>_host.csv
+//and the energy of every RAPL domain to RESULTS_DIR/<algName>_energy.csv
+void host_report(char *algName){
+    char fileName[10000];
+
+    snprintf(fileName, sizeof(fileName), "%s_host.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Side,Thread,Core,Tid,MinMHz,AvgMHz,Interrupts,Switches\n");
+
+    for(int i = 0; i < inputThreadCount; i++){
+        report_thread(fptr, algName, "Input", i, &input[i], inputSwitches[i]);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        report_thread(fptr, algName, "Output", i, &output[i], outputSwitches[i]);
+    }
+
+    fclose(fptr);
+
+    //Energy of every RAPL domain to RESULTS_DIR/<algName>_energy.csv
+    if(domainCount <= 0)
+        return;
+
+    snprintf(fileName, sizeof(fileName), "%s_energy.csv", algName);
+    fptr = open_results_file(fileName, "Algorithm,Input,Output,Domain,Joules,Watts,NanojoulesPerPacket\n");
+
+    double packets = (double)finalTotal / avgPacketSize;
+    for(int d = 0; d < domainCount; d++){
+        long long used = domain_energy(&domains[d]);
+        if(used < 0)
+            continue;
+        fprintf(fptr, "%s,%lu,%lu,%s,%.6f,%.3f,%.3f\n", algName, inputThreadCount, outputThreadCount, domains[d].name,
+            used / 1000000.0, used / 1000000.0 / runTime, packets > 0 ? used * 1000.0 / packets : 0);
+    }
+
+    fclose(fptr);
+}
@@ -0,0 +1,40 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include<global.h>
+
+//Which snapshot to take for the timed window
+#define HOST_START 0
+#define HOST_END 1
+
+//Summary of how much the host disturbed a run
+//minMHz (double) - lowest frequency seen on a pinned core, 0 if unknown
+//maxInterrupts (long long) - most interrupts taken by one pinned core, -1 if unknown
+//maxSwitches (long long) - most context switches made by one worker thread, -1 if unknown
+//flags (char array) - which limits were crossed joined with '+' (freq, irq, ctx), or "none"
+typedef struct HostNoise{
+    double minMHz;
+    long long maxInterrupts;
+    long long maxSwitches;
+    char flags[32];
+}hostNoise_t;
+
+//Energy used over the timed window, from the powercap RAPL package and DRAM domains
+//available (int) - 0 if no domain could be read, the other fields are then 0
+//watts (double) - average power of all domains
+//nanojoulesPerPacket (double) - energy of all domains per packet passed
+//joulesPerGigabit (double) - energy of all domains per gigabit passed
+typedef struct HostEnergy{
+    int available;
+    double watts;
+    double nanojoulesPerPacket;
+    double joulesPerGigabit;
+}hostEnergy_t;
+
+void host_snapshot(int which);
+void host_sample();
+void host_check(hostNoise_t *noise);
+void host_energy(hostEnergy_t *energy);
+void host_report(char *algName);
+
+#endif
@@ -0,0 +1,103 @@
+//Open loop latency
+//With -p open:<rate> every input thread sends on a fixed schedule (pacer.c) and stamps each
+//packet with the TSC value it was due at. Output threads look the stamp up in VERIFY_PACKET()
+//and count now - due in a log-linear histogram of their own, in the timed window only.
+//Measuring from the schedule instead of from when the input thread got the packet out is
+//what keeps a stalled algorithm from hiding its latency (coordinated omission): the packets
+//that piled up behind the stall are all late by the time they were kept waiting.
+//
+//The histograms are merged after the run. Percentiles are reported as the upper edge of
+//their bucket, at most 6% above the true value, and converted to nanoseconds with the TSC
+//rate of the timed window.
+
+#include<global.h>
+#include<latency.h>
+
+//Million packets per second each input thread is scheduled to send
+static double openRate;
+
+//Allocates the stamp rings, called from pacer_setup() for the open loop pattern. They are
+//placed with shared_alloc() so PROCS=1 workers stamp and read the same rings.
+void latency_setup(double rate){
+    size_t count = (size_t)MAX_FLOWS * LATENCY_RING;
+
+    openRate = rate;
+    latencyStamps = shared_alloc(sizeof(stamp_t) * count);
+    for(size_t i = 0; i < count; i++){
+        latencyStamps[i].order = LATENCY_NO_ORDER;
+        latencyStamps[i].due = 0;
+    }
+}
+
+//Largest latency in TSC ticks that falls into a bucket
+static double bucket_upper(size_t bucket){
+    if(bucket < LATENCY_SUB_COUNT)
+        return bucket;
+    int exponent = (bucket >> LATENCY_SUB_BITS) + LATENCY_SUB_BITS - 1;
+    size_t sub = bucket & (LATENCY_SUB_COUNT - 1);
+    return ldexp(LATENCY_SUB_COUNT + sub + 1, exponent - LATENCY_SUB_BITS) - 1;
+}
+
+//Merges the output threads' histograms, returns 0 if the run wasn't open loop
+int latency_summary(latencySummary_t *summary){
+    static uint64_t merged[LATENCY_BUCKETS];
+    double percentiles[] = {0.5, 0.99, 0.999};
+    double *values[] = {&summary->p50Ns, &summary->p99Ns, &summary->p999Ns};
+
+    memset(summary, 0, sizeof(*summary));
+    if(latencyStamps == NULL)
+        return 0;
+
+    memset(merged, 0, sizeof(merged));
+    for(int i = 0; i < outputThreadCount; i++){
+        verify_t *verify = output[i].verify;
+        if(verify == NULL)
+            continue;
+        for(size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++){
+            merged[bucket] += verify->latency[bucket];
+            summary->packets += verify->latency[bucket];
+        }
+        summary->unstamped += verify->unstamped;
+    }
+    summary->offeredPps = openRate * 1000000.0 * inputThreadCount;
+
+    //The timed window gives the TSC rate
+    double ticksPerNs = (double)(windowEnd - windowStart) / (runTime * 1000000000.0);
+    if(summary->packets == 0 || ticksPerNs <= 0)
+        return 1;
+
+    double seen = 0;
+    size_t next = 0;
+    for(size_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++){
+        if(merged[bucket] == 0)
+            continue;
+        seen += merged[bucket];
+        while(next < sizeof(percentiles) / sizeof(percentiles[0]) && seen >= percentiles[next] * summary->packets){
+            *values[next] = bucket_upper(bucket) / ticksPerNs;
+            next++;
+        }
+        summary->maxNs = bucket_upper(bucket) / ticksPerNs;
+    }
+    return 1;
+}
+
+//Prints the latency of an open loop run and appends it to RESULTS_DIR/<alg>_latency.csv
+void latency_report(char *algName){
+    char fileName[10000];
+    latencySummary_t summary;
+
+    if(!latency_summary(&summary))
+        return;
+
+    printf("\nOpen Loop Latency (from scheduled send, %.3f Mpps offered):\n", summary.offeredPps / 1000000.0);
+    printf("%14s %12s %12s %12s %12s\n", "Packets", "p50 ns", "p99 ns", "p99.9 ns", "Max ns");
+    printf("%14.0f %12.0f %12.0f %12.0f %12.0f\n", summary.packets, summary.p50Ns, summary.p99Ns, summary.p999Ns, summary.maxNs);
+    if(summary.unstamped > 0)
+        printf("WARNING: %.0f packets were passed after their stamp was overwritten (more than %d packets of a flow in flight), they aren't counted\n", summary.unstamped, LATENCY_RING);
+
+    snprintf(fileName, sizeof(fileName), "%s_latency.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Pattern,OfferedPps,Packets,Unstamped,P50Ns,P99Ns,P999Ns,MaxNs\n");
+    fprintf(fptr, "%s,%lu,%lu,%s,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n", algName, inputThreadCount, outputThreadCount, trafficPattern,
+        summary.offeredPps, summary.packets, summary.unstamped, summary.p50Ns, summary.p99Ns, summary.p999Ns, summary.maxNs);
+    fclose(fptr);
+}
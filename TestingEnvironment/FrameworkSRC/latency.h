@@ -0,0 +1,34 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include"global.h"
+
+//Latency of an open loop run, from the time each packet was due to the time it was passed
+//offeredPps (double) - packets per second the schedule offered, summed over the input threads
+//packets (double) - packets whose latency was measured
+//unstamped (double) - packets passed after their stamp was overwritten, not measured
+//p50Ns, p99Ns, p999Ns, maxNs (double) - latency percentiles in nanoseconds, the upper edge of their bucket
+typedef struct LatencySummary{
+    double offeredPps;
+    double packets;
+    double unstamped;
+    double p50Ns;
+    double p99Ns;
+    double p999Ns;
+    double maxNs;
+}latencySummary_t;
+
+void latency_setup(double rate);
+int latency_summary(latencySummary_t *summary);
+void latency_report(char *algName);
+
+//Records the time a packet was due in its flow's ring, see latency_record() in global.h
+static inline void latency_stamp(size_t flow, size_t order, tsc_t due){
+    uint64_t sequence = latency_sequence(flow, order);
+    stamp_t *stamp = &latencyStamps[FLOW_SLOT(flow) * LATENCY_RING + (sequence & (LATENCY_RING - 1))];
+    stamp->order = LATENCY_NO_ORDER;
+    stamp->due = due;
+    stamp->order = sequence;
+}
+
+#endif
@@ -0,0 +1,186 @@
+//Queue occupancy sampling
+//When built with OCCUPANCY=1 a sampler thread on the monitor core asks the algorithm
+//how full its queues are (queue_occupancy() in global.h) up to OCCUPANCY_HZ times a
+//second during the timed window. The sampler runs with normal scheduling so it never
+//takes the core from the main thread, and the hook only reads the queues so sampling
+//does not take cache lines away from the threads writing them.
+//After the run the samples are turned into a histogram per queue and a time x queue heatmap.
+
+#include<global.h>
+#include<wrapper.h>
+#include<occupancy.h>
+
+#ifdef OCCUPANCY_SAMPLING
+static pthread_t samplerThread;
+static int sampling = 0;
+
+//Fill of every queue in percent, MAX_QUEUES entries per sample
+static unsigned char *samples;
+//Milliseconds since sampling started for every sample
+static double *sampleTimes;
+static size_t sampleCount = 0;
+static size_t maxSamples = 0;
+static size_t numQueues = 0;
+
+static void * sampler(void *args){
+    double fill[MAX_QUEUES];
+    struct timespec start, next, now;
+    long period = 1000000000L / OCCUPANCY_HZ;
+
+    //Share the monitor core without real time priority
+    set_thread_props(MONITOR_CORE, (long)NULL);
+
+    while(startFlag == 0){
+        usleep(100);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    next = start;
+
+    while(endFlag == 0 && sampleCount < maxSamples){
+        size_t count = queue_occupancy(fill);
+        if(count > MAX_QUEUES)
+            count = MAX_QUEUES;
+        numQueues = count;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        sampleTimes[sampleCount] = (now.tv_sec - start.tv_sec) * 1000.0 + (now.tv_nsec - start.tv_nsec) / 1000000.0;
+
+        unsigned char *row = &samples[sampleCount * MAX_QUEUES];
+        for(size_t q = 0; q < count; q++){
+            double percent = fill[q] * 100;
+            row[q] = percent >= 100 ? 100 : (percent <= 0 ? 0 : (unsigned char)(percent + 0.5));
+        }
+        sampleCount++;
+
+        //If the hook took longer than a period sample again right away rather than catching up
+        next.tv_nsec += period;
+        if(next.tv_nsec >= 1000000000L){
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        if(next.tv_sec < now.tv_sec || (next.tv_sec == now.tv_sec && next.tv_nsec < now.tv_nsec))
+            next = now;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    return NULL;
+}
+
+//Writes the histogram of every queue to RESULTS_DIR/<algName>_occupancy.csv and prints a summary
+static void write_histogram(char *algName){
+    char fileName[10000];
+
+    snprintf(fileName, sizeof(fileName), "%s_occupancy.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Queue,Samples,Mean,Empty,"
+        "Bin0,Bin10,Bin20,Bin30,Bin40,Bin50,Bin60,Bin70,Bin80,Bin90,Bin100\n");
+
+    double span = sampleTimes[sampleCount - 1] / 1000.0;
+    printf("\nQueue Occupancy (%lu samples at %.0f Hz):\n", sampleCount, span > 0 ? (sampleCount - 1) / span : 0);
+    printf("%-6s %8s %8s %8s\n", "Queue", "Mean", "Empty", "Full");
+
+    for(size_t q = 0; q < numQueues; q++){
+        size_t bins[OCCUPANCY_BINS] = {0};
+        size_t empty = 0;
+        double total = 0;
+
+        for(size_t i = 0; i < sampleCount; i++){
+            unsigned char percent = samples[i * MAX_QUEUES + q];
+            bins[percent / 10]++;
+            if(percent == 0)
+                empty++;
+            total += percent;
+        }
+
+        double mean = total / sampleCount;
+        printf("%-6lu %7.1f%% %7.1f%% %7.1f%%\n", q, mean, 100.0 * empty / sampleCount, 100.0 * bins[OCCUPANCY_BINS - 1] / sampleCount);
+
+        fprintf(fptr, "%s,%lu,%lu,%lu,%lu,%.2f,%.4f", algName, inputThreadCount, outputThreadCount, q, sampleCount, mean, (double)empty / sampleCount);
+        for(int b = 0; b < OCCUPANCY_BINS; b++){
+            fprintf(fptr, ",%.4f", (double)bins[b] / sampleCount);
+        }
+        fprintf(fptr, "\n");
+    }
+
+    fclose(fptr);
+}
+
+//Writes the mean fill of every queue over each HEATMAP_MS bucket to
+//RESULTS_DIR/<algName>_<M>x<N>_heatmap.csv, one row per bucket and one column per queue
+static void write_heatmap(char *algName){
+    char fileName[10000];
+    double sums[MAX_QUEUES];
+    size_t i = 0;
+
+    snprintf(fileName, sizeof(fileName), "%s_%lux%lu_heatmap.csv", algName, inputThreadCount, outputThreadCount);
+    FILE *fptr = open_results_file(fileName, NULL);
+
+    fprintf(fptr, "TimeMs");
+    for(size_t q = 0; q < numQueues; q++){
+        fprintf(fptr, ",Q%lu", q);
+    }
+    fprintf(fptr, "\n");
+
+    while(i < sampleCount){
+        size_t bucket = (size_t)(sampleTimes[i] / HEATMAP_MS);
+        size_t count = 0;
+
+        memset(sums, 0, sizeof(sums));
+        while(i < sampleCount && (size_t)(sampleTimes[i] / HEATMAP_MS) == bucket){
+            for(size_t q = 0; q < numQueues; q++){
+                sums[q] += samples[i * MAX_QUEUES + q];
+            }
+            count++;
+            i++;
+        }
+
+        fprintf(fptr, "%lu", bucket * HEATMAP_MS);
+        for(size_t q = 0; q < numQueues; q++){
+            fprintf(fptr, ",%.1f", sums[q] / count);
+        }
+        fprintf(fptr, "\n");
+    }
+
+    fclose(fptr);
+}
+#endif
+
+//Starts the sampler thread if the algorithm reports its queues.
+//Only runs when built with OCCUPANCY=1.
+void occupancy_start(){
+#ifdef OCCUPANCY_SAMPLING
+    if(queue_occupancy == NULL){
+        printf("\n%s does not report its queues, occupancy will not be sampled\n", get_name());
+        return;
+    }
+
+    //Room for every sample over the window plus a second of slack
+    maxSamples = (size_t)(runTime + 1) * OCCUPANCY_HZ;
+    samples = Malloc(maxSamples * MAX_QUEUES);
+    sampleTimes = Malloc(maxSamples * sizeof(double));
+
+    Pthread_create(&samplerThread, NULL, sampler, NULL);
+    sampling = 1;
+#endif
+}
+
+//Waits for the sampler to stop and writes out what it collected
+void occupancy_report(char *algName){
+#ifdef OCCUPANCY_SAMPLING
+    if(!sampling)
+        return;
+
+    Pthread_join(samplerThread, NULL);
+
+    if(sampleCount == 0 || numQueues == 0){
+        printf("\nNo queue occupancy samples were taken\n");
+        return;
+    }
+
+    write_histogram(algName);
+    write_heatmap(algName);
+
+    free(samples);
+    free(sampleTimes);
+#endif
+}
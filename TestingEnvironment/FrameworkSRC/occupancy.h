@@ -0,0 +1,9 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include<global.h>
+
+void occupancy_start();
+void occupancy_report(char *algName);
+
+#endif
@@ -0,0 +1,101 @@
+#Build options shared by the framework and every algorithm.
+#Pass them on the make command line along with AP so every object is built the same way.
+#Example: make AP=Algorithm1/ PHASES=1
+
+#PHASES=1:	Compile in the per phase cycle accounting (PHASE() in global.h)
+ifeq ($(PHASES),1)
+CFLAGS += -DPHASE_TIMING
+endif
+
+#TRACE=1:	Record a per thread event trace (TRACE() in global.h)
+ifeq ($(TRACE),1)
+CFLAGS += -DEVENT_TRACE
+endif
+
+#OCCUPANCY=1:	Sample how full the algorithm's queues are (queue_occupancy() in global.h)
+ifeq ($(OCCUPANCY),1)
+CFLAGS += -DOCCUPANCY_SAMPLING
+endif
+
+#SPIN=1:	Time the waits of loops that poll several queues (SPIN_MISS()/SPIN_HIT() in
+#global.h). SPIN_WHILE() waits are always timed, they cost nothing unless the thread waits.
+ifeq ($(SPIN),1)
+CFLAGS += -DSPIN_POLL_TIMING
+endif
+
+#MODE=release:	Optimized build, -O3 tuned for this CPU with link time optimization
+#across the framework and algorithm objects. The default debug build is unoptimized.
+ifeq ($(MODE),release)
+CFLAGS += -O3 -march=native -flto=auto -DRELEASE_BUILD
+endif
+
+#PGO=gen:	Instrument the build to collect a profile (.gcda files next to the objects)
+#PGO=use:	Build with the collected profile. pgoBuild.sh runs the whole flow.
+#Counters are updated atomically since every worker thread runs the same code.
+ifeq ($(PGO),gen)
+CFLAGS += -fprofile-generate -fprofile-update=atomic -DPGO_GENERATE
+endif
+ifeq ($(PGO),use)
+CFLAGS += -fprofile-use -fprofile-correction -Wno-missing-profile -DPGO_USE
+endif
+
+#SIM=1:	Run every input and output routine as a coroutine on one core and report
+#instructions and cycles per packet (sim.c). Needs neither root nor isolated cores.
+ifeq ($(SIM),1)
+CFLAGS += -DCOROUTINE_SIM
+endif
+
+#PROCS=1:	Run the input and output threads in two separate processes that share the
+#algorithm's queues through memfd mappings (process.c), to measure what isolation costs
+ifeq ($(PROCS),1)
+CFLAGS += -DMULTI_PROCESS
+endif
+
+#GEN=scalar|sse|avx2:	Force one packet generator implementation (generator.c) instead of
+#the widest one the CPU supports, e.g. GEN=scalar to see what the SIMD generator saves
+ifeq ($(GEN),scalar)
+CFLAGS += -DGEN_FORCE_SCALAR
+endif
+ifeq ($(GEN),sse)
+CFLAGS += -DGEN_FORCE_SSE
+endif
+ifeq ($(GEN),avx2)
+CFLAGS += -DGEN_FORCE_AVX2
+endif
+
+#PROBE=scalar:	Probe the output flow tables (flowtable.h) one entry at a time instead of
+#with the widest vector compare the build targets
+ifeq ($(PROBE),scalar)
+CFLAGS += -DFLOW_PROBE_FORCE_SCALAR
+endif
+
+#PREFETCH=1:	Algorithms that pass packets a batch at a time prefetch the flow table
+#buckets of the whole batch first (flow_prefetch() in flowtable.h)
+ifeq ($(PREFETCH),1)
+CFLAGS += -DFLOW_PREFETCH
+endif
+
+#CRC=table:	Check payloads (-d, payload.c) with the byte at a time CRC32C table instead of
+#the SSE4.2 crc32 instruction
+ifeq ($(CRC),table)
+CFLAGS += -DCRC_FORCE_TABLE
+endif
+
+#HEADER=compact:	12 byte packet headers (32 bit flow, 48 bit order, 16 bit length) instead
+#of three size_t fields, to see what smaller descriptors gain (packet_t in global.h)
+ifeq ($(HEADER),compact)
+CFLAGS += -DCOMPACT_HEADER
+endif
+
+#DEFS="-DNAME=value ...":	Extra defines, to build variants of an algorithm that
+#override one of its #ifndef guarded constants (e.g. DEFS=-DBUFFSIZEBYTES=32768)
+ifneq ($(DEFS),)
+CFLAGS += $(DEFS)
+endif
+
+#Build metadata recorded with every run in the results store (results.c).
+#Keep this last so BUILD_CFLAGS holds every option above.
+GIT_SHA := $(shell git rev-parse --short HEAD 2>/dev/null || echo unknown)$(shell git diff --quiet HEAD -- 2>/dev/null || echo -dirty)
+BUILD_CFLAGS := $(strip $(CFLAGS))
+BUILD_COMPILER := $(subst ",,$(shell $(CC) --version 2>/dev/null | head -1))
+CFLAGS += -DGIT_SHA=\"$(GIT_SHA)\" -DBUILD_CFLAGS="\"$(BUILD_CFLAGS)\"" -DBUILD_COMPILER="\"$(BUILD_COMPILER)\""
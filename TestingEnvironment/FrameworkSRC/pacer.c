@@ -0,0 +1,232 @@
+//Temporal traffic models
+//By default input threads generate back to back for the whole window (steady). With -p an
+//input thread only sends its next packet once the model lets it, and spins until then:
+//  onoff:<on us>:<off us>          full speed for on microseconds, then idle for off, repeated
+//  mmpp:<rate0>:<rate1>:<dwell us> two state Markov modulated process: the thread sends at
+//                                  rate0 or rate1 million packets per second (0 is idle) and
+//                                  switches state after exponentially distributed times with
+//                                  a mean of dwell microseconds
+//  ramp:<from>:<to>:<seconds>      the rate goes from from to to million packets per second
+//                                  over seconds, then holds
+//  pcap[:<speed>]                  the gaps between the packets of the capture replayed with -r,
+//                                  divided by speed (1 by default)
+//  open:<rate>                     open loop: rate million packets per second on a fixed schedule
+//Adding @<offset us> to a model runs input thread t's pattern t * offset microseconds behind
+//thread 0's. Without it every input bursts together. MMPP threads share one sequence of
+//states, so the offset also decides whether they switch together.
+//
+//A thread that falls more than a packet behind its schedule, because it was blocked on a
+//full queue, sends as soon as it can and is scheduled from there, so the input threads stay
+//closed loop. Idle time is charged to PHASE(IDLE) and traced as idle, not as a spin wait.
+//
+//The open loop model never reschedules. Packet k of a thread is due k intervals after its
+//first one, and a thread that fell behind sends its late packets back to back until it
+//catches up, the way a NIC keeps receiving while the software is stalled. Each packet is
+//stamped with the time it was due (latency.c), so the latency the output threads measure
+//includes the time a packet waited to be sent and doesn't hide stalls (coordinated omission).
+
+#include<global.h>
+#include<pacer.h>
+#include<pcap.h>
+#include<latency.h>
+
+//TSC ticks the calibration runs for, in microseconds
+#define CALIBRATE_US 50000
+
+//The parsed model, the same for every input thread
+static int paceModel;
+static tsc_t onTicks, offTicks;
+static double stateIntervals[2];
+static double dwellTicks;
+static double fromRate, toRate;
+static double rampTicks;
+static double captureTicks;
+static double openTicks;
+static double offsetTicks;
+
+//Measures how many TSC ticks a microsecond takes against CLOCK_MONOTONIC
+static double tsc_calibrate(){
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    tsc_t tscStart = rdtsc();
+    usleep(CALIBRATE_US);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    tsc_t tscEnd = rdtsc();
+
+    double us = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_nsec - start.tv_nsec) / 1000.0;
+    return (tscEnd - tscStart) / us;
+}
+
+//Parses the -p argument, called from generator_select() before any input thread runs
+void pacer_setup(){
+    char model[256];
+    char *at;
+    char extra;
+    double first, second, third, offsetUs = 0;
+
+    snprintf(model, sizeof(model), "%s", trafficPattern);
+    if((at = strchr(model, '@')) != NULL){
+        *at = '\0';
+        if(sscanf(at + 1, "%lf%c", &offsetUs, &extra) != 1 || offsetUs < 0)
+            model[0] = '\0';
+    }
+
+    if(strcmp(model, "steady") == 0){
+        paceModel = PACE_STEADY;
+    }
+    else if(sscanf(model, "onoff:%lf:%lf%c", &first, &second, &extra) == 2 && first > 0 && second >= 0){
+        paceModel = PACE_ONOFF;
+    }
+    else if(sscanf(model, "mmpp:%lf:%lf:%lf%c", &first, &second, &third, &extra) == 3 && first >= 0 && second >= 0 && first + second > 0 && third > 0){
+        paceModel = PACE_MMPP;
+    }
+    else if(sscanf(model, "ramp:%lf:%lf:%lf%c", &first, &second, &third, &extra) == 3 && first > 0 && second > 0 && third > 0){
+        paceModel = PACE_RAMP;
+    }
+    else if(strcmp(model, "pcap") == 0 || (sscanf(model, "pcap:%lf%c", &first, &extra) == 1 && first > 0)){
+        paceModel = PACE_CAPTURE;
+        if(strcmp(model, "pcap") == 0)
+            first = 1;
+        if(replayFile == NULL){
+            printf("ERROR: the pcap traffic pattern needs a capture to replay with -r\n");
+            exit(1);
+        }
+    }
+    else if(sscanf(model, "open:%lf%c", &first, &extra) == 1 && first > 0){
+        paceModel = PACE_OPEN;
+    }
+    else{
+        printf("Unknown traffic pattern %s. Use steady, onoff:<on us>:<off us>, mmpp:<Mpps>:<Mpps>:<dwell us>, ramp:<Mpps>:<Mpps>:<seconds>, pcap[:<speed>] or open:<Mpps>, optionally followed by @<offset us>\n", trafficPattern);
+        exit(1);
+    }
+
+    if(paceModel == PACE_STEADY)
+        return;
+
+    double tscPerUs = tsc_calibrate();
+    offsetTicks = offsetUs * tscPerUs;
+
+    switch(paceModel){
+        case PACE_ONOFF:
+            onTicks = first * tscPerUs;
+            offTicks = second * tscPerUs;
+            break;
+        case PACE_MMPP:
+            stateIntervals[0] = first > 0 ? tscPerUs / first : 0;
+            stateIntervals[1] = second > 0 ? tscPerUs / second : 0;
+            dwellTicks = third * tscPerUs;
+            break;
+        case PACE_RAMP:
+            //Rates in packets per TSC tick
+            fromRate = first / tscPerUs;
+            toRate = second / tscPerUs;
+            rampTicks = third * 1000000.0 * tscPerUs;
+            break;
+        case PACE_CAPTURE:
+            captureTicks = tscPerUs / 1000 / first;
+            break;
+        case PACE_OPEN:
+            openTicks = tscPerUs / first;
+            latency_setup(first);
+            break;
+    }
+}
+
+//Draws how long an MMPP state lasts, exponentially distributed
+static tsc_t state_length(unsigned int *seed){
+    double uniform = ((NEXT_SEED(*seed) >> 8) + 0.5) / (1 << 24);
+    return (tsc_t)(-dwellTicks * log(uniform));
+}
+
+//Sets up the pacer of an input thread, its pattern starts with its first packet
+void pacer_init(pacer_t *pacer, size_t threadNum){
+    pacer->model = paceModel;
+    pacer->shift = (tsc_t)(offsetTicks * threadNum);
+    pacer->origin = 0;
+    pacer->due = 0;
+    pacer->state = 0;
+
+    //Past the seeds of the input threads and of their flow shuffles in generator.c
+    pacer->stateSeed = thread_seed(2 * MAX_NUM_INPUT_THREADS, FLOW_STREAM);
+    pacer->stateEnd = paceModel == PACE_MMPP ? state_length(&pacer->stateSeed) : 0;
+
+    replay_t *replay = pcap_replay(threadNum);
+    pacer->gaps = replay != NULL ? replay->gaps : NULL;
+    pacer->gapCount = replay != NULL ? replay->count : 0;
+    pacer->gapNext = 0;
+    pacer->scheduled = 0;
+}
+
+//Rate based models: the next packet is due an interval after the last one, or right away
+//if the thread fell more than an interval behind
+static tsc_t pace_interval(pacer_t *pacer, tsc_t now, double interval){
+    if(pacer->due + (tsc_t)interval < now)
+        pacer->due = now;
+
+    tsc_t due = pacer->due;
+    pacer->due += (tsc_t)interval;
+    return due;
+}
+
+//Holds the calling input thread until the temporal model lets its next packet go and
+//returns the TSC value the packet was due at.
+//next_header() calls it for every packet unless the pattern is steady.
+tsc_t pace_packet(pacer_t *pacer){
+    tsc_t now = rdtsc();
+    tsc_t due = now;
+
+    if(pacer->origin == 0){
+        pacer->origin = now;
+        pacer->due = now;
+    }
+
+    //Time into the thread's own pattern, negative until a thread with a phase offset starts it
+    int64_t time = (int64_t)(now - pacer->origin) - (int64_t)pacer->shift;
+
+    switch(pacer->model){
+        case PACE_ONOFF:{
+            int64_t period = onTicks + offTicks;
+            tsc_t position = ((time % period) + period) % period;
+            if(position >= onTicks)
+                due = now + (period - position);
+            break;
+        }
+        case PACE_MMPP:
+            while(time >= 0 && (tsc_t)time >= pacer->stateEnd){
+                pacer->state ^= 1;
+                pacer->stateEnd += state_length(&pacer->stateSeed);
+            }
+            if(stateIntervals[pacer->state] == 0)
+                due = pacer->origin + pacer->shift + pacer->stateEnd;
+            else
+                due = pace_interval(pacer, now, stateIntervals[pacer->state]);
+            break;
+        case PACE_RAMP:{
+            double progress = time <= 0 ? 0 : time >= rampTicks ? 1 : time / rampTicks;
+            due = pace_interval(pacer, now, 1 / (fromRate + (toRate - fromRate) * progress));
+            break;
+        }
+        case PACE_CAPTURE:
+            //Schedules the packet after this one, the first packet of every loop goes right
+            //after the last one of the loop before (its gap is 0)
+            if(++pacer->gapNext == pacer->gapCount)
+                pacer->gapNext = 0;
+            due = pace_interval(pacer, now, pacer->gaps[pacer->gapNext] * captureTicks);
+            break;
+        case PACE_OPEN:
+            due = pacer->origin + pacer->shift + (tsc_t)(pacer->scheduled++ * openTicks);
+            break;
+    }
+
+    if(due > now){
+        PHASE(GENERATE);
+        TRACE(TRACE_IDLE_BEGIN);
+        while(rdtsc() < due){
+            SIM_YIELD();
+        }
+        TRACE(TRACE_IDLE_END);
+        PHASE(IDLE);
+    }
+    return due;
+}
@@ -0,0 +1,44 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include"global.h"
+
+//Temporal traffic models, picked with -p (see pacer.c)
+#define PACE_STEADY 0
+#define PACE_ONOFF 1
+#define PACE_MMPP 2
+#define PACE_RAMP 3
+#define PACE_CAPTURE 4
+#define PACE_OPEN 5
+
+//When an input thread may send its packets under the temporal model
+//model (int) - PACE_* define of the model, the same for every thread
+//shift (tsc_t) - TSC ticks this thread runs the pattern behind thread 0 (phase offset times thread number)
+//origin (tsc_t) - TSC value of the thread's first packet, 0 until then
+//due (tsc_t) - TSC value the next packet is scheduled for
+//state (int) - MMPP state the thread is in, 0 or 1
+//stateEnd (tsc_t) - Pattern time in TSC ticks the MMPP state ends at
+//stateSeed (unsigned int) - Seed of the MMPP state lengths, the same for every thread
+//gaps (const uint32_t *) - Nanoseconds before each packet of the thread's share of the capture (-r)
+//gapCount (size_t) - Gaps in gaps
+//gapNext (size_t) - Gap of the packet being sent
+//scheduled (size_t) - Packets the open loop schedule has handed out
+typedef struct Pacer{
+    int model;
+    tsc_t shift;
+    tsc_t origin;
+    tsc_t due;
+    int state;
+    tsc_t stateEnd;
+    unsigned int stateSeed;
+    const uint32_t *gaps;
+    size_t gapCount;
+    size_t gapNext;
+    size_t scheduled;
+}pacer_t;
+
+void pacer_setup();
+void pacer_init(pacer_t *pacer, size_t threadNum);
+tsc_t pace_packet(pacer_t *pacer);
+
+#endif
@@ -0,0 +1,185 @@
+//Payload check
+//By default payloads are whatever was in the input threads' buffers and output threads copy
+//them out without reading them, so a copy that is skipped, cut short or aliased to another
+//packet's bytes still passes the order check. With -d input threads fill every payload
+//(FILL_PAYLOAD()) from a counter seeded by the run seed, the flow and the order, and end it
+//with a CRC32C of the rest. Output threads compute the CRC32C of the payload they copied out
+//(CHECK_PAYLOAD()) and count the ones that differ, which fails the stream verification.
+//Seeding the CRC with the flow and order ties the bytes to their header, so a payload left
+//over from an earlier packet in a reused slot doesn't pass either.
+//
+//Reading and writing the bytes is what real producers and consumers do, so both sides time
+//it and the run reports the touch cost in cycles per packet and bytes per cycle.
+//CRC32C runs on the SSE4.2 crc32 instruction 8 bytes at a time where the CPU has it, and a
+//byte at a time from a table otherwise. CRC=table in options.mk forces the table.
+
+#include<global.h>
+#include<payload.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(CRC_FORCE_TABLE)
+    #include<immintrin.h>
+    #define CRC_SSE42
+#endif
+
+//Reflected CRC32C (Castagnoli) polynomial
+#define CRC32C_POLY 0x82F63B78U
+
+//Step of the counter the payload words come from
+#define PAYLOAD_STEP 0x9E3779B97F4A7C15ULL
+
+const char *payloadCrcName = "table";
+
+//CRC32C implementation payload_fill() and payload_check() use, picked by payload_setup()
+static uint32_t (*payload_crc)(uint32_t crc, const unsigned char *data, size_t length);
+
+//Byte at a time lookup table of the polynomial
+static uint32_t crcTable[256];
+
+//Mixed into every payload's seed so the bytes change with the run seed
+static uint64_t payloadSalt;
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *data, size_t length){
+    for(size_t i = 0; i < length; i++)
+        crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length){
+    uint64_t wide = crc;
+    size_t i = 0;
+    for(; i + 8 <= length; i += 8){
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t)wide;
+    for(; i < length; i++)
+        crc = _mm_crc32_u8(crc, data[i]);
+    return crc;
+}
+#endif
+
+//Builds the table, picks the CRC32C implementation and salts the payloads, called in main()
+//once the run seed is known
+void payload_setup(){
+    for(uint32_t byte = 0; byte < 256; byte++){
+        uint32_t crc = byte;
+        for(int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+        crcTable[byte] = crc;
+    }
+
+    payload_crc = crc32c_table;
+    payloadCrcName = "table";
+#ifdef CRC_SSE42
+    if(__builtin_cpu_supports("sse4.2")){
+        payload_crc = crc32c_sse42;
+        payloadCrcName = "sse4.2";
+    }
+#endif
+
+    //Seeds past the last input thread never generate traffic, so this is a stream of its own
+    payloadSalt = ((uint64_t)thread_seed(4 * MAX_NUM_INPUT_THREADS, FLOW_STREAM) << 32) | thread_seed(4 * MAX_NUM_INPUT_THREADS, LENGTH_STREAM);
+}
+
+//Seed of a packet's payload bytes and CRC
+static inline uint64_t payload_seed(size_t flow, size_t order){
+    uint64_t seed = (flow * PAYLOAD_STEP) ^ (order * 0xC2B2AE3D27D4EB4FULL) ^ payloadSalt;
+    seed ^= seed >> 31;
+    seed *= 0xBF58476D1CE4E5B9ULL;
+    seed ^= seed >> 29;
+    return seed;
+}
+
+//Counts the touch cost of a payload in the timed window
+static inline void payload_count(size_t length, tsc_t start){
+    if(endFlag)
+        return;
+    threadVerify.payloadTicks += rdtsc() - start;
+    threadVerify.payloadBytes += length;
+    threadVerify.payloadPackets++;
+}
+
+//Writes the payload of a packet: 8 byte words of a counter seeded by the packet, then the
+//low bytes of the CRC32C of those words
+void payload_fill(unsigned char *payload, size_t flow, size_t order, size_t length){
+    tsc_t start = rdtsc();
+    uint64_t seed = payload_seed(flow, order);
+    size_t tail = length < PAYLOAD_CRC_BYTES ? length : PAYLOAD_CRC_BYTES;
+    size_t body = length - tail;
+    uint64_t counter = seed;
+    size_t i = 0;
+
+    for(; i < body; i += 8){
+        counter += PAYLOAD_STEP;
+        uint64_t word = counter ^ (counter >> 29);
+        memcpy(payload + i, &word, body - i < 8 ? body - i : 8);
+    }
+
+    uint32_t crc = payload_crc((uint32_t)(seed >> 32), payload, body);
+    memcpy(payload + body, &crc, tail);
+    payload_count(length, start);
+}
+
+//Checks the CRC32C at the end of a payload an output thread copied out
+void payload_check(const unsigned char *payload, size_t flow, size_t order, size_t length){
+    tsc_t start = rdtsc();
+    uint64_t seed = payload_seed(flow, order);
+    size_t tail = length < PAYLOAD_CRC_BYTES ? length : PAYLOAD_CRC_BYTES;
+    size_t body = length - tail;
+
+    uint32_t crc = payload_crc((uint32_t)(seed >> 32), payload, body);
+    if(memcmp(payload + body, &crc, tail) != 0)
+        threadVerify.payloadErrors++;
+    payload_count(length, start);
+}
+
+//Sums the touch cost of one side's threads
+static void payload_side(io_t *threads, size_t count, double *packets, double *cycles, double *bytesPerCycle, double *errors){
+    double bytes = 0, ticks = 0;
+    *packets = 0;
+    for(size_t i = 0; i < count; i++){
+        verify_t *verify = threads[i].verify;
+        if(verify == NULL)
+            continue;
+        *packets += verify->payloadPackets;
+        bytes += verify->payloadBytes;
+        ticks += verify->payloadTicks;
+        if(errors != NULL)
+            *errors += verify->payloadErrors;
+    }
+    *cycles = *packets > 0 ? ticks / *packets : 0;
+    *bytesPerCycle = ticks > 0 ? bytes / ticks : 0;
+}
+
+//Sums what the input and output threads spent on payloads, returns 0 without -d
+int payload_summary(payloadSummary_t *summary){
+    memset(summary, 0, sizeof(*summary));
+    if(!payloadCheck)
+        return 0;
+    payload_side(input, inputThreadCount, &summary->fillPackets, &summary->fillCycles, &summary->fillBytesPerCycle, NULL);
+    payload_side(output, outputThreadCount, &summary->checkPackets, &summary->checkCycles, &summary->checkBytesPerCycle, &summary->errors);
+    return 1;
+}
+
+//Prints the touch cost of a -d run and appends it to RESULTS_DIR/<alg>_payload.csv
+void payload_report(char *algName){
+    char fileName[10000];
+    payloadSummary_t summary;
+
+    if(!payload_summary(&summary))
+        return;
+
+    printf("\nPayload Touch Cost (CRC32C with %s):\n", payloadCrcName);
+    printf("%-8s %14s %14s %14s\n", "Side", "Packets", "Cycles/Packet", "Bytes/Cycle");
+    printf("%-8s %14.0f %14.1f %14.2f\n", "Fill", summary.fillPackets, summary.fillCycles, summary.fillBytesPerCycle);
+    printf("%-8s %14.0f %14.1f %14.2f\n", "Check", summary.checkPackets, summary.checkCycles, summary.checkBytesPerCycle);
+
+    snprintf(fileName, sizeof(fileName), "%s_payload.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Profile,Crc,FillPackets,FillCyclesPerPacket,FillBytesPerCycle,CheckPackets,CheckCyclesPerPacket,CheckBytesPerCycle,Errors\n");
+    fprintf(fptr, "%s,%lu,%lu,%s,%s,%.0f,%.1f,%.2f,%.0f,%.1f,%.2f,%.0f\n", algName, inputThreadCount, outputThreadCount, replayFile != NULL ? "capture" : sizeProfile, payloadCrcName,
+        summary.fillPackets, summary.fillCycles, summary.fillBytesPerCycle, summary.checkPackets, summary.checkCycles, summary.checkBytesPerCycle, summary.errors);
+    fclose(fptr);
+}
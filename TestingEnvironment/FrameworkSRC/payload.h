@@ -0,0 +1,31 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include"global.h"
+
+//Bytes at the end of a payload that hold its CRC32C, fewer for shorter payloads
+#define PAYLOAD_CRC_BYTES 4
+
+//Touch cost of the payload check (-d), summed over the input or output threads
+//fillPackets, checkPackets (double) - payloads filled by the input threads and checked by the output threads
+//fillCycles, checkCycles (double) - TSC cycles per packet spent filling or checking a payload
+//fillBytesPerCycle, checkBytesPerCycle (double) - payload bytes filled or checked per TSC cycle
+//errors (double) - payloads whose CRC32C didn't match
+typedef struct PayloadSummary{
+    double fillPackets;
+    double fillCycles;
+    double fillBytesPerCycle;
+    double checkPackets;
+    double checkCycles;
+    double checkBytesPerCycle;
+    double errors;
+}payloadSummary_t;
+
+//Name of the CRC32C implementation ("sse4.2" or "table")
+extern const char *payloadCrcName;
+
+void payload_setup();
+int payload_summary(payloadSummary_t *summary);
+void payload_report(char *algName);
+
+#endif
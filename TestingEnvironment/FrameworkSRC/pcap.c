@@ -0,0 +1,426 @@
+//Capture replay (-r <file>)
+//Loads a pcap or pcapng capture at startup and turns it into a compact index that the
+//input threads replay in place of the generated traffic: every packet becomes a draw_t
+//(8 bytes) in the list of the input thread its flow key hashes to. The flow key is the IP
+//5-tuple, without the ports for fragments and protocols that have none, or the EtherType
+//for frames that aren't IP. Each flow gets an id in its thread in order of first
+//appearance, and the flow space (flowLanes, -n) is widened until every id has a flow of its
+//own: id i is slot i % FLOWS_PER_THREAD of lane i / FLOWS_PER_THREAD, see FLOW_ID_STRIDE.
+//All of a flow's packets go to the same framework flow in capture order, so per flow order
+//stays defined.
+//
+//Input threads loop over their share. Lengths are the packets' length on the wire clamped
+//to MIN_PAYLOAD_SIZE..MAX_PAYLOAD_SIZE. The gaps between each thread's packets are kept for
+//-p pcap, which replays at the capture's own timing (see pacer.c).
+
+#include<global.h>
+#include<wrapper.h>
+#include<pcap.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+
+//File formats
+#define PCAP_MAGIC_US 0xA1B2C3D4
+#define PCAP_MAGIC_NS 0xA1B23C4D
+#define PCAP_HEADER_SIZE 24
+#define PCAP_RECORD_SIZE 16
+#define PCAPNG_SECTION 0x0A0D0D0A
+#define PCAPNG_BYTE_ORDER 0x1A2B3C4D
+#define PCAPNG_INTERFACE 1
+#define PCAPNG_SIMPLE_PACKET 3
+#define PCAPNG_ENHANCED_PACKET 6
+#define PCAPNG_OPTION_TSRESOL 9
+#define PCAPNG_MAX_INTERFACES 64
+
+//Link layers the flow key can be read from
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_DLT_RAW 12
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4 228
+#define LINKTYPE_IPV6 229
+#define LINKTYPE_LINUX_SLL2 276
+
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86DD
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88A8
+
+//Size the flow table starts at, it doubles when half full
+#define FLOW_TABLE_START (1 << 16)
+
+//Flow table entry
+//key (uint64_t) - Hash of the flow key, 0 if the entry is empty
+//thread (uint32_t) - Input thread the flow is replayed by
+//flow (uint32_t) - Flow within the thread
+typedef struct FlowEntry{
+    uint64_t key;
+    uint32_t thread;
+    uint32_t flow;
+}flowEntry_t;
+
+//Index being built
+//table (flowEntry_t *) - Open addressing table from flow key hash to flow
+//tableSize (size_t) - Entries in table, a power of 2
+//flows (size_t) - Flows in table
+//flowsPerThread (size_t array) - Flows each thread was given so far
+//lastTime (uint64_t array) - Capture time of each thread's last packet in nanoseconds
+//capacity (size_t array) - Packets each thread's arrays have room for
+//clamped (size_t) - Packets whose length was outside the payload sizes
+typedef struct Index{
+    flowEntry_t *table;
+    size_t tableSize;
+    size_t flows;
+    size_t flowsPerThread[MAX_NUM_INPUT_THREADS];
+    uint64_t lastTime[MAX_NUM_INPUT_THREADS];
+    size_t capacity[MAX_NUM_INPUT_THREADS];
+    size_t clamped;
+}index_t;
+
+static replay_t replays[MAX_NUM_INPUT_THREADS];
+static int loaded;
+
+static uint16_t read16(const unsigned char *data, int swap){
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return swap ? __builtin_bswap16(value) : value;
+}
+
+static uint32_t read32(const unsigned char *data, int swap){
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return swap ? __builtin_bswap32(value) : value;
+}
+
+//Reads a big endian field of a packet header
+static uint16_t net16(const unsigned char *data){
+    return (data[0] << 8) | data[1];
+}
+
+static void bad_capture(const char *fileName, const char *reason){
+    printf("ERROR: %s is not a capture that can be replayed: %s\n", fileName, reason);
+    exit(1);
+}
+
+//Hashes the flow key of a packet, data starts with the link layer header
+static uint64_t flow_key(const unsigned char *data, size_t length, uint32_t linkType){
+    unsigned char key[40];
+    size_t keyLength = 0;
+    size_t offset = 0;
+    uint16_t etherType = 0;
+
+    switch(linkType){
+        case LINKTYPE_ETHERNET:
+            if(length >= 14){
+                etherType = net16(data + 12);
+                offset = 14;
+                while((etherType == ETHERTYPE_VLAN || etherType == ETHERTYPE_QINQ) && length >= offset + 4){
+                    etherType = net16(data + offset + 2);
+                    offset += 4;
+                }
+            }
+            break;
+        case LINKTYPE_LINUX_SLL:
+            if(length >= 16){
+                etherType = net16(data + 14);
+                offset = 16;
+            }
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            if(length >= 20){
+                etherType = net16(data);
+                offset = 20;
+            }
+            break;
+        case LINKTYPE_IPV4:
+            etherType = ETHERTYPE_IPV4;
+            break;
+        case LINKTYPE_IPV6:
+            etherType = ETHERTYPE_IPV6;
+            break;
+        default:
+            //Raw IP, the version tells which
+            if(length >= 1)
+                etherType = (data[0] >> 4) == 6 ? ETHERTYPE_IPV6 : ETHERTYPE_IPV4;
+            break;
+    }
+
+    data += offset;
+    length -= offset;
+
+    if(etherType == ETHERTYPE_IPV4 && length >= 20){
+        size_t headerLength = (data[0] & 0xF) * 4;
+        int fragment = (net16(data + 6) & 0x3FFF) != 0;
+        uint8_t protocol = data[9];
+
+        memcpy(key, data + 12, 8);
+        key[8] = protocol;
+        keyLength = 9;
+        if(!fragment && (protocol == 6 || protocol == 17 || protocol == 132) && length >= headerLength + 4){
+            memcpy(key + keyLength, data + headerLength, 4);
+            keyLength += 4;
+        }
+    }
+    else if(etherType == ETHERTYPE_IPV6 && length >= 40){
+        uint8_t protocol = data[6];
+
+        memcpy(key, data + 8, 32);
+        key[32] = protocol;
+        keyLength = 33;
+        if((protocol == 6 || protocol == 17 || protocol == 132) && length >= 44){
+            memcpy(key + keyLength, data + 40, 4);
+            keyLength += 4;
+        }
+    }
+    else{
+        key[0] = etherType >> 8;
+        key[1] = etherType & 0xFF;
+        keyLength = 2;
+    }
+
+    //FNV-1a over the key, then mixed so the low bits pick threads and table slots evenly
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for(size_t i = 0; i < keyLength; i++){
+        hash = (hash ^ key[i]) * 0x100000001B3ULL;
+    }
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return hash != 0 ? hash : 1;
+}
+
+//Returns the table entry of a key, the empty entry it would go in if it isn't there
+static flowEntry_t * flow_find(flowEntry_t *table, size_t tableSize, uint64_t key){
+    size_t slot = key & (tableSize - 1);
+
+    while(table[slot].key != 0 && table[slot].key != key){
+        slot = (slot + 1) & (tableSize - 1);
+    }
+    return &table[slot];
+}
+
+static void flow_table_grow(index_t *index){
+    size_t oldSize = index->tableSize;
+    flowEntry_t *oldTable = index->table;
+
+    index->tableSize = oldSize == 0 ? FLOW_TABLE_START : oldSize * 2;
+    index->table = Malloc(sizeof(flowEntry_t) * index->tableSize);
+    memset(index->table, 0, sizeof(flowEntry_t) * index->tableSize);
+    for(size_t i = 0; i < oldSize; i++){
+        if(oldTable[i].key != 0)
+            *flow_find(index->table, index->tableSize, oldTable[i].key) = oldTable[i];
+    }
+    free(oldTable);
+}
+
+//Adds a packet of the capture to the replay of the thread its flow belongs to
+static void add_packet(index_t *index, const unsigned char *data, size_t captured, size_t length, uint32_t linkType, uint64_t time){
+    uint64_t key = flow_key(data, captured, linkType);
+
+    if(index->flows * 2 >= index->tableSize)
+        flow_table_grow(index);
+
+    flowEntry_t *entry = flow_find(index->table, index->tableSize, key);
+    if(entry->key == 0){
+        entry->key = key;
+        entry->thread = key % inputThreadCount;
+        entry->flow = index->flowsPerThread[entry->thread]++;
+        index->flows++;
+    }
+
+    replay_t *replay = &replays[entry->thread];
+    size_t *capacity = &index->capacity[entry->thread];
+    if(replay->count == *capacity){
+        *capacity = *capacity == 0 ? 1024 : *capacity * 2;
+        replay->headers = Realloc(replay->headers, sizeof(draw_t) * *capacity);
+        replay->gaps = Realloc(replay->gaps, sizeof(uint32_t) * *capacity);
+    }
+
+    if(length < MIN_PAYLOAD_SIZE || length > MAX_PAYLOAD_SIZE){
+        length = length < MIN_PAYLOAD_SIZE ? MIN_PAYLOAD_SIZE : MAX_PAYLOAD_SIZE;
+        index->clamped++;
+    }
+
+    uint64_t *lastTime = &index->lastTime[entry->thread];
+    uint64_t gap = replay->count > 0 && time > *lastTime ? time - *lastTime : 0;
+    *lastTime = time;
+
+    replay->headers[replay->count].flow = entry->flow;
+    replay->headers[replay->count].length = length;
+    replay->gaps[replay->count] = gap > UINT32_MAX ? UINT32_MAX : gap;
+    replay->count++;
+}
+
+static void parse_pcap(const char *fileName, index_t *index, const unsigned char *file, size_t size){
+    uint32_t magic = read32(file, 0);
+    int swap = magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS;
+    int nanoseconds = read32(file, swap) == PCAP_MAGIC_NS;
+    size_t pos = PCAP_HEADER_SIZE;
+
+    if(size < PCAP_HEADER_SIZE)
+        bad_capture(fileName, "truncated file header");
+
+    //The top bits of the link type field hold the FCS length
+    uint32_t linkType = read32(file + 20, swap) & 0x0FFFFFFF;
+
+    while(pos + PCAP_RECORD_SIZE <= size){
+        const unsigned char *record = file + pos;
+        uint64_t seconds = read32(record, swap);
+        uint64_t fraction = read32(record + 4, swap);
+        size_t captured = read32(record + 8, swap);
+        size_t length = read32(record + 12, swap);
+
+        if(pos + PCAP_RECORD_SIZE + captured > size)
+            break;
+
+        add_packet(index, record + PCAP_RECORD_SIZE, captured, length, linkType,
+            seconds * 1000000000 + fraction * (nanoseconds ? 1 : 1000));
+        pos += PCAP_RECORD_SIZE + captured;
+    }
+}
+
+static void parse_pcapng(const char *fileName, index_t *index, const unsigned char *file, size_t size){
+    uint32_t linkTypes[PCAPNG_MAX_INTERFACES];
+    double nsPerTick[PCAPNG_MAX_INTERFACES];
+    size_t interfaces = 0;
+    uint64_t time = 0;
+    int swap = 0;
+    size_t pos = 0;
+
+    while(pos + 12 <= size){
+        const unsigned char *block = file + pos;
+        uint32_t type = read32(block, swap);
+
+        //Every section sets its own byte order and interfaces
+        if(read32(block, 0) == PCAPNG_SECTION){
+            uint32_t byteOrder = read32(block + 8, 0);
+            if(byteOrder != PCAPNG_BYTE_ORDER && __builtin_bswap32(byteOrder) != PCAPNG_BYTE_ORDER)
+                bad_capture(fileName, "bad pcapng byte order magic");
+            swap = byteOrder != PCAPNG_BYTE_ORDER;
+            type = PCAPNG_SECTION;
+            interfaces = 0;
+        }
+
+        size_t blockLength = read32(block + 4, swap);
+        if(blockLength < 12 || pos + blockLength > size)
+            break;
+
+        const unsigned char *body = block + 8;
+        size_t bodyLength = blockLength - 12;
+
+        if(type == PCAPNG_INTERFACE && bodyLength >= 8 && interfaces < PCAPNG_MAX_INTERFACES){
+            linkTypes[interfaces] = read16(body, swap);
+            nsPerTick[interfaces] = 1000;
+
+            //Options: code, length and a value padded to 4 bytes
+            size_t option = 8;
+            while(option + 4 <= bodyLength){
+                uint16_t code = read16(body + option, swap);
+                uint16_t optionLength = read16(body + option + 2, swap);
+                if(code == 0 || option + 4 + optionLength > bodyLength)
+                    break;
+                if(code == PCAPNG_OPTION_TSRESOL && optionLength >= 1){
+                    uint8_t resolution = body[option + 4];
+                    nsPerTick[interfaces] = 1e9 * ((resolution & 0x80) ? pow(2, -(resolution & 0x7F)) : pow(10, -resolution));
+                }
+                option += 4 + ((optionLength + 3) & ~3);
+            }
+            interfaces++;
+        }
+        else if(type == PCAPNG_ENHANCED_PACKET && bodyLength >= 20){
+            uint32_t interface = read32(body, swap);
+            uint64_t ticks = ((uint64_t)read32(body + 4, swap) << 32) | read32(body + 8, swap);
+            size_t captured = read32(body + 12, swap);
+            size_t length = read32(body + 16, swap);
+
+            if(interface >= interfaces)
+                bad_capture(fileName, "packet of an undescribed interface");
+            if(20 + captured > bodyLength)
+                bad_capture(fileName, "packet longer than its block");
+
+            time = (uint64_t)(ticks * nsPerTick[interface]);
+            add_packet(index, body + 20, captured, length, linkTypes[interface], time);
+        }
+        else if(type == PCAPNG_SIMPLE_PACKET && bodyLength >= 4){
+            size_t length = read32(body, swap);
+            size_t captured = length < bodyLength - 4 ? length : bodyLength - 4;
+
+            //Simple packets have no timestamp, they follow the last packet without a gap
+            if(interfaces == 0)
+                bad_capture(fileName, "packet before any interface");
+            add_packet(index, body + 4, captured, length, linkTypes[0], time);
+        }
+
+        pos += blockLength;
+    }
+}
+
+//Maps a capture and builds the replay of every input thread from it, called from
+//generator_select() once the number of input threads is known
+void pcap_load(const char *fileName){
+    struct stat status;
+    index_t index;
+    size_t packets = 0;
+
+    int fd = open(fileName, O_RDONLY);
+    if(fd < 0){
+        perror("ERROR: unable to open the capture");
+        exit(1);
+    }
+    if(fstat(fd, &status) < 0){
+        perror("ERROR: fstat() failed");
+        exit(1);
+    }
+    if(status.st_size < 4)
+        bad_capture(fileName, "file too short");
+
+    const unsigned char *file = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED){
+        perror("ERROR: mmap() failed");
+        exit(1);
+    }
+
+    memset(&index, 0, sizeof(index));
+    uint32_t magic = read32(file, 0);
+    if(magic == PCAPNG_SECTION)
+        parse_pcapng(fileName, &index, file, status.st_size);
+    else if(magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS || __builtin_bswap32(magic) == PCAP_MAGIC_US || __builtin_bswap32(magic) == PCAP_MAGIC_NS)
+        parse_pcap(fileName, &index, file, status.st_size);
+    else
+        bad_capture(fileName, "not a pcap or pcapng file");
+
+    munmap((void *)file, status.st_size);
+    free(index.table);
+
+    size_t lanes = flowLanes;
+    for(size_t thread = 0; thread < inputThreadCount; thread++){
+        if(replays[thread].count == 0){
+            printf("ERROR: the flows of %s only hash to some of the %lu input threads, replay it with fewer\n", fileName, inputThreadCount);
+            exit(1);
+        }
+        packets += replays[thread].count;
+        if((index.flowsPerThread[thread] + FLOWS_PER_THREAD - 1) / FLOWS_PER_THREAD > lanes)
+            lanes = (index.flowsPerThread[thread] + FLOWS_PER_THREAD - 1) / FLOWS_PER_THREAD;
+    }
+
+    //-n can make the flow space larger than the capture needs, not smaller
+    if(lanes > FLOW_MAX_LANES){
+        printf("ERROR: an input thread replays %'lu flows of %s, more than the %'lu flow ids it has, replay it with more input threads\n",
+            lanes * FLOWS_PER_THREAD, fileName, FLOWS_PER_THREAD * FLOW_MAX_LANES);
+        exit(1);
+    }
+    flowLanes = lanes;
+
+    printf("Replaying %s: %'lu packets of %'lu flows", fileName, packets, index.flows);
+    if(index.clamped > 0)
+        printf(", %'lu lengths clamped to %d-%d bytes", index.clamped, MIN_PAYLOAD_SIZE, MAX_PAYLOAD_SIZE);
+    printf("\n");
+    loaded = 1;
+}
+
+//Returns the replay of an input thread, NULL when no capture is replayed
+replay_t * pcap_replay(size_t threadNum){
+    return loaded ? &replays[threadNum] : NULL;
+}
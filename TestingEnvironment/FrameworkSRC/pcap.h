@@ -0,0 +1,20 @@
+#ifndef PCAP_H
+#define PCAP_H
+
+#include"global.h"
+#include"generator.h"
+
+//One input thread's share of a capture, in capture order
+//headers (draw_t *) - Flow within the thread and payload length of each packet
+//gaps (uint32_t *) - Nanoseconds since the thread's previous packet in the capture
+//count (size_t) - Number of packets
+typedef struct Replay{
+    draw_t *headers;
+    uint32_t *gaps;
+    size_t count;
+}replay_t;
+
+void pcap_load(const char *fileName);
+replay_t * pcap_replay(size_t threadNum);
+
+#endif
@@ -0,0 +1,163 @@
+//Multi-process mode (build with PROCS=1)
+//The input threads and the output threads run in two processes of their own, forked from
+//the main process once the algorithm has set up its queues. The only memory the three
+//processes share is what was placed in memfd mappings before the fork: the framework's
+//io_t arrays and start/end flags (process_init()) and whatever the algorithm allocated
+//with shared_alloc(). Comparing a run with the threaded build of the same algorithm shows
+//what process isolation costs: separate page tables, so every shared page is faulted in
+//and takes TLB misses once per process, and shmem pages where threads use anonymous ones.
+//
+//The main process keeps the monitor role. It opens the workers' hardware counters by
+//thread id (process_attach()) since descriptors opened in a worker process can't be read
+//from here, and kills both worker processes when the window ends (process_stop()).
+
+#include<global.h>
+#include<wrapper.h>
+#include<counters.h>
+#include<process.h>
+#include<sys/mman.h>
+#include<sys/wait.h>
+#include<sys/prctl.h>
+
+#ifdef MULTI_PROCESS
+//Worker thread state read by this process after the window (see workerState in global.h)
+__thread workerState_t workerState;
+
+//Worker process of each side, 0 until forked
+static pid_t workers[2];
+static const char *sideNames[2] = {"input", "output"};
+#endif
+
+//Returns size bytes of zeroed, page aligned memory for state that input and output threads
+//share. With PROCS=1 it is a MAP_SHARED memfd mapping, which the worker processes inherit
+//at the same address when they are forked. Otherwise it is private anonymous memory, so
+//both builds run the algorithm on the same kind of allocation apart from the sharing.
+//Must be called before the worker processes are forked, i.e. from run() at the latest.
+void * shared_alloc(size_t size){
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    void *region;
+
+    size = (size + pageSize - 1) / pageSize * pageSize;
+
+#ifdef MULTI_PROCESS
+    if(workers[INPUT_SIDE] != 0 || workers[OUTPUT_SIDE] != 0){
+        printf("ERROR: shared_alloc() called after the worker processes were forked\n");
+        exit(1);
+    }
+
+    int fd = memfd_create("lava_shared", MFD_CLOEXEC);
+    if(fd < 0){
+        perror("ERROR: memfd_create() failed");
+        exit(1);
+    }
+    if(ftruncate(fd, size) < 0){
+        perror("ERROR: ftruncate() failed");
+        exit(1);
+    }
+    region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+#else
+    region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#endif
+
+    if(region == MAP_FAILED){
+        perror("ERROR: mmap() failed");
+        exit(1);
+    }
+
+    return region;
+}
+
+#ifdef MULTI_PROCESS
+
+//Places the framework's shared state in the shared region, called at the start of main()
+//before anything touches the flags or the io_t arrays
+void process_init(){
+    control = shared_alloc(sizeof(control_t));
+    input = shared_alloc(sizeof(io_t) * MAX_NUM_INPUT_THREADS);
+    output = shared_alloc(sizeof(io_t) * MAX_NUM_OUTPUT_THREADS);
+
+#ifdef EVENT_TRACE
+    //A ring allocated by a worker would only be mapped in its own process
+    for(int i = 0; i < MAX_NUM_INPUT_THREADS; i++){
+        input[i].traceState.events = shared_alloc(sizeof(tsc_t) * TRACE_RING_SIZE);
+    }
+    for(int i = 0; i < MAX_NUM_OUTPUT_THREADS; i++){
+        output[i].traceState.events = shared_alloc(sizeof(tsc_t) * TRACE_RING_SIZE);
+    }
+#endif
+}
+
+//Forks the worker process of one side. Returns 0 in the worker, which then spawns the
+//side's threads, and the worker's pid in the main process.
+pid_t process_fork(int side){
+    pid_t parent = getpid();
+
+    //Buffered output would otherwise be printed by both processes
+    fflush(NULL);
+
+    pid_t pid = fork();
+    if(pid < 0){
+        perror("ERROR: fork() failed");
+        exit(1);
+    }
+
+    if(pid == 0){
+        //Don't leave workers spinning on their cores if the main process dies
+        if(prctl(PR_SET_PDEATHSIG, SIGKILL) < 0 || getppid() != parent){
+            _exit(1);
+        }
+        return 0;
+    }
+
+    workers[side] = pid;
+    return pid;
+}
+
+//Parks the main thread of a worker process while its threads run, until process_stop()
+void process_idle(){
+    while(1){
+        pause();
+    }
+}
+
+//Opens the hardware counters of every worker thread once they are all ready
+void process_attach(){
+    for(int i = 0; i < inputThreadCount; i++){
+        counters_open(&input[i].counters, input[i].tid);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        counters_open(&output[i].counters, output[i].tid);
+    }
+}
+
+//Ends both worker processes in place of cancelling the threads, called from sig_alrm().
+//A worker that already exited (an algorithm error) left its side without threads for
+//part of the window, which is printed as a warning.
+void process_stop(){
+    int status;
+
+    for(int side = INPUT_SIDE; side <= OUTPUT_SIDE; side++){
+        if(workers[side] == 0)
+            continue;
+
+        if(waitpid(workers[side], &status, WNOHANG) == workers[side]){
+            printf("\nWARNING: the %s process exited before the window ended, results are not valid\n", sideNames[side]);
+        }
+        else{
+            kill(workers[side], SIGKILL);
+            waitpid(workers[side], &status, 0);
+        }
+        workers[side] = 0;
+    }
+}
+
+#else
+
+void process_init(){}
+pid_t process_fork(int side){ return -1; }
+void process_idle(){}
+void process_attach(){}
+void process_stop(){}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include<global.h>
+
+//Sides that get a process of their own (PROCS=1)
+#define INPUT_SIDE 0
+#define OUTPUT_SIDE 1
+
+void process_init();
+pid_t process_fork(int side);
+void process_idle();
+void process_attach();
+void process_stop();
+
+#endif
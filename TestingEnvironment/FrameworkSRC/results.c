@@ -0,0 +1,291 @@
+//Results store
+//Every run appends one JSON record to RESULTS_DIR/RUNS_FILE holding its results and
+//everything needed to reproduce or compare it: the host (CPU model, kernel), the build
+//(compiler, CFLAGS, git commit, build options), where the threads were placed and the
+//framework parameters. compare.py reads these records to gate changes on regressions.
+
+#include<global.h>
+#include<wrapper.h>
+#include<results.h>
+#include<sim.h>
+#include<generator.h>
+#include<latency.h>
+#include<flowtable.h>
+#include<payload.h>
+#include<sys/utsname.h>
+
+//Passed in by options.mk, defaults for builds outside of make
+#ifndef GIT_SHA
+    #define GIT_SHA "unknown"
+#endif
+#ifndef BUILD_CFLAGS
+    #define BUILD_CFLAGS "unknown"
+#endif
+#ifndef BUILD_COMPILER
+    #define BUILD_COMPILER "unknown"
+#endif
+
+//Build options from options.mk this framework was compiled with
+static const char *buildOptions[] = {
+#ifdef PHASE_TIMING
+    "PHASES",
+#endif
+#ifdef EVENT_TRACE
+    "TRACE",
+#endif
+#ifdef OCCUPANCY_SAMPLING
+    "OCCUPANCY",
+#endif
+#ifdef SPIN_POLL_TIMING
+    "SPIN",
+#endif
+#ifdef COROUTINE_SIM
+    "SIM",
+#endif
+#ifdef MULTI_PROCESS
+    "PROCS",
+#endif
+#ifdef GEN_FORCE_SCALAR
+    "GEN=scalar",
+#endif
+#ifdef GEN_FORCE_SSE
+    "GEN=sse",
+#endif
+#ifdef GEN_FORCE_AVX2
+    "GEN=avx2",
+#endif
+#ifdef RELEASE_BUILD
+    "MODE=release",
+#endif
+#ifdef PGO_GENERATE
+    "PGO=gen",
+#endif
+#ifdef PGO_USE
+    "PGO=use",
+#endif
+#ifdef FLOW_PROBE_FORCE_SCALAR
+    "PROBE=scalar",
+#endif
+#ifdef FLOW_PREFETCH
+    "PREFETCH",
+#endif
+#ifdef CRC_FORCE_TABLE
+    "CRC=table",
+#endif
+#ifdef COMPACT_HEADER
+    "HEADER=compact",
+#endif
+    NULL
+};
+
+//How the framework was optimized
+//Instrumented training runs are slower and shouldn't be compared with the others
+#if defined(PGO_GENERATE)
+    #define BUILD_MODE "pgo-training"
+#elif defined(RELEASE_BUILD) && defined(PGO_USE)
+    #define BUILD_MODE "release+pgo"
+#elif defined(RELEASE_BUILD)
+    #define BUILD_MODE "release"
+#elif defined(PGO_USE)
+    #define BUILD_MODE "pgo"
+#else
+    #define BUILD_MODE "debug"
+#endif
+
+//Command line and start time of the run
+static char commandLine[1024];
+static time_t startTime;
+
+//Remembers how the framework was started, called at the start of main()
+void results_init(int argc, char **argv){
+    size_t used = 0;
+
+    startTime = time(NULL);
+    commandLine[0] = '\0';
+    for(int i = 0; i < argc && used < sizeof(commandLine); i++){
+        used += snprintf(commandLine + used, sizeof(commandLine) - used, "%s%s", i > 0 ? " " : "", argv[i]);
+    }
+}
+
+//Writes a quoted JSON string
+static void json_string(FILE *fptr, const char *str){
+    fputc('"', fptr);
+    for(; *str; str++){
+        if(*str == '"' || *str == '\\')
+            fprintf(fptr, "\\%c", *str);
+        else if((unsigned char)*str < 0x20)
+            fprintf(fptr, "\\u%04x", *str);
+        else
+            fputc(*str, fptr);
+    }
+    fputc('"', fptr);
+}
+
+//Writes "key": "value", for string fields
+static void json_field(FILE *fptr, const char *key, const char *value){
+    fprintf(fptr, "\"%s\": ", key);
+    json_string(fptr, value);
+    fprintf(fptr, ", ");
+}
+
+//Finds the CPU model name in /proc/cpuinfo
+static void cpu_model(char *model, size_t size){
+    char line[512];
+    FILE *fptr = fopen("/proc/cpuinfo", "r");
+
+    snprintf(model, size, "unknown");
+    if(fptr == NULL)
+        return;
+
+    while(fgets(line, sizeof(line), fptr) != NULL){
+        if(strncmp(line, "model name", 10) == 0){
+            char *value = strchr(line, ':');
+            if(value != NULL){
+                value += strspn(value, ": \t");
+                value[strcspn(value, "\n")] = '\0';
+                snprintf(model, size, "%s", value);
+            }
+            break;
+        }
+    }
+
+    fclose(fptr);
+}
+
+//Writes the cores the input or output threads were pinned to as a JSON array
+static void json_cores(FILE *fptr, const char *key, io_t *threads, size_t count){
+    fprintf(fptr, "\"%s\": [", key);
+    for(size_t i = 0; i < count; i++){
+        fprintf(fptr, "%s%lu", i > 0 ? ", " : "", threads[i].threadArgs.coreNum);
+    }
+    fprintf(fptr, "], ");
+}
+
+//Appends the record of this run to RESULTS_DIR/RUNS_FILE
+void results_record(char *algName, double producerWait, double consumerWait, char *bound, hostNoise_t *noise, hostEnergy_t *energy, streamCheck_t *check){
+    char model[256];
+    char timestamp[64];
+    struct utsname host;
+
+    cpu_model(model, sizeof(model));
+    if(uname(&host) < 0)
+        memset(&host, 0, sizeof(host));
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S%z", localtime(&startTime));
+
+    //An empty header keeps the file free of anything but records
+    FILE *fptr = open_results_file(RUNS_FILE, "");
+
+    fprintf(fptr, "{");
+    json_field(fptr, "timestamp", timestamp);
+    json_field(fptr, "algorithm", algName);
+    fprintf(fptr, "\"input\": %lu, \"output\": %lu, ", inputThreadCount, outputThreadCount);
+    fprintf(fptr, "\"bits_per_second\": %lu, \"packets_per_second\": %lu, ", (finalTotal / runTime) * 8, (size_t)((finalTotal / runTime) / avgPacketSize));
+    fprintf(fptr, "\"goodput_bits_per_second\": %.0f, \"header_bytes\": %d, ", (double)((finalTotal / runTime) * 8) * PAYLOAD_SHARE, PACKET_HEADER_SIZE);
+    //Waits and bound that weren't timed (built without SPIN=1) are null
+    if(producerWait >= 0)
+        fprintf(fptr, "\"producer_wait\": %.4f, ", producerWait);
+    else
+        fprintf(fptr, "\"producer_wait\": null, ");
+    if(consumerWait >= 0)
+        fprintf(fptr, "\"consumer_wait\": %.4f, ", consumerWait);
+    else
+        fprintf(fptr, "\"consumer_wait\": null, ");
+    if(bound != NULL)
+        json_field(fptr, "bound", bound);
+    else
+        fprintf(fptr, "\"bound\": null, ");
+    json_field(fptr, "noise", noise->flags);
+    if(noise->minMHz > 0)
+        fprintf(fptr, "\"min_mhz\": %.0f, ", noise->minMHz);
+    else
+        fprintf(fptr, "\"min_mhz\": null, ");
+    fprintf(fptr, "\"max_interrupts\": %lld, \"max_switches\": %lld, ", noise->maxInterrupts, noise->maxSwitches);
+    if(energy->available)
+        fprintf(fptr, "\"watts\": %.3f, \"nj_per_packet\": %.3f, ", energy->watts, energy->nanojoulesPerPacket);
+    else
+        fprintf(fptr, "\"watts\": null, \"nj_per_packet\": null, ");
+
+    //Traffic of the run and whether the outputs passed it intact
+    fprintf(fptr, "\"seed\": %u, \"verified\": %s, \"stream_checksum\": \"%016llx\", ",
+        runSeed, check->verified ? "true" : "false", (unsigned long long)check->checksum);
+    json_field(fptr, "flow_model", flowModel);
+    json_field(fptr, "traffic_pattern", trafficPattern);
+    json_field(fptr, "size_profile", sizeProfile);
+    if(replayFile != NULL)
+        json_field(fptr, "capture", strrchr(replayFile, '/') != NULL ? strrchr(replayFile, '/') + 1 : replayFile);
+    else
+        fprintf(fptr, "\"capture\": null, ");
+    fprintf(fptr, "\"output_imbalance\": %.3f, ", output_imbalance());
+
+    //Flow churn and the flow state the output threads kept
+    flowStats_t flows;
+    flow_stats(&flows);
+    if(churnPackets > 0)
+        fprintf(fptr, "\"churn_packets\": %lu, \"flows_per_second\": %.0f, ", churnPackets, (double)flows.finished / runTime);
+    else
+        fprintf(fptr, "\"churn_packets\": null, \"flows_per_second\": null, ");
+    fprintf(fptr, "\"flows_per_input\": %lu, \"flow_table_peak\": %lu, ", FLOWS_PER_THREAD * flowLanes, flows.peak);
+
+    //Touch cost of the payload check, -d only
+    payloadSummary_t payload;
+    if(payload_summary(&payload))
+        fprintf(fptr, "\"payload_crc\": \"%s\", \"payload_fill_cycles\": %.1f, \"payload_check_cycles\": %.1f, \"payload_errors\": %.0f, ",
+            payloadCrcName, payload.fillCycles, payload.checkCycles, payload.errors);
+    else
+        fprintf(fptr, "\"payload_crc\": null, \"payload_fill_cycles\": null, \"payload_check_cycles\": null, \"payload_errors\": null, ");
+
+    //Latency from the scheduled send time, open loop pattern only
+    latencySummary_t latency;
+    if(latency_summary(&latency) && latency.packets > 0)
+        fprintf(fptr, "\"offered_pps\": %.0f, \"latency_p50_ns\": %.0f, \"latency_p99_ns\": %.0f, \"latency_p999_ns\": %.0f, \"latency_max_ns\": %.0f, ",
+            latency.offeredPps, latency.p50Ns, latency.p99Ns, latency.p999Ns, latency.maxNs);
+    else
+        fprintf(fptr, "\"offered_pps\": null, \"latency_p50_ns\": null, \"latency_p99_ns\": null, \"latency_p999_ns\": null, \"latency_max_ns\": null, ");
+
+#ifdef COROUTINE_SIM
+    //Cost per packet measured by the coroutine simulation, comparable across hosts with the same CPU
+    simCost_t cost;
+    sim_cost(&cost);
+    fprintf(fptr, "\"tsc_per_packet\": %.2f, ", cost.tscPerPacket);
+    if(cost.cyclesPerPacket >= 0)
+        fprintf(fptr, "\"cycles_per_packet\": %.2f, ", cost.cyclesPerPacket);
+    else
+        fprintf(fptr, "\"cycles_per_packet\": null, ");
+    if(cost.instructionsPerPacket >= 0)
+        fprintf(fptr, "\"instructions_per_packet\": %.2f, ", cost.instructionsPerPacket);
+    else
+        fprintf(fptr, "\"instructions_per_packet\": null, ");
+#endif
+
+    //How the run was placed
+    json_cores(fptr, "input_cores", input, inputThreadCount);
+    json_cores(fptr, "output_cores", output, outputThreadCount);
+    json_field(fptr, "command", commandLine);
+
+    //Host the run was on
+    json_field(fptr, "hostname", host.nodename);
+    json_field(fptr, "cpu", model);
+    fprintf(fptr, "\"cpus_online\": %ld, ", sysconf(_SC_NPROCESSORS_ONLN));
+    json_field(fptr, "kernel", host.release);
+    json_field(fptr, "kernel_version", host.version);
+
+    //How the framework was built
+    json_field(fptr, "compiler", BUILD_COMPILER);
+    json_field(fptr, "build_mode", BUILD_MODE);
+    json_field(fptr, "cflags", BUILD_CFLAGS);
+    json_field(fptr, "git", GIT_SHA);
+    json_field(fptr, "generator", generatorName);
+    json_field(fptr, "flow_probe", flows.probe);
+    fprintf(fptr, "\"build_options\": [");
+    for(int i = 0; buildOptions[i] != NULL; i++){
+        fprintf(fptr, "%s\"%s\"", i > 0 ? ", " : "", buildOptions[i]);
+    }
+    fprintf(fptr, "], ");
+
+    //Framework parameters the results depend on
+    fprintf(fptr, "\"params\": {\"runtime\": %d, \"buffer_size\": %d, \"max_payload\": %lu, \"avg_packet_size\": %.2f, \"flows_per_thread\": %u}",
+        runTime, BUFFERSIZE, maxPayload, avgPacketSize, FLOWS_PER_THREAD);
+
+    fprintf(fptr, "}\n");
+    fclose(fptr);
+}
@@ -0,0 +1,11 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include<global.h>
+#include<host.h>
+#include<verify.h>
+
+void results_init(int argc, char **argv);
+void results_record(char *algName, double producerWait, double consumerWait, char *bound, hostNoise_t *noise, hostEnergy_t *energy, streamCheck_t *check);
+
+#endif
@@ -0,0 +1,180 @@
+//Coroutine simulation (build with SIM=1)
+//Runs the M input and N output routines as coroutines on the main thread instead of
+//pinned realtime threads. A routine runs until it would spin (SPIN_WHILE, SPIN_MISS or
+//WAIT_FOR_START in global.h) and then yields to the next one, round robin. With no other
+//thread to race against, the instructions each packet costs are close to the same from
+//run to run, so algorithms can be compared on a laptop or in CI without isolated cores.
+//The cost includes the coroutine switches, which are reported alongside.
+
+#include<global.h>
+#include<wrapper.h>
+#include<counters.h>
+#include<sim.h>
+
+#ifdef COROUTINE_SIM
+#include<ucontext.h>
+
+//Stack of each coroutine, algorithms keep buffers of up to a few hundred KB on the stack
+#define SIM_STACK_SIZE (8 << 20)
+#define MAX_COROUTINES (MAX_NUM_INPUT_THREADS + MAX_NUM_OUTPUT_THREADS)
+
+//One input or output routine and the per thread state it would have had
+typedef struct Coroutine{
+    ucontext_t context;
+    void *stack;
+    io_t *io;
+    function entry;
+    phases_t phases;
+    spin_t spin;
+    trace_t trace;
+    verify_t verify;
+}coroutine_t;
+
+static coroutine_t coroutines[MAX_COROUTINES];
+static size_t coroutineCount;
+static size_t current;
+static ucontext_t scheduler;
+static size_t switches;
+
+//State of the main thread while no coroutine runs
+static phases_t mainPhases;
+static spin_t mainSpin;
+static trace_t mainTrace;
+static verify_t mainVerify;
+
+workerState_t workerState = {&mainPhases, &mainSpin, &mainTrace, &mainVerify};
+
+//Counter group of the main thread, read at the window boundaries by counters_snapshot()
+counters_t simCounters = {.groupFd = -1};
+
+//First function of every coroutine. Routines never return, if one does it just
+//keeps yielding so the others can carry on.
+static void sim_entry(){
+    coroutine_t *co = &coroutines[current];
+    co->entry(co->io);
+    while(1){
+        sim_yield();
+    }
+}
+
+//Sets up a coroutine for an input or output routine, it starts running in sim_start()
+void sim_spawn(io_t *io, function entry){
+    assert(coroutineCount < MAX_COROUTINES);
+    coroutine_t *co = &coroutines[coroutineCount++];
+
+    co->io = io;
+    co->entry = entry;
+    co->stack = Malloc(SIM_STACK_SIZE);
+    if(getcontext(&co->context) < 0){
+        perror("ERROR: getcontext() failed");
+        exit(1);
+    }
+    co->context.uc_stack.ss_sp = co->stack;
+    co->context.uc_stack.ss_size = SIM_STACK_SIZE;
+    co->context.uc_link = NULL;
+    makecontext(&co->context, sim_entry, 0);
+}
+
+//Switches back to the scheduler, called by SIM_YIELD() wherever a thread would spin
+void sim_yield(){
+    swapcontext(&coroutines[current].context, &scheduler);
+}
+
+//Runs every coroutine once, until it yields
+static void sim_round(){
+    for(current = 0; current < coroutineCount; current++){
+        coroutine_t *co = &coroutines[current];
+        workerState.phases = &co->phases;
+        workerState.spin = &co->spin;
+        workerState.trace = &co->trace;
+        workerState.verify = &co->verify;
+
+        swapcontext(&scheduler, &co->context);
+
+        if(startFlag && !endFlag)
+            switches++;
+    }
+    workerState.phases = &mainPhases;
+    workerState.spin = &mainSpin;
+    workerState.trace = &mainTrace;
+    workerState.verify = &mainVerify;
+}
+
+//Runs every routine up to WAIT_FOR_START() so it can set its ready flag
+void sim_start(){
+    counters_open(&simCounters, 0);
+    if(simCounters.groupFd < 0)
+        printf("Hardware counters unavailable: %s. Only TSC cycles per packet are reported.\n", strerror(simCounters.error));
+    sim_round();
+}
+
+//Runs the coroutines until the timed window ends, in place of monitor_threads()
+void sim_run(){
+    printf("Simulating %lu input and %lu output routines on one core for %d seconds\n", inputThreadCount, outputThreadCount, runTime);
+    fflush(NULL);
+    while(endFlag == 0){
+        sim_round();
+    }
+}
+
+void sim_cost(simCost_t *cost){
+    double packets = 0;
+
+    for(int i = 0; i < outputThreadCount; i++){
+        if(output[i].verify == NULL)
+            continue;
+        for(int flow = 0; flow < MAX_FLOWS; flow++){
+            packets += output[i].verify->counts[flow];
+        }
+    }
+
+    double cycles = counters_delta(&simCounters, CTR_CYCLES);
+    double instructions = counters_delta(&simCounters, CTR_INSTRUCTIONS);
+
+    cost->packets = packets;
+    cost->switches = switches;
+    cost->tscPerPacket = packets > 0 ? (double)(windowEnd - windowStart) / packets : -1;
+    cost->cyclesPerPacket = packets > 0 && cycles >= 0 ? cycles / packets : -1;
+    cost->instructionsPerPacket = packets > 0 && instructions >= 0 ? instructions / packets : -1;
+}
+
+//Prints the cost per packet and appends it to RESULTS_DIR/<alg>_sim.csv
+void sim_report(char *algName){
+    char fileName[10000];
+    simCost_t cost;
+
+    sim_cost(&cost);
+
+    printf("\nCoroutine Simulation (per packet):\n");
+    printf("%14s %12s %12s %12s %12s\n", "Packets", "Switches", "TSC", "Cycles", "Instructions");
+    printf("%14.0f %12.4f %12.1f ", cost.packets, cost.packets > 0 ? cost.switches / cost.packets : 0, cost.tscPerPacket);
+    if(cost.cyclesPerPacket < 0)
+        printf("%12s ", "-");
+    else
+        printf("%12.1f ", cost.cyclesPerPacket);
+    if(cost.instructionsPerPacket < 0)
+        printf("%12s\n", "-");
+    else
+        printf("%12.1f\n", cost.instructionsPerPacket);
+
+    snprintf(fileName, sizeof(fileName), "%s_sim.csv", algName);
+    FILE *fptr = open_results_file(fileName, "Algorithm,Input,Output,Packets,Switches,TscPerPacket,CyclesPerPacket,InstructionsPerPacket\n");
+    fprintf(fptr, "%s,%lu,%lu,%.0f,%.0f,%.2f,", algName, inputThreadCount, outputThreadCount, cost.packets, cost.switches, cost.tscPerPacket);
+    if(cost.cyclesPerPacket >= 0)
+        fprintf(fptr, "%.2f", cost.cyclesPerPacket);
+    fprintf(fptr, ",");
+    if(cost.instructionsPerPacket >= 0)
+        fprintf(fptr, "%.2f", cost.instructionsPerPacket);
+    fprintf(fptr, "\n");
+    fclose(fptr);
+}
+
+#else
+
+void sim_spawn(io_t *io, function entry){}
+void sim_start(){}
+void sim_run(){}
+void sim_cost(simCost_t *cost){}
+void sim_report(char *algName){}
+
+#endif
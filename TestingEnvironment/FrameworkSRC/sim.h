@@ -0,0 +1,30 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include<global.h>
+
+//Cost of the algorithm measured by the coroutine simulation (SIM=1)
+//packets (double) - packets passed in the timed window, counted per flow by the output routines
+//switches (double) - coroutine switches in the timed window
+//tscPerPacket (double) - TSC cycles of the window per packet
+//cyclesPerPacket (double) - core cycles per packet, -1 if the counters are unavailable
+//instructionsPerPacket (double) - user space instructions per packet, -1 if unavailable
+typedef struct SimCost{
+    double packets;
+    double switches;
+    double tscPerPacket;
+    double cyclesPerPacket;
+    double instructionsPerPacket;
+}simCost_t;
+
+#ifdef COROUTINE_SIM
+extern counters_t simCounters;
+#endif
+
+void sim_spawn(io_t *io, function entry);
+void sim_start();
+void sim_run();
+void sim_cost(simCost_t *cost);
+void sim_report(char *algName);
+
+#endif
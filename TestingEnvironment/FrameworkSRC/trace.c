@@ -0,0 +1,94 @@
+//Event trace export
+//Threads record events into their rings with TRACE() (global.h) when built with TRACE=1.
+//After the run every ring is written to RESULTS_DIR/<algName>_<M>x<N>_trace.json in the
+//Chrome trace event format, which chrome://tracing and ui.perfetto.dev both open.
+//Begin/end events are paired into complete events so each wait and each time a shared
+//slot is held shows as a bar on the thread's timeline.
+
+#include<global.h>
+#include<wrapper.h>
+#include<trace.h>
+
+#ifdef EVENT_TRACE
+//Bits of the TSC value that survive the shift into an event word
+#define TRACE_TSC_MASK (~0ULL >> TRACE_EVENT_BITS)
+
+//Writes the events of one thread. tid is the row the thread gets in the viewer.
+static void trace_thread(FILE *fptr, char *side, size_t threadNum, size_t tid, io_t *io, double ticksPerUs, int *first){
+    trace_t *trace = io->trace;
+    tsc_t begin[TRACE_IDLE_END + 1] = {0};
+    tsc_t base = windowStart & TRACE_TSC_MASK;
+
+    //Name the row after the thread and the core it ran on
+    fprintf(fptr, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s %lu (core %lu)\"}}",
+        *first ? "" : ",", tid, side, threadNum, io->threadArgs.coreNum);
+    *first = 0;
+
+    if(trace == NULL)
+        return;
+
+    //Only the last TRACE_RING_SIZE events are still in the ring
+    size_t start = trace->index > TRACE_RING_SIZE ? trace->index - TRACE_RING_SIZE : 0;
+
+    for(size_t i = start; i < trace->index; i++){
+        tsc_t word = trace->events[i & TRACE_RING_MASK];
+        int event = word & TRACE_EVENT_MASK;
+        tsc_t tsc = word >> TRACE_EVENT_BITS;
+        double ts = (double)((tsc - base) & TRACE_TSC_MASK) / ticksPerUs;
+
+        switch(event){
+            case TRACE_WAIT_BEGIN:
+            case TRACE_ACQUIRE:
+            case TRACE_IDLE_BEGIN:
+                begin[event] = tsc;
+                break;
+            case TRACE_WAIT_END:
+            case TRACE_RELEASE:
+            case TRACE_IDLE_END:
+                //The matching begin may have been overwritten when the ring wrapped
+                if(begin[event - 1] == 0)
+                    break;
+                double beginTs = (double)((begin[event - 1] - base) & TRACE_TSC_MASK) / ticksPerUs;
+                fprintf(fptr, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+                    event == TRACE_WAIT_END ? "wait" : event == TRACE_RELEASE ? "slot" : "idle", tid, beginTs, ts - beginTs);
+                begin[event - 1] = 0;
+                break;
+            case TRACE_FLUSH:
+            case TRACE_FLIP:
+                fprintf(fptr, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f}",
+                    event == TRACE_FLUSH ? "flush" : "flip", tid, ts);
+                break;
+        }
+    }
+}
+#endif
+
+//Writes every thread's event ring to RESULTS_DIR as Chrome trace JSON.
+//Only written when built with TRACE=1.
+void trace_report(char *algName){
+#ifdef EVENT_TRACE
+    char fileName[10000];
+    int first = 1;
+
+    //The timed window gives the TSC rate, used to convert events to microseconds
+    double ticksPerUs = (double)(windowEnd - windowStart) / (runTime * 1000000.0);
+    if(ticksPerUs <= 0)
+        return;
+
+    snprintf(fileName, sizeof(fileName), "%s_%lux%lu_trace.json", algName, inputThreadCount, outputThreadCount);
+    FILE *fptr = open_results_file(fileName, NULL);
+
+    fprintf(fptr, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for(int i = 0; i < inputThreadCount; i++){
+        trace_thread(fptr, "Input", i, i, &input[i], ticksPerUs, &first);
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        trace_thread(fptr, "Output", i, inputThreadCount + i, &output[i], ticksPerUs, &first);
+    }
+    fprintf(fptr, "\n]}\n");
+
+    fclose(fptr);
+
+    printf("\nEvent trace written to %s/%s\n", RESULTS_DIR, fileName);
+#endif
+}
@@ -0,0 +1,8 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include<global.h>
+
+void trace_report(char *algName);
+
+#endif
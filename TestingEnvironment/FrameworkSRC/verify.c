@@ -0,0 +1,146 @@
+//Golden stream check
+//Input threads generate their traffic from seeds split off the run seed (thread_seed()),
+//so the packets of every flow are known up front. Output threads keep a count and a
+//rolling checksum of each flow they pass (VERIFY_PACKET() in global.h). After the run the
+//generators are replayed from the same seeds and each flow's checksum is compared with
+//the one the replay gives after the same number of packets. This catches corrupted
+//lengths, misrouted flows and duplicated or dropped packets, not only reordering.
+//Under flow churn (-c) and a larger flow space (-n) the checksums are kept per flow slot and
+//cover every flow of the slot in the order they were sent, with each flow's own id and orders.
+
+#include<global.h>
+#include<verify.h>
+#include<generator.h>
+
+//Most flow mismatches printed, the rest are only counted
+#define MAX_MISMATCH_LINES 8
+
+//A flow is checked once the replay has generated as many of its packets as an
+//output thread passed, or one more if the output thread was updating it when read
+#define FLOW_PENDING 0
+#define FLOW_MATCHED 1
+#define FLOW_MISMATCHED 2
+
+static void report_mismatch(streamCheck_t *check, size_t flow, const char *reason){
+    if(check->mismatches < MAX_MISMATCH_LINES)
+        printf("Flow %lu doesn't match the golden stream: %s\n", flow, reason);
+    check->mismatches++;
+    check->verified = 0;
+}
+
+void verify_stream(streamCheck_t *check){
+    size_t counts[MAX_FLOWS] = {0};
+    uint64_t sums[MAX_FLOWS] = {0};
+    int owner[MAX_FLOWS];
+    int status[MAX_FLOWS];
+
+    check->verified = 1;
+    check->flows = 0;
+    check->mismatches = 0;
+    check->checksum = 0;
+    check->corrupt = 0;
+
+    //Gather what the output threads passed, every flow must stay on one output thread
+    for(int flow = 0; flow < MAX_FLOWS; flow++){
+        owner[flow] = -1;
+        status[flow] = FLOW_PENDING;
+    }
+    for(int i = 0; i < outputThreadCount; i++){
+        verify_t *verify = output[i].verify;
+        if(verify == NULL)
+            continue;
+        for(int flow = 0; flow < MAX_FLOWS; flow++){
+            size_t count = verify->counts[flow];
+            uint64_t sum = verify->sums[flow];
+            if(count == 0 && sum == 0)
+                continue;
+            if(owner[flow] != -1){
+                report_mismatch(check, flow, "passed by more than one output thread");
+                status[flow] = FLOW_MISMATCHED;
+                continue;
+            }
+            owner[flow] = i;
+            counts[flow] = count;
+            sums[flow] = sum;
+        }
+    }
+
+    //Flows nothing was passed for match the empty stream
+    for(int flow = 0; flow < MAX_FLOWS; flow++){
+        if(status[flow] != FLOW_PENDING)
+            continue;
+        if(owner[flow] == -1){
+            status[flow] = FLOW_MATCHED;
+        }
+        else if(flow >= inputThreadCount * FLOWS_PER_THREAD){
+            status[flow] = FLOW_MISMATCHED;
+            report_mismatch(check, flow, "no input thread generates it");
+        }
+    }
+
+    //Replay each input thread's generators until all of its flows are checked
+    for(size_t thread = 0; thread < inputThreadCount; thread++){
+        generator_t gen;
+        draw_t header;
+        size_t base = thread * FLOWS_PER_THREAD;
+        size_t generated[FLOWS_PER_THREAD] = {0};
+        uint64_t golden[FLOWS_PER_THREAD] = {0};
+        size_t pending = 0;
+        size_t limit = 1 << 20;
+
+        for(size_t local = 0; local < FLOWS_PER_THREAD; local++){
+            if(status[base + local] == FLOW_PENDING){
+                pending++;
+                limit += counts[base + local] * 4;
+            }
+        }
+
+        //The scalar generator is the reference the one the input threads used was checked against
+        generator_init(&gen, thread);
+        for(size_t packet = 0; pending > 0 && packet < limit; packet++){
+            generate_burst_scalar(&gen, &header, 1);
+            size_t local = header.flow & FLOWS_PER_THREAD_MOD;
+            size_t length = header.length;
+            size_t flow = base + local;
+            if(status[flow] != FLOW_PENDING)
+                continue;
+
+            //Numbered by lane and instance as next_header() does
+            next_flow(&gen, header.flow);
+            golden[local] = stream_step(golden[local], gen.header.flow, gen.header.order, length);
+            generated[local]++;
+            if(generated[local] >= counts[flow] && golden[local] == sums[flow]){
+                status[flow] = FLOW_MATCHED;
+                check->checksum ^= golden[local];
+                pending--;
+            }
+            else if(generated[local] > counts[flow]){
+                status[flow] = FLOW_MISMATCHED;
+                report_mismatch(check, flow, "checksum differs");
+                pending--;
+            }
+        }
+
+        generator_free(&gen);
+
+        for(size_t local = 0; local < FLOWS_PER_THREAD; local++){
+            if(status[base + local] == FLOW_PENDING)
+                report_mismatch(check, base + local, "more packets passed than the stream generates");
+        }
+    }
+
+    for(int flow = 0; flow < MAX_FLOWS; flow++){
+        if(owner[flow] != -1)
+            check->flows++;
+    }
+    if(check->mismatches > MAX_MISMATCH_LINES)
+        printf("... and %lu more flows\n", check->mismatches - MAX_MISMATCH_LINES);
+
+    //Payloads the output threads found corrupt (-d) fail the check as well
+    for(int i = 0; i < outputThreadCount; i++){
+        if(output[i].verify != NULL)
+            check->corrupt += output[i].verify->payloadErrors;
+    }
+    if(check->corrupt > 0)
+        check->verified = 0;
+}
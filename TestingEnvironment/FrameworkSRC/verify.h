@@ -0,0 +1,22 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include<global.h>
+
+//Result of checking what the output threads passed against the golden stream
+//verified (int) - 1 if every flow matched the stream the seed generates
+//flows (size_t) - flows that passed at least one packet
+//mismatches (size_t) - flows that didn't match
+//checksum (uint64_t) - golden checksum of everything passed, the same seed and counts give the same value
+//corrupt (size_t) - packets passed with a payload that failed its CRC32C (-d)
+typedef struct StreamCheck{
+    int verified;
+    size_t flows;
+    size_t mismatches;
+    uint64_t checksum;
+    size_t corrupt;
+}streamCheck_t;
+
+void verify_stream(streamCheck_t *check);
+
+#endif
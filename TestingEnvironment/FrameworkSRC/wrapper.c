@@ -92,6 +92,17 @@ void *Malloc(size_t size){
 	return returnPtr;
 }
 
+void *Realloc(void *ptr, size_t size){
+	void *returnPtr;
+
+	if((returnPtr = realloc(ptr, size)) == NULL){
+		perror("\nrealloc() error");
+		exit(1);
+	}
+
+	return returnPtr;
+}
+
 FILE *Fopen(const char *filename, const char *mode){
 	FILE *fptr;
 	
@@ -10,6 +10,7 @@ int Pthread_join(pthread_t thread, void **retval);
 int Pthread_attr_setinheritsched(pthread_attr_t *attr, int inheritsched);
 
 void *Malloc(size_t size);
+void *Realloc(void *ptr, size_t size);
 
 int Pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *mutexattr);
 int Pthread_mutex_lock(pthread_mutex_t *mutex);
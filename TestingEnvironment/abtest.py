@@ -0,0 +1,175 @@
+"""
+Interleaved A/B benchmark of two framework builds.
+
+Only uses the python standard library.
+
+Usage:
+    sudo python3 abtest.py "AP=Algorithm6/" "AP=Algorithm6/ DEFS=-DBUFFSIZEBYTES=32768" -m 4 -n 4
+    sudo python3 abtest.py frameworkA frameworkB -m 4 -n 4 --rounds 20 --window 2
+
+Each variant is either a framework executable or the make arguments that build one.
+Both run with the same M x N, so their threads are pinned to the same cores. Every
+round runs A and B back to back for --window seconds each, alternating which goes
+first (ABBA) and feeding both the same traffic (the same -s seed), so slow drift of the host (thermals, frequency, background load) hits
+both variants equally. The per round difference of B against A is then tested with
+a paired t-test, which cancels the round to round noise an unpaired comparison of two
+separate sweeps has to average out. That is what resolves changes of a few percent.
+
+Each variant runs in its own directory under Results/ab/ so its csv rows and results
+store stay apart from the normal runs. A round where either variant failed the golden
+stream check (verified false) is left out of the difference and fails the test.
+"""
+import os
+import sys
+import json
+import math
+import shlex
+import shutil
+import argparse
+import subprocess
+from compare import incompleteBeta
+
+AB_DIR = os.path.join("Results", "ab")
+
+"""
+Gets the framework executable of a variant into its run directory
+Takes in:
+    variant: path to a framework executable or make arguments to build one
+    label: "A" or "B", names the run directory
+Returns the run directory
+"""
+def prepareVariant(variant, label):
+    runDir = os.path.join(AB_DIR, label)
+    os.makedirs(runDir, exist_ok=True)
+    #Not named framework, make clean deletes every file with that name
+    executable = os.path.join(runDir, "framework_" + label)
+
+    if os.path.isfile(variant):
+        shutil.copy(variant, executable)
+    else:
+        print("Building %s: make %s" % (label, variant))
+        build = subprocess.run(["make"] + shlex.split(variant), stdout=subprocess.DEVNULL)
+        if build.returncode != 0 or not os.path.isfile("framework"):
+            print("Building variant %s failed" % label)
+            sys.exit(1)
+        shutil.copy("framework", executable)
+    return runDir
+
+"""
+Reads the records of a variant's results store
+"""
+def loadRecords(runDir):
+    storeName = os.path.join(runDir, "Results", "runs.jsonl")
+    if not os.path.isfile(storeName):
+        return []
+    with open(storeName) as runsFile:
+        return [json.loads(line) for line in runsFile if line.strip()]
+
+"""
+Runs one window of a variant and returns its record from the results store
+The framework's exit status is not reliable, a finished run is one that added a record
+"""
+def runWindow(runDir, label, inputCount, outputCount, window, seed):
+    command = ["./framework_" + label, "-t", str(window), "-s", str(seed), str(inputCount), str(outputCount), "i"]
+    before = len(loadRecords(runDir))
+    subprocess.run(command, cwd=runDir, stdout=subprocess.DEVNULL)
+    records = loadRecords(runDir)
+    if len(records) == before:
+        print("%s in %s did not finish" % (" ".join(command), runDir))
+        sys.exit(1)
+    return records[-1]
+
+"""
+Two sided critical value of the t distribution with df degrees of freedom
+"""
+def tCritical(confidence, df):
+    low, high = 0.0, 1000.0
+    for i in range(200):
+        middle = (low + high) / 2
+        if incompleteBeta(df / 2.0, 0.5, df / (df + middle * middle)) > 1 - confidence:
+            low = middle
+        else:
+            high = middle
+    return (low + high) / 2
+
+"""
+Mean, confidence interval and p-value of the paired differences (percent)
+"""
+def pairedDifference(differences, confidence):
+    count = len(differences)
+    mean = sum(differences) / count
+    if count < 2:
+        return mean, None, None, None
+    deviation = math.sqrt(sum((d - mean) ** 2 for d in differences) / (count - 1))
+    error = deviation / math.sqrt(count)
+    if error == 0:
+        return mean, mean, mean, 1.0 if mean == 0 else 0.0
+    halfWidth = tCritical(confidence, count - 1) * error
+    t = mean / error
+    p = incompleteBeta((count - 1) / 2.0, 0.5, (count - 1) / (count - 1 + t * t))
+    return mean, mean - halfWidth, mean + halfWidth, p
+
+parser = argparse.ArgumentParser(description="Interleaved A/B benchmark of two framework builds")
+parser.add_argument("a", help="variant A (baseline): framework executable or make arguments")
+parser.add_argument("b", help="variant B (candidate): framework executable or make arguments")
+parser.add_argument("-m", type=int, default=1, help="input threads (default 1)")
+parser.add_argument("-n", type=int, default=1, help="output threads (default 1)")
+parser.add_argument("--rounds", type=int, default=10, help="measured rounds, each runs A and B once (default 10)")
+parser.add_argument("--window", type=int, default=2, help="seconds each variant runs per round (default 2)")
+parser.add_argument("--warmup", type=int, default=1, help="rounds run first and discarded (default 1)")
+parser.add_argument("--seed", type=int, default=1, help="traffic seed of the first round, each round uses the next one (default 1)")
+parser.add_argument("--confidence", type=float, default=0.95, help="confidence level of the interval (default 0.95)")
+args = parser.parse_args()
+
+if os.path.isdir(AB_DIR):
+    shutil.rmtree(AB_DIR)
+runDirs = {"A": prepareVariant(args.a, "A"), "B": prepareVariant(args.b, "B")}
+
+rows = []
+differences = []
+unverified = 0
+print("\n%5s %5s %12s %12s %9s  %s" % ("Round", "Order", "A Gbs", "B Gbs", "B vs A", "Noise"))
+for roundIndex in range(args.warmup + args.rounds):
+    order = "AB" if roundIndex % 2 == 0 else "BA"
+    records = {}
+    for label in order:
+        records[label] = runWindow(runDirs[label], label, args.m, args.n, args.window, args.seed + roundIndex)
+
+    bitsA = records["A"]["bits_per_second"]
+    bitsB = records["B"]["bits_per_second"]
+    difference = (bitsB - bitsA) / bitsA * 100 if bitsA > 0 else 0.0
+    noise = ",".join(sorted(set(records[label].get("noise", "none") for label in order) - {"none"})) or "none"
+    failed = "".join(label for label in "AB" if not records[label].get("verified", True))
+    warmup = roundIndex < args.warmup
+    if not warmup:
+        if failed:
+            unverified += 1
+        else:
+            differences.append(difference)
+        rows.append([roundIndex - args.warmup + 1, order, bitsA, bitsB, "%.4f" % difference, noise, "false" if failed else "true"])
+    print("%5s %5s %12.3f %12.3f %+8.2f%%  %s%s" % ("warm" if warmup else roundIndex - args.warmup + 1, order, bitsA / 1e9, bitsB / 1e9, difference, noise,
+        "  %s failed the golden stream check" % " and ".join(failed) if failed else ""))
+
+with open(os.path.join(AB_DIR, "ab.csv"), "w") as csvFile:
+    csvFile.write("Round,Order,BitsA,BitsB,Difference,Noise,Verified\n")
+    for row in rows:
+        csvFile.write(",".join(str(value) for value in row) + "\n")
+
+if unverified:
+    print("\n%d of %d rounds left out, a variant passed packets that don't match the golden stream" % (unverified, args.rounds))
+if not differences:
+    sys.exit(1)
+mean, low, high, p = pairedDifference(differences, args.confidence)
+if low is None:
+    print("\nB vs A: %+.2f%% (one round, no interval)" % mean)
+    sys.exit(1 if unverified else 0)
+print("\nB vs A: %+.2f%%, %.0f%% CI [%+.2f%%, %+.2f%%], p = %.4f over %d rounds of %dx%d" % (
+    mean, args.confidence * 100, low, high, p, len(differences), args.m, args.n))
+if low > 0:
+    print("B is faster than A")
+elif high < 0:
+    print("B is slower than A")
+else:
+    print("No significant difference, +-%.2f%% could not be resolved (add rounds to narrow it)" % ((high - low) / 2))
+if unverified:
+    sys.exit(1)
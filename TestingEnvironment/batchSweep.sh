@@ -0,0 +1,45 @@
+#!/bin/bash
+#Sweeps the vector (batch) size of an algorithm that has a BUFFSIZEBYTES constant.
+#Usage: sudo ./batchSweep.sh Algorithm#/ <# input threads> <# output threads> [seconds] [extra make arguments]
+#Example: sudo ./batchSweep.sh Algorithm9/ 4 4 5 PROCS=1
+#
+#Builds the algorithm once per size with DEFS=-DBUFFSIZEBYTES=<size>, runs M x N and
+#prints the throughput at every size. For Algorithm9 the size is the data each send and
+#receive system call moves, so the table shows which batch amortizes the system calls.
+#Pass SOCKET_TCP etc. with BATCH_DEFS, e.g. BATCH_DEFS="-DSOCKET_TCP" sudo ./batchSweep.sh ...
+#
+#Runs are kept in Results/batch/ and their records hold the size in build_cflags.
+#The sizes can be changed with SIZES="4096 65536" sudo ./batchSweep.sh ...
+
+AP=$1
+INPUT_THREADS=$2
+OUTPUT_THREADS=$3
+SECONDS_PER_RUN=${4:-5}
+EXTRA_ARGS=("${@:5}")
+
+SIZES=${SIZES:-"4096 8192 16384 32768 65536 131072"}
+
+if [ -z "$AP" ] || [ ! -d "$AP" ] || [ -z "$OUTPUT_THREADS" ]; then
+	echo "Usage: sudo ./batchSweep.sh Algorithm#/ <# input threads> <# output threads> [seconds] [extra make arguments]"
+	exit 1
+fi
+
+if ! grep -q "ifndef BUFFSIZEBYTES" "$AP"algorithm.c; then
+	echo "$AP has no #ifndef guarded BUFFSIZEBYTES to sweep"
+	exit 1
+fi
+
+mkdir -p Results/batch
+printf "\n%12s %12s %16s\n" "Batch Bytes" "Gbs" "Packets/s" > Results/batch/sweep.txt
+for size in $SIZES; do
+	echo ">>>>>>>> BUILDING $AP WITH $size BYTE BATCHES <<<<<<<<"
+	make AP="$AP" DEFS="-DBUFFSIZEBYTES=$size $BATCH_DEFS" "${EXTRA_ARGS[@]}" > /dev/null || exit 1
+
+	echo ">>>>>>>> RUNNING INPUT: $INPUT_THREADS AND OUTPUT: $OUTPUT_THREADS <<<<<<<<"
+	(cd Results/batch && ../../framework -t "$SECONDS_PER_RUN" "$INPUT_THREADS" "$OUTPUT_THREADS" i > /dev/null)
+
+	#The run just appended its record to the results store
+	python3 -c 'import json,sys; r=json.loads(open("Results/batch/Results/runs.jsonl").readlines()[-1]); print("%12s %12.3f %16d" % (sys.argv[1], r["bits_per_second"] / 1e9, r["packets_per_second"]))' "$size" >> Results/batch/sweep.txt
+done
+
+cat Results/batch/sweep.txt
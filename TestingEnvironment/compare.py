@@ -0,0 +1,230 @@
+"""
+Compares two sets of runs from the results store (Results/runs.jsonl) and
+exits non-zero if the candidate regressed against the baseline.
+
+Only uses the python standard library.
+
+Usage:
+    python3 compare.py baseline.jsonl candidate.jsonl [options]
+    python3 compare.py Results/runs.jsonl Results/runs.jsonl --base-git abc123 --cand-git def456
+
+Runs are grouped by Algorithm, M x N and traffic (flow model and pattern). For every metric both sets have, the
+means are compared with Welch's t-test. A change counts as a regression when it is
+worse than the threshold and, if both sides have at least two runs, significant.
+Runs whose outputs failed the golden stream check (verified false) are left out, and a
+compared group with such a candidate run fails the comparison as well.
+"""
+import sys
+import json
+import math
+import argparse
+from collections import defaultdict
+
+"""
+Metrics that are compared: (record key, label, True if higher is better)
+Latency (open loop runs) and per packet cost (SIM=1 builds) are only compared when the runs recorded them
+"""
+METRICS = [
+    ("bits_per_second", "Throughput", True),
+    ("goodput_bits_per_second", "Goodput", True),
+    ("latency_p99_ns", "p99 Latency", False),
+    ("latency_p999_ns", "p99.9 Latency", False),
+    ("instructions_per_packet", "Instr/Packet", False),
+    ("cycles_per_packet", "Cycles/Packet", False),
+]
+
+"""
+Describes the generated traffic of a run, empty for uniform 64 byte packets sent back to back
+Runs with different traffic are never compared with each other
+"""
+def traffic(run):
+    parts = []
+    if run.get("capture"):
+        parts.append(run["capture"])
+    if run.get("flow_model", "uniform") != "uniform":
+        parts.append(run["flow_model"])
+    if run.get("traffic_pattern", "steady") != "steady":
+        parts.append(run["traffic_pattern"])
+    if run.get("size_profile", "fixed:64") != "fixed:64":
+        parts.append(run["size_profile"])
+    if run.get("churn_packets"):
+        parts.append("churn:%d" % run["churn_packets"])
+    if run.get("payload_crc"):
+        parts.append("payload")
+    if run.get("flows_per_input", 8) != 8:
+        parts.append("flows:%d" % run["flows_per_input"])
+    return " ".join(parts)
+
+"""
+Header sizes of a group of runs, runs from before goodput was recorded had 24 byte headers
+"""
+def headerBytes(runs):
+    return set(run.get("header_bytes", 24) for run in runs)
+
+"""
+Reads every record from a results store file
+Takes in:
+    fileName: path to a .jsonl file
+    gitPrefix: only keep runs whose git commit starts with this, None keeps all
+    skipNoisy: drop runs the framework flagged as disturbed by the host
+"""
+def loadRuns(fileName, gitPrefix, skipNoisy):
+    groups = defaultdict(list)
+    with open(fileName) as runsFile:
+        for line in runsFile:
+            line = line.strip()
+            if not line:
+                continue
+            run = json.loads(line)
+            if gitPrefix is not None and not run.get("git", "").startswith(gitPrefix):
+                continue
+            if skipNoisy and run.get("noise", "none") != "none":
+                continue
+            groups[(run["algorithm"], run["input"], run["output"], traffic(run))].append(run)
+    return groups
+
+"""
+Splits off the runs whose outputs lost, duplicated, reordered or corrupted packets
+Runs from before the golden stream check was recorded count as verified
+Returns the groups without them and {group: number of runs that failed the check}
+"""
+def splitUnverified(groups):
+    verified = defaultdict(list)
+    failed = defaultdict(int)
+    for key, runs in groups.items():
+        for run in runs:
+            if run.get("verified", True):
+                verified[key].append(run)
+            else:
+                failed[key] += 1
+    return verified, failed
+
+"""
+Continued fraction for the regularized incomplete beta function (modified Lentz)
+"""
+def betaContinuedFraction(a, b, x):
+    tiny = 1e-300
+    c = 1.0
+    d = 1.0 - (a + b) * x / (a + 1.0)
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    result = d
+    for m in range(1, 300):
+        m2 = 2 * m
+        numerator = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2))
+        d = 1.0 + numerator * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + numerator / c
+        c = c if abs(c) > tiny else tiny
+        result *= d * c
+        numerator = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0))
+        d = 1.0 + numerator * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + numerator / c
+        c = c if abs(c) > tiny else tiny
+        delta = d * c
+        result *= delta
+        if abs(delta - 1.0) < 1e-12:
+            break
+    return result
+
+"""
+Regularized incomplete beta function I_x(a, b)
+"""
+def incompleteBeta(a, b, x):
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    logFront = math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) + a * math.log(x) + b * math.log(1.0 - x)
+    if x < (a + 1.0) / (a + b + 2.0):
+        return math.exp(logFront) * betaContinuedFraction(a, b, x) / a
+    return 1.0 - math.exp(logFront) * betaContinuedFraction(b, a, 1.0 - x) / b
+
+"""
+Two sided p-value of Welch's t-test, None if either side has fewer than two runs
+"""
+def welchTest(base, cand):
+    if len(base) < 2 or len(cand) < 2:
+        return None
+    meanBase = sum(base) / len(base)
+    meanCand = sum(cand) / len(cand)
+    varBase = sum((v - meanBase) ** 2 for v in base) / (len(base) - 1)
+    varCand = sum((v - meanCand) ** 2 for v in cand) / (len(cand) - 1)
+    errBase = varBase / len(base)
+    errCand = varCand / len(cand)
+    if errBase + errCand == 0:
+        return 1.0 if meanBase == meanCand else 0.0
+    t = (meanCand - meanBase) / math.sqrt(errBase + errCand)
+    df = (errBase + errCand) ** 2 / (errBase ** 2 / (len(base) - 1) + errCand ** 2 / (len(cand) - 1))
+    return incompleteBeta(df / 2.0, 0.5, df / (df + t * t))
+
+"""
+Compares every Algorithm and M x N both sets ran, prints a table and returns
+the number of regressions found
+"""
+def compare(baseGroups, candGroups, threshold, alpha):
+    regressions = 0
+    print("%-12s %5s %-14s %16s %16s %9s %8s  %s" % ("Algorithm", "MxN", "Metric", "Baseline (n)", "Candidate (n)", "Change", "p", "Verdict"))
+    for key in sorted(set(baseGroups) & set(candGroups)):
+        algorithm, inputCount, outputCount, trafficName = key
+        if trafficName:
+            algorithm += " " + trafficName
+        for metric, label, higherIsBetter in METRICS:
+            base = [run[metric] for run in baseGroups[key] if run.get(metric) is not None]
+            cand = [run[metric] for run in candGroups[key] if run.get(metric) is not None]
+            if not base or not cand:
+                continue
+            #Wire throughput counts the headers, so builds with different header sizes only compare goodput
+            if metric == "bits_per_second" and headerBytes(baseGroups[key]) != headerBytes(candGroups[key]):
+                continue
+            meanBase = sum(base) / len(base)
+            meanCand = sum(cand) / len(cand)
+            if meanBase == 0:
+                continue
+            change = (meanCand - meanBase) / meanBase * 100
+            worse = -change if higherIsBetter else change
+            p = welchTest(base, cand)
+
+            if worse > threshold and (p is None or p < alpha):
+                verdict = "REGRESSION" if p is not None else "REGRESSION (untested, n<2)"
+                regressions += 1
+            elif -worse > threshold and (p is None or p < alpha):
+                verdict = "improved"
+            else:
+                verdict = "ok"
+
+            print("%-12s %5s %-14s %12.4g (%d) %12.4g (%d) %+8.2f%% %8s  %s" % (algorithm, "%dx%d" % (inputCount, outputCount), label,
+                meanBase, len(base), meanCand, len(cand), change, "-" if p is None else "%.4f" % p, verdict))
+    return regressions
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compare two sets of runs from the results store")
+    parser.add_argument("baseline", help="results store (.jsonl) with the baseline runs")
+    parser.add_argument("candidate", help="results store (.jsonl) with the candidate runs")
+    parser.add_argument("--threshold", type=float, default=5.0, help="percent change that counts as a regression (default 5)")
+    parser.add_argument("--alpha", type=float, default=0.05, help="significance level (default 0.05)")
+    parser.add_argument("--base-git", help="only use baseline runs built from this commit")
+    parser.add_argument("--cand-git", help="only use candidate runs built from this commit")
+    parser.add_argument("--skip-noisy", action="store_true", help="ignore runs flagged as disturbed by the host")
+    args = parser.parse_args()
+
+    baseGroups, baseFailed = splitUnverified(loadRuns(args.baseline, args.base_git, args.skip_noisy))
+    candGroups, candFailed = splitUnverified(loadRuns(args.candidate, args.cand_git, args.skip_noisy))
+    common = (set(baseGroups) | set(baseFailed)) & (set(candGroups) | set(candFailed))
+    if not common:
+        print("No Algorithm and M x N in common between the two sets of runs")
+        sys.exit(2)
+
+    regressions = compare(baseGroups, candGroups, args.threshold, args.alpha)
+
+    for key in sorted(baseFailed):
+        print("\nLeft out %d baseline run(s) of %s %dx%d that failed the golden stream check" % (baseFailed[key], " ".join(key[:1] + key[3:]).strip(), key[1], key[2]))
+    unverified = 0
+    for key in sorted(set(candFailed) & common):
+        print("\nFAILED: %d candidate run(s) of %s %dx%d failed the golden stream check" % (candFailed[key], " ".join(key[:1] + key[3:]).strip(), key[1], key[2]))
+        unverified += 1
+
+    if regressions or unverified:
+        print("\n%d regression(s) beyond %.1f%%, %d group(s) with candidate runs that failed the golden stream check" % (regressions, args.threshold, unverified))
+        sys.exit(1)
+    print("\nNo regressions beyond %.1f%%" % args.threshold)
@@ -0,0 +1,62 @@
+#!/bin/bash
+#Steps the offered load of open loop runs (-p open) up to the measured capacity of each algorithm.
+#Usage: sudo ./loadSweep.sh "Algorithm#/ [Algorithm#/ ...]" <# input threads> <# output threads> [seconds] [extra make arguments]
+#Example: sudo ./loadSweep.sh "Algorithm1/ Algorithm4/" 2 2 5 MODE=release
+#
+#Runs every algorithm once back to back (-p steady) to measure its capacity, then open loop
+#at each percentage in LOADS of that capacity, split evenly between the input threads, and
+#prints the latency percentiles measured from the scheduled send time at every load. Past
+#the knee of the curve p99 climbs steeply, well before the throughput stops following the load.
+#
+#Runs are kept in Results/load/, the curve of each algorithm in Results/load/<name>_sweep.csv.
+#The loads can be changed with LOADS="50 90 95 99" sudo ./loadSweep.sh ...
+#Pass framework flags (e.g. -l imix -f zipf:1.2) with FRAMEWORK_ARGS="-l imix" sudo ./loadSweep.sh ...
+
+ALGORITHMS=$1
+INPUT_THREADS=$2
+OUTPUT_THREADS=$3
+SECONDS_PER_RUN=${4:-5}
+EXTRA_ARGS=("${@:5}")
+
+LOADS=${LOADS:-"10 20 30 40 50 60 70 80 90 100"}
+
+if [ -z "$ALGORITHMS" ] || [ -z "$OUTPUT_THREADS" ]; then
+	echo "Usage: sudo ./loadSweep.sh \"Algorithm#/ [Algorithm#/ ...]\" <# input threads> <# output threads> [seconds] [extra make arguments]"
+	exit 1
+fi
+
+#Prints fields of the record the last run appended to the results store
+last_record() {
+	python3 -c 'import json,sys; r=json.loads(open("Results/load/Results/runs.jsonl").readlines()[-1]); print(" ".join(str(r[k]) for k in sys.argv[1:]))' "$@"
+}
+
+mkdir -p Results/load
+for AP in $ALGORITHMS; do
+	if [ ! -d "$AP" ]; then
+		echo "$AP is not an algorithm folder"
+		exit 1
+	fi
+
+	echo ">>>>>>>> BUILDING $AP <<<<<<<<"
+	make AP="$AP" "${EXTRA_ARGS[@]}" > /dev/null || exit 1
+
+	echo ">>>>>>>> MEASURING CAPACITY, INPUT: $INPUT_THREADS AND OUTPUT: $OUTPUT_THREADS <<<<<<<<"
+	(cd Results/load && ../../framework $FRAMEWORK_ARGS -t "$SECONDS_PER_RUN" "$INPUT_THREADS" "$OUTPUT_THREADS" i > /dev/null)
+	read -r NAME CAPACITY <<< "$(last_record algorithm packets_per_second)"
+
+	SWEEP=Results/load/"$NAME"_sweep.csv
+	echo "Load,OfferedPps,PassedPps,P50Ns,P99Ns,P999Ns,MaxNs" > "$SWEEP"
+	for load in $LOADS; do
+		#Million packets per second for each input thread
+		RATE=$(python3 -c "print('%.6f' % ($CAPACITY * $load / 100.0 / $INPUT_THREADS / 1e6))")
+		echo ">>>>>>>> RUNNING $NAME AT $load% ($RATE Mpps PER INPUT THREAD) <<<<<<<<"
+		(cd Results/load && ../../framework $FRAMEWORK_ARGS -t "$SECONDS_PER_RUN" -p open:"$RATE" "$INPUT_THREADS" "$OUTPUT_THREADS" i > /dev/null)
+		echo "$load,$(last_record offered_pps packets_per_second latency_p50_ns latency_p99_ns latency_p999_ns latency_max_ns | tr ' ' ',')" >> "$SWEEP"
+	done
+
+	printf "\n%s %sx%s, capacity %'d packets/s\n" "$NAME" "$INPUT_THREADS" "$OUTPUT_THREADS" "$CAPACITY"
+	printf "%6s %14s %14s %12s %12s %12s\n" "Load" "Offered" "Passed" "p50 ns" "p99 ns" "p99.9 ns"
+	tail -n +2 "$SWEEP" | while IFS=, read -r load offered passed p50 p99 p999 max; do
+		printf "%5s%% %14s %14s %12s %12s %12s\n" "$load" "$offered" "$passed" "$p50" "$p99" "$p999"
+	done
+done
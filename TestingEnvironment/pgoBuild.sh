@@ -0,0 +1,44 @@
+#!/bin/bash
+#Profile guided release build of one algorithm.
+#Usage: sudo ./pgoBuild.sh Algorithm#/ [training seconds] [extra make arguments]
+#
+#1. Builds the framework and the algorithm instrumented (MODE=release PGO=gen)
+#2. Runs a training sweep so the profile covers few and many threads on both sides
+#3. Rebuilds with the profile (MODE=release PGO=use), leaving ./framework ready to run
+#
+#Training runs are kept apart from real results in Results/pgo/ and are recorded
+#with build_mode "pgo-training" in their results store.
+
+AP=$1
+SECONDS_PER_RUN=${2:-2}
+EXTRA_ARGS=("${@:3}")
+
+#M x N points of the training sweep
+TRAINING="1:1 2:2 4:4 8:8 1:8 8:1"
+
+if [ -z "$AP" ] || [ ! -d "$AP" ]; then
+	echo "Usage: sudo ./pgoBuild.sh Algorithm#/ [training seconds] [extra make arguments]"
+	exit 1
+fi
+
+#Profiles from an earlier build would be merged into this one
+find FrameworkSRC/ "$AP" -name "*.gcda" -type f -delete
+
+echo ">>>>>>>> BUILDING INSTRUMENTED $AP <<<<<<<<"
+make AP="$AP" MODE=release PGO=gen "${EXTRA_ARGS[@]}" || exit 1
+
+mkdir -p Results/pgo
+for point in $TRAINING; do
+	inputT=${point%:*}
+	outputT=${point#*:}
+	echo ">>>>>>>> TRAINING ON INPUT: $inputT AND OUTPUT: $outputT <<<<<<<<"
+	(cd Results/pgo && ../../framework -t "$SECONDS_PER_RUN" "$inputT" "$outputT" i > /dev/null)
+done
+
+if [ -z "$(find FrameworkSRC/ "$AP" -name "*.gcda" -type f)" ]; then
+	echo "Training did not write a profile, the instrumented framework must run to completion"
+	exit 1
+fi
+
+echo ">>>>>>>> BUILDING $AP WITH PROFILE <<<<<<<<"
+make AP="$AP" MODE=release PGO=use "${EXTRA_ARGS[@]}" || exit 1
@@ -0,0 +1,174 @@
+"""
+Fits the Universal Scalability Law to the M x N sweep results of each algorithm.
+
+Only uses the python standard library.
+
+Usage:
+    python3 usl.py <results> [<results> ...] [--predict 32] [--csv usl.csv]
+
+Results can be "algorithm name".csv files, results stores (.jsonl) or directories
+holding them. Runs of the same Algorithm and M x N are averaged. Runs of a results store
+that failed the golden stream check (verified false) are skipped, the csv files don't
+record it.
+
+    X(n) = X(1) * n / (1 + sigma * (n - 1) + kappa * n * (n - 1))
+
+sigma is the contention (serialization) and kappa the coherency (crosstalk) cost.
+Throughput is fitted as a function of the input thread count M at every output
+thread count N, of N at every M, and along M = N. Each fit reports sigma, kappa,
+the thread count where throughput peaks, R^2 of the fitted throughput and the
+throughput it predicts at --predict threads.
+"""
+import os
+import sys
+import csv
+import json
+import math
+import argparse
+from collections import defaultdict
+
+"""
+Reads throughput from "algorithm name".csv files and results stores
+Returns {algorithm: {(M, N): [bits per second, ...]}} and the number of runs skipped
+"""
+def loadResults(paths):
+    results = defaultdict(lambda: defaultdict(list))
+    unverified = 0
+    files = []
+    for path in paths:
+        if os.path.isdir(path):
+            for root, dirs, names in os.walk(path):
+                files += [os.path.join(root, name) for name in names if name.endswith(".csv") or name.endswith(".jsonl")]
+        else:
+            files.append(path)
+
+    for fileName in files:
+        with open(fileName) as resultsFile:
+            if fileName.endswith(".jsonl"):
+                for line in resultsFile:
+                    if line.strip():
+                        run = json.loads(line)
+                        if not run.get("verified", True):
+                            unverified += 1
+                            continue
+                        results[run["algorithm"]][(run["input"], run["output"])].append(float(run["bits_per_second"]))
+            else:
+                reader = csv.DictReader(resultsFile)
+                #Skip the per thread csv files, only the throughput files have Bits. The
+                #_summary.csv files in Results/ repeat the rows of "algorithm name".csv
+                if reader.fieldnames is None or "Bits" not in reader.fieldnames or fileName.endswith("_summary.csv"):
+                    continue
+                for row in reader:
+                    results[row["Algorithm"]][(int(row["Input"]), int(row["Output"]))].append(float(row["Bits"]))
+    return results, unverified
+
+"""
+Least squares fit of y = a * x + b * x^2 with a, b >= 0 (sigma + kappa and kappa)
+"""
+def fitCoefficients(xs, ys):
+    sxx = sum(x * x for x in xs)
+    sx3 = sum(x ** 3 for x in xs)
+    sx4 = sum(x ** 4 for x in xs)
+    sxy = sum(x * y for x, y in zip(xs, ys))
+    sx2y = sum(x * x * y for x, y in zip(xs, ys))
+
+    det = sxx * sx4 - sx3 * sx3
+    if det != 0:
+        a = (sxy * sx4 - sx2y * sx3) / det
+        b = (sxx * sx2y - sx3 * sxy) / det
+        if a >= b >= 0:
+            return a, b
+
+    #Fall back to the best fit with one of the terms fixed at its bound:
+    #no coherency cost (b = 0) or no contention (a = b)
+    candidates = []
+    if sxx > 0:
+        a = max(sxy / sxx, 0.0)
+        candidates.append((a, 0.0))
+    denominator = sum((x + x * x) ** 2 for x in xs)
+    if denominator > 0:
+        b = max(sum((x + x * x) * y for x, y in zip(xs, ys)) / denominator, 0.0)
+        candidates.append((b, b))
+    if not candidates:
+        return 0.0, 0.0
+    return min(candidates, key=lambda c: sum((y - c[0] * x - c[1] * x * x) ** 2 for x, y in zip(xs, ys)))
+
+"""
+Throughput the fitted law predicts at n threads
+"""
+def uslThroughput(base, sigma, kappa, n):
+    return base * n / (1 + sigma * (n - 1) + kappa * n * (n - 1))
+
+"""
+Fits one series {n: mean throughput}. Needs a point at n = 1 and at least three points.
+Returns None if the series can't be fitted.
+"""
+def fitSeries(series, predict):
+    if 1 not in series or len(series) < 3 or series[1] <= 0:
+        return None
+    base = series[1]
+    counts = sorted(series)
+
+    #Linearized form: n / C(n) - 1 = (sigma + kappa) * (n - 1) + kappa * (n - 1)^2
+    xs = [n - 1.0 for n in counts]
+    ys = [n / (series[n] / base) - 1.0 for n in counts]
+    a, kappa = fitCoefficients(xs, ys)
+    sigma = a - kappa
+
+    #Fit quality on the throughput itself
+    mean = sum(series.values()) / len(series)
+    total = sum((series[n] - mean) ** 2 for n in counts)
+    residual = sum((series[n] - uslThroughput(base, sigma, kappa, n)) ** 2 for n in counts)
+    rSquared = 1 - residual / total if total > 0 else 1.0
+
+    peak = math.sqrt((1 - sigma) / kappa) if kappa > 0 and sigma < 1 else math.inf
+    return {"sigma": sigma, "kappa": kappa, "peak": peak, "r2": rSquared, "points": len(series),
+            "predicted": uslThroughput(base, sigma, kappa, predict)}
+
+"""
+Builds the series of one algorithm: M at every N, N at every M and M = N
+"""
+def buildSeries(points):
+    means = {key: sum(values) / len(values) for key, values in points.items()}
+    inputs = sorted(set(m for m, n in means))
+    outputs = sorted(set(n for m, n in means))
+    series = []
+    for n in outputs:
+        series.append(("M", "N=%d" % n, {m: means[(m, n)] for m in inputs if (m, n) in means}))
+    for m in inputs:
+        series.append(("N", "M=%d" % m, {n: means[(m, n)] for n in outputs if (m, n) in means}))
+    series.append(("M=N", "-", {m: means[(m, m)] for m in inputs if (m, m) in means}))
+    return series
+
+parser = argparse.ArgumentParser(description="Fit the Universal Scalability Law to M x N sweep results")
+parser.add_argument("results", nargs="+", help="csv files, results stores (.jsonl) or directories holding them")
+parser.add_argument("--predict", type=int, default=32, help="thread count to predict throughput at (default 32)")
+parser.add_argument("--csv", help="also write the fits to this csv file")
+args = parser.parse_args()
+
+results, unverified = loadResults(args.results)
+if unverified:
+    print("Skipped %d run(s) that failed the golden stream check" % unverified)
+if not results:
+    print("No results found")
+    sys.exit(1)
+
+rows = []
+for algorithm in sorted(results):
+    print("\n%s" % algorithm)
+    print("%-5s %-5s %6s %10s %10s %8s %8s %14s" % ("Vary", "Fixed", "Points", "Sigma", "Kappa", "Peak", "R^2", "Gbs@%d" % args.predict))
+    for vary, fixed, series in buildSeries(results[algorithm]):
+        fit = fitSeries(series, args.predict)
+        if fit is None:
+            print("%-5s %-5s %6d %s" % (vary, fixed, len(series), "  not enough points (needs 1 thread and 3 counts)"))
+            continue
+        peak = "none" if math.isinf(fit["peak"]) else "%.1f" % fit["peak"]
+        print("%-5s %-5s %6d %10.5f %10.6f %8s %8.3f %14.3f" % (vary, fixed, fit["points"], fit["sigma"], fit["kappa"], peak, fit["r2"], fit["predicted"] / 1e9))
+        rows.append([algorithm, vary, fixed, fit["points"], "%.6f" % fit["sigma"], "%.8f" % fit["kappa"],
+                     "" if math.isinf(fit["peak"]) else "%.2f" % fit["peak"], "%.4f" % fit["r2"], args.predict, "%.0f" % fit["predicted"]])
+
+if args.csv:
+    with open(args.csv, "w", newline="") as csvFile:
+        writer = csv.writer(csvFile)
+        writer.writerow(["Algorithm", "Vary", "Fixed", "Points", "Sigma", "Kappa", "Peak", "R2", "PredictAt", "PredictedBits"])
+        writer.writerows(rows)